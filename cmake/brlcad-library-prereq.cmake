@@ -1,11 +1,38 @@
 #======================================================================
 # BRL-CAD
-find_library(BRLCAD
-  NAMES bn bu brep rt
-  PATHS ENV
+#
+# The headers live in <prefix>/include/brlcad.  Look only in BRL-CAD
+# install trees for the libraries: the system has a POSIX 'librt' too.
+set(BRLCAD_PREFIXES
+  $ENV{BRLCAD_ROOT}
+  /usr/brlcad
+  /usr/local/brlcad
+  /usr/local
 )
-if(BRLCAD)
-  include_directories(${GDAL_INCLUDE_DIRS})
+find_path(BRLCAD_INCLUDE_DIR
+  NAMES wdb.h
+  PATHS ${BRLCAD_PREFIXES}
+  PATH_SUFFIXES include/brlcad
+  NO_DEFAULT_PATH
+)
+foreach(lib wdb rt bn bu)
+  string(TOUPPER ${lib} LIB)
+  find_library(BRLCAD_${LIB}_LIBRARY
+    NAMES ${lib}
+    PATHS ${BRLCAD_PREFIXES}
+    PATH_SUFFIXES lib lib64
+    NO_DEFAULT_PATH
+  )
+endforeach()
+if(BRLCAD_INCLUDE_DIR AND BRLCAD_WDB_LIBRARY AND BRLCAD_RT_LIBRARY
+   AND BRLCAD_BN_LIBRARY AND BRLCAD_BU_LIBRARY)
+  include_directories(${BRLCAD_INCLUDE_DIR})
+  set(BRLCAD_LIBRARIES
+    ${BRLCAD_WDB_LIBRARY}
+    ${BRLCAD_RT_LIBRARY}
+    ${BRLCAD_BN_LIBRARY}
+    ${BRLCAD_BU_LIBRARY}
+  )
   message(
     "Required BRL-CAD libraries were found."
   )
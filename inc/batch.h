@@ -0,0 +1,64 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Batch mode: many inputs converted in one process.
+//
+// Inputs on the command line may be CATD files, directories (searched
+// recursively for '*CATD.DDF') or '@listfile' (one path per line,
+// blank lines and '#' comments skipped; a listed path may itself be a
+// directory).  Each input's outputs are named from a pattern (see
+// output_name()), the inputs run on a bounded pool of worker threads,
+// and a summary table of sizes, times and failures is printed at the
+// end.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+
+// what happened to one input
+struct JobResult {
+  std::string input;
+  std::string name;       // output base name
+  int         nx;
+  int         ny;
+  long long   in_bytes;   // all files of the data set
+  long long   out_bytes;  // all output files
+  double      seconds;
+  bool        ok;
+  std::string error;      // short reason when !ok
+
+  JobResult()
+    : nx(0), ny(0), in_bytes(0), out_bytes(0), seconds(0), ok(false)
+  {}
+};
+
+// expand 'args' into input files, in order; 'expanded' is set if any
+// argument was a directory or a list.  False (with a message) if a
+// list can't be read or a directory holds no CATD file.
+bool collect_inputs(const std::vector<std::string>& args,
+                    std::vector<std::string>& inputs, bool& expanded);
+
+// the output base name for input number 'index' (0-based) from
+// 'pattern', where
+//
+//   %d  the name of the input's directory
+//   %b  the input's file name without its extension
+//   %n  the input's number (1-based)
+//   %%  a '%'
+std::string output_name(const std::string& pattern, const std::string& input,
+                        const int index);
+
+// run 'job(i)' for i in [0, njobs) on 'nworkers' threads (0 = all
+// cores); jobs start in index order
+void run_pool(const int njobs, const int nworkers,
+              const std::function<void(int)>& job);
+
+// size of a file in bytes (0 if it doesn't exist)
+long long file_size(const std::string& fname);
+
+// the table and totals; 'wall' is the whole batch's wall time
+void print_summary(FILE* fp, const std::vector<JobResult>& results,
+                   const int nworkers, const double wall);
+
+#endif // BATCH_H
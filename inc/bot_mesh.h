@@ -0,0 +1,99 @@
+#ifndef BOT_MESH_H
+#define BOT_MESH_H
+
+// Adaptive triangle mesh (BoT) export (for '--bot[=E]'): the grid as a
+// closed mesh whose top is within E meters of every cell, so flat
+// ground costs a few big triangles instead of the DSP's two per cell.
+//
+// The top is a right triangle (restricted quadtree) triangulation.
+// The grid is cut into aligned squares of 2^k cells (256, smaller
+// along the far edges), each halved along a diagonal, and a triangle
+// is split at the midpoint of its hypotenuse while some cell under it
+// is more than E off its plane.  A midpoint's error is the largest of
+// the triangles it splits and of their children's midpoints, so a
+// split forces its neighbors' and the mesh has no cracks.  That holds
+// across squares too: their errors are kept in one grid, the corners
+// of every square always split its neighbors down to them, and the
+// squares work out one triangle size at a time, smallest first, on
+// worker threads taking squares from a shared counter.
+//
+// Like the DSP solid the mesh is closed: its sides go straight down to
+// 0 and the bottom is a fan from its center.  Faces are counter-
+// clockwise seen from outside.
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+class BotMesh {
+public:
+  // 'z' is nx by ny heights (row 0 north) in units of 'zunit' meters,
+  // 'cellx' by 'celly' meters apart; works out every midpoint's error
+  BotMesh(const std::vector<float>& z, const int nx, const int ny,
+          const double cellx, const double celly, const double zunit,
+          const int nthreads = 0);
+
+  // top triangles within 'max_error' meters
+  long long count(const double max_error) const;
+
+  // the closed mesh within 'max_error' meters: x, y, z (meters) of
+  // every vertex, then three vertex indices per face
+  void extract(const double max_error, std::vector<double>& vertices,
+               std::vector<int>& faces);
+
+  // the mesh's size against the DSP's, the triangles at a few other
+  // errors, and time spent
+  void print(FILE* fp, const std::string& what,
+             const double max_error) const;
+
+private:
+  BotMesh(const BotMesh&);
+  BotMesh& operator=(const BotMesh&);
+
+  struct Square {
+    int x0;       // first cell column and row
+    int y0;
+    int k;        // 2^k cells a side
+  };
+
+  // corners: a and b end the hypotenuse, c is the right angle
+  struct Tri {
+    int ax, ay;
+    int bx, by;
+    int cx, cy;
+  };
+
+  void add_squares(const int x0, const int y0, const int k);
+  // triangle 'i' of the 2^(d+1) of square 'q' at depth 'd'
+  Tri triangle(const Square& q, const int d, const int i) const;
+  // the largest distance (height units) of a cell under 't' from its
+  // plane
+  float plane_error(const Tri& t) const;
+  void split_errors(const Square& q, const int size);
+  // the top triangles of square 'q' within 'tol' height units
+  void top(const Square& q, const float tol, std::vector<int>* points,
+           long long& n) const;
+  void top(const Tri& t, const int size, const float tol,
+           std::vector<int>* points, long long& n) const;
+
+  const std::vector<float>& z;
+  const int    nx;
+  const int    ny;
+  const double cellx;
+  const double celly;
+  const double zunit;
+  int          nthreads;
+
+  std::vector<Square>                    squares;
+  std::unique_ptr<std::atomic<float>[]>  error;  // per cell, height units
+
+  double    error_seconds;
+  double    mesh_seconds;
+  long long top_faces;
+  long long nfaces;
+  long long nvertices;
+};
+
+#endif // BOT_MESH_H
@@ -0,0 +1,48 @@
+#ifndef BUILD_MANIFEST_H
+#define BUILD_MANIFEST_H
+
+// Content-hash manifest for the incremental mode ('--incremental').
+//
+// Each output artifact is recorded with a key: a hash of the input
+// data set's file contents and of the option values that went into
+// the artifact, chained through the keys of the artifacts it was made
+// from.  A stage whose recorded key matches (and whose artifact still
+// exists) need not be run again.  The manifest is a text file with
+// one "key artifact" line per artifact.
+
+#include <map>
+#include <string>
+
+typedef unsigned long long Hash;
+
+// 64-bit FNV-1a
+const Hash HASH_SEED = 14695981039346656037ULL;
+
+Hash hash_bytes(const void* data, const size_t n, const Hash seed = HASH_SEED);
+Hash hash_string(const std::string& s, const Hash seed = HASH_SEED);
+Hash hash_int(const long long v, const Hash seed = HASH_SEED);
+// hash a file's contents; false if it can't be read
+bool hash_file(const std::string& path, Hash& h);
+
+class BuildManifest {
+public:
+  explicit BuildManifest(const std::string& fname);
+
+  // read the manifest (a missing file is an empty manifest)
+  void load();
+  bool save() const;
+
+  // true if 'artifact' was recorded with 'key' and still exists
+  bool up_to_date(const std::string& artifact, const Hash key) const;
+
+  void record(const std::string& artifact, const Hash key);
+  void forget(const std::string& artifact);
+
+  const std::string& path() const { return fname; }
+
+private:
+  std::string                 fname;
+  std::map<std::string, Hash> keys;
+};
+
+#endif // BUILD_MANIFEST_H
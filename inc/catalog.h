@@ -0,0 +1,85 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+// Machine-readable data set info (for '--info=json' and '--catalog').
+//
+// probe_dataset() gathers what '--info' prints (files, driver, size,
+// geotransform, SRS, units, block size, cell type, no-data value and
+// the stored range), reading headers only unless asked for the exact
+// statistics (see raster_stats.h); to_json() writes it as one line of
+// JSON, so tools need no longer scrape the text.
+//
+// write_catalog() probes many inputs (see collect_inputs() in batch.h)
+// on a pool of worker threads, each on a handle of its own, and writes
+// one record a line (JSON Lines) in input order, every record as soon
+// as those before it are done.  Inputs that fail still get a record,
+// with "ok": false and the reason.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "raster_stats.h"
+
+struct DatasetInfo {
+  std::string              file;
+  bool                     ok;
+  std::string              error;       // the reason when !ok (GDAL's
+                                        // message if it can't be opened)
+  double                   open_ms;
+  std::string              driver;
+  std::vector<std::string> files;       // all files of the data set
+  long long                bytes;       // their total size
+  int                      nx;
+  int                      ny;
+  int                      nbands;
+  bool                     has_transform;
+  double                   transform[6];  // GDAL's geotransform
+  std::string              wkt;         // empty: no SRS
+  std::string              projcs;      // names from the SRS
+  std::string              geogcs;
+  std::string              datum;
+  std::string              epsg;        // EPSG code, if any
+  std::string              xy_unit;     // linear unit name
+  double                   xy_meters;   // meters per xy unit
+  std::string              z_unit;      // the band's unit type
+  double                   z_scale;
+  double                   z_offset;
+  int                      blockx;
+  int                      blocky;
+  std::string              data_type;
+  bool                     has_nodata;
+  double                   nodata;
+  bool                     has_range;   // stored in the header
+  double                   min;
+  double                   max;
+  int                      noverviews;
+  bool                     has_stats;
+  RasterStats              stats;
+
+  DatasetInfo()
+    : ok(false), open_ms(0), bytes(0), nx(0), ny(0), nbands(0),
+      has_transform(false), xy_meters(0), z_scale(1), z_offset(0),
+      blockx(0), blocky(0), has_nodata(false), nodata(0),
+      has_range(false), min(0), max(0), noverviews(0), has_stats(false)
+  {
+    for (int i = 0; i < 6; ++i)
+      transform[i] = 0;
+  }
+};
+
+// open 'fname' and read its headers into 'd'; with 'nbins' > 0 also
+// its exact statistics on 'nthreads' threads (0 = all cores).  False
+// (with d.error) if it can't be opened or read.
+bool probe_dataset(const std::string& fname, const int nbins,
+                   const int nthreads, DatasetInfo& d);
+
+// 'd' as one line of JSON (no newline)
+std::string to_json(const DatasetInfo& d);
+
+// probe 'inputs' on 'nworkers' threads (0 = all cores) and write a
+// JSON line for each to 'fp'; the number that failed
+int write_catalog(const std::vector<std::string>& inputs, const int nbins,
+                  const int nworkers, FILE* fp);
+
+#endif // CATALOG_H
@@ -0,0 +1,72 @@
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+// Decimated conversion (for '--decimate=N'): the grid N times coarser
+// each way, ceil(nx / N) by ceil(ny / N) cells N times as far apart,
+// for a quick look at a large data set.
+//
+// If the band has an overview at least as fine as the decimated grid,
+// RasterIO() is asked for the window at the reduced buffer size and
+// GDAL reads that overview instead of the full band (its values are
+// whatever the overview was built with).  Otherwise every N rows of
+// the band are read and each N x N block reduced to its mean, minimum
+// or maximum, skipping no-data cells; a block with no data left is
+// no-data.  The reductions run over whole rows without branches so the
+// compiler can vectorize them.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gdal_priv.h"
+
+enum DecimateMode { DECIMATE_MEAN, DECIMATE_MIN, DECIMATE_MAX };
+
+class Decimator {
+public:
+  Decimator(GDALRasterBand* band, const int factor, const DecimateMode mode,
+            const bool has_nodata, const double nodata);
+
+  int nx() const { return width; }
+  int ny() const { return height; }
+
+  // true if GDAL reads an overview
+  bool overview() const { return use_overview; }
+
+  // the next row (nx() cells, top down); false on a read error
+  bool read_row(float* row);
+
+  // sizes, source and time spent reading
+  void print(FILE* fp, const std::string& what) const;
+
+private:
+  Decimator(const Decimator&);
+  Decimator& operator=(const Decimator&);
+
+  bool read_overview_block();
+  bool reduce_row(float* row);
+
+  GDALRasterBand*    band;
+  const int          factor;
+  const DecimateMode mode;
+  const bool         has_nodata;
+  const float        nodata;
+  const int          band_nx;
+  const int          band_ny;
+  const int          width;
+  const int          height;
+  bool               use_overview;
+  int                next;        // next row read_row() returns
+
+  std::vector<float> block;       // overview rows [first, first + nrows)
+  int                first;
+  int                nrows;
+  std::vector<float> rows;        // factor band rows
+  std::vector<float> acc;         // per band column
+  std::vector<float> count;
+
+  double seconds;
+  long long band_rows;            // band rows read (no overview)
+};
+
+#endif // DECIMATE_H
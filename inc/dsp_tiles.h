@@ -0,0 +1,94 @@
+#ifndef DSP_TILES_H
+#define DSP_TILES_H
+
+// Tiled DSP output (for '--tile=WxH[,overlap]'): the grid cut into
+// tiles of at most W by H cells, each its own DSP file and solid, so
+// no single huge DSP has to be prepped or edited.
+//
+// Neighboring tiles share 'overlap' rows and columns of cells (one by
+// default, and at least one: DSP cells are posts, so a tile of N posts
+// spans N - 1 cells and only tiles sharing their edge posts meet
+// without a gap).  Every tile is at least 2 posts wide and high.  Each tile's solid is placed at its first column and
+// last row times the cell size, the same place its cells have in the
+// single DSP of the whole grid.
+//
+// The tiles are written in-process (big-endian 16 bit cells, south row
+// first, as asc2dsp writes them) by worker threads taking tiles from a
+// shared counter.  DspRows writes the single DSP of the whole grid
+// (for '--stream') the same way, from the conversion's own rows.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+
+struct DspTiling {
+  int w;          // cells; 0 = no tiling
+  int h;
+  int overlap;
+
+  DspTiling()
+    : w(0), h(0), overlap(1)
+  {}
+};
+
+struct DspTile {
+  int         row;    // tile indices, row 0 north
+  int         col;
+  int         x0;     // first cell column and row (row 0 north)
+  int         y0;
+  int         nx;
+  int         ny;
+  std::string dsp;    // X-rR-cC.dsp
+  std::string solid;  // X-rR-cC.s
+};
+
+// the tiles of an nx by ny grid, row by row from the north-west; none
+// unless 1 <= t.overlap < t.w, t.h
+std::vector<DspTile> layout_tiles(const std::string& base, const int nx,
+                                  const int ny, const DspTiling& t);
+
+// write 'cells' (nx by ny, row 0 north) as a DSP file; values are
+// clamped to 0-65535
+bool write_dsp_file(const std::string& fname, const int* cells,
+                    const int nx, const int ny);
+
+// A DSP file written a row at a time as a conversion produces them,
+// north row first: each row is put in its place (south row first) in
+// the file, so the grid is never held or spooled as a whole.
+class DspRows {
+public:
+  DspRows(const std::string& fname, const int nx, const int ny);
+  ~DspRows();  // closes the file if still open
+
+  bool open();
+
+  // the grid's next row (row 0 north); values are clamped to 0-65535
+  void add_row(const int* row);
+
+  // true only if every row was written
+  bool close();
+
+private:
+  DspRows(const DspRows&);
+  DspRows& operator=(const DspRows&);
+
+  std::string                fname;
+  const int                  nx;
+  const int                  ny;
+  FILE*                      fp;
+  std::vector<unsigned char> buf;
+  int                        rows;
+  bool                       ok;
+};
+
+// fill 'cells' with tile 't's cells (row 0 north); 'worker' (below
+// the thread count) is the same for all calls from one thread
+typedef std::function<bool(const int worker, const DspTile& t,
+                           std::vector<int>& cells)> TileCells;
+
+// write every tile's DSP on 'nthreads' threads (0 = all cores)
+bool write_dsp_tiles(const std::vector<DspTile>& tiles,
+                     const TileCells& cells, const int nthreads = 0);
+
+#endif // DSP_TILES_H
@@ -0,0 +1,60 @@
+#ifndef G_DATABASE_H
+#define G_DATABASE_H
+
+// Writes BRL-CAD .g databases in-process with libwdb, replacing the
+// mged script ('in X.s dsp f ...', 'r X.r u X.s') run through
+// 'mged -c'.  One open database can take any number of objects, so a
+// batch of solids costs one open and no interpreter startup.
+//
+// libwdb/librt keep global state, so all calls are serialized on one
+// lock; databases may be written from any thread.
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct rt_wdb;
+
+// held around every libwdb/librt call that touches global state
+std::mutex& brlcad_lock();
+
+class GDatabase {
+public:
+  GDatabase();
+  ~GDatabase();  // closes
+
+  // create (or replace) 'fname'; local units are meters
+  bool open(const std::string& fname, const std::string& title);
+  // false if the database couldn't be written out
+  bool close();
+
+  // a DSP solid from 'dspfile' (nx by ny cells, 'cell' meters apart,
+  // 'zscale' meters per unit of height) with its lower left corner
+  // at 'origin' (meters); no smoothing, adaptive cut direction
+  bool add_dsp(const std::string& name, const std::string& dspfile,
+               const int nx, const int ny,
+               const double cell, const double zscale,
+               const double origin[3] = 0);
+
+  // a closed triangle mesh: x, y, z (meters) of every vertex, then
+  // three vertex indices per face, counter-clockwise seen from outside
+  bool add_bot(const std::string& name, const std::vector<double>& vertices,
+               const std::vector<int>& faces);
+
+  // union of 'members'; 'region' selects a region or a plain
+  // combination
+  bool add_comb(const std::string& name,
+                const std::vector<std::string>& members,
+                const bool region);
+
+  bool add_region(const std::string& name, const std::string& member)
+  { return add_comb(name, std::vector<std::string>(1, member), true); }
+
+private:
+  GDatabase(const GDatabase&);
+  GDatabase& operator=(const GDatabase&);
+
+  struct rt_wdb* wdbp;
+};
+
+#endif // G_DATABASE_H
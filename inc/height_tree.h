@@ -0,0 +1,113 @@
+#ifndef HEIGHT_TREE_H
+#define HEIGHT_TREE_H
+
+// Min/max quadtree over the height grid for casting rays at the
+// surface (hillshade shadows, '--los' sight lines) without marching
+// cell by cell.
+//
+// The surface is the grid's samples joined by two triangles per cell,
+// split from (x, y) to (x + 1, y + 1).  Level 1 holds the lowest and
+// highest sample of every 2x2 cells, each level above those of 2x2
+// nodes of the one below, up to a single node.  A ray walks down from
+// the top node, visiting children in the order it crosses them, and
+// skips every node it passes wholly above; only the cells under nodes
+// it can touch get the triangle test, so a ray over open ground costs
+// a few dozen nodes instead of one test per cell crossed.
+//
+// Nodes are a pair of floats (8 bytes, 2 bytes a cell over all
+// levels); each level is row-major with rows padded to whole 64-byte
+// lines and starts on a line of its own, so the 2x2 children of a node
+// are two pairs of adjacent nodes.  The grid itself is not copied.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class HeightTree {
+public:
+  // 'z' is nx by ny heights (row 0 north); built on 'nthreads' threads
+  // (0 = all cores)
+  HeightTree(const std::vector<float>& z, const int nx, const int ny,
+             const int nthreads = 0);
+
+  // Grid coordinates: x is the column, y the row, z a height (units
+  // of 'z').  The first point where the segment 'p' to 'p' + 'd' meets
+  // the surface, as the fraction 't' along it (beyond 'tmin'); false if
+  // it meets none inside the grid.  'visits' counts nodes and cells
+  // looked at.
+  bool intersect(const double p[3], const double d[3], double& t,
+                 const double tmin = 0, long long* visits = 0) const;
+
+  // the same by testing every cell the segment crosses (the reference
+  // the tree is measured against)
+  bool march(const double p[3], const double d[3], double& t,
+             const double tmin = 0, long long* visits = 0) const;
+
+  int levels() const { return static_cast<int>(level.size()); }
+  size_t bytes() const { return nodes.size() * sizeof(Range); }
+  double build_seconds() const { return seconds; }
+
+private:
+  HeightTree(const HeightTree&);
+  HeightTree& operator=(const HeightTree&);
+
+  struct Range {
+    float lo;
+    float hi;
+  };
+
+  struct Level {
+    int    w;       // nodes a row
+    int    h;       // rows
+    int    stride;  // nodes a row, padded
+    size_t offset;  // first node in 'nodes'
+  };
+
+  // node (x, y) of level 'l' (1 and up)
+  const Range& node(const int l, const int x, const int y) const
+  {
+    const Level& v = level[l - 1];
+    return base[v.offset + static_cast<size_t>(y) * v.stride + x];
+  }
+
+  // [t0, t1]: the part of [tmin, 1] inside the grid; false if none
+  bool clip(const double p[3], const double d[3], const double tmin,
+            double& t0, double& t1) const;
+  bool descend(const int l, const int x, const int y, const double p[3],
+               const double d[3], const double t0, const double t1,
+               double& t, long long& visits) const;
+  // the first 't' in [t0, t1] at or below the two triangles of cell
+  // (x, y)
+  bool cell(const int x, const int y, const double p[3], const double d[3],
+            const double t0, const double t1, double& t) const;
+
+  const std::vector<float>& z;
+  const int                 nx;
+  const int                 ny;
+
+  std::vector<Level> level;  // level 1 first
+  std::vector<Range> nodes;  // all levels, plus room to align them
+  Range*             base;   // the first line-aligned node
+  double             seconds;
+};
+
+// a sight line between two cells (columns and rows, fractions
+// allowed), both ends 'h' meters above the ground
+struct Sightline {
+  double x1, y1;
+  double x2, y2;
+  double h;
+};
+
+// answer 'lines' over the 'nx' by 'ny' grid 'z' (heights 'zunit'
+// meters, cells 'cellx' by 'celly' meters apart) into 'fp', one line
+// each; with 'bench' random sight lines also cast them through the
+// tree and by marching, and report both times to 'log'.  The tree is
+// built and the bench run on 'nthreads' threads (0 = all cores).
+void sightlines(const std::vector<float>& z, const int nx, const int ny,
+                const double cellx, const double celly, const double zunit,
+                const std::vector<Sightline>& lines, const int bench,
+                FILE* fp, FILE* log, const std::string& what,
+                const int nthreads = 0);
+
+#endif // HEIGHT_TREE_H
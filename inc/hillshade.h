@@ -0,0 +1,76 @@
+#ifndef HILLSHADE_H
+#define HILLSHADE_H
+
+// Shaded relief straight from the height grid (for '--preview=hillshade'),
+// a QA thumbnail without building and ray tracing the DSP.
+//
+// Normals come from Horn's 3x3 stencil.  With one sun the shade is
+// the cosine to the sun; the multi-directional mode blends four suns
+// 45 degrees apart (the sun's azimuth and the three before it), each
+// weighted by how squarely it lights the slope's aspect, so relief
+// running along any one light direction still shows.  The optional
+// ambient occlusion darkens cells lying below the mean height of the
+// surrounding (2R+1)^2 cells.  Cast shadows (for the grid in memory)
+// halve the light of cells that don't see the sun, each found by a
+// ray toward it through a min/max quadtree (see height_tree.h).
+//
+// Work is cut into bands of rows taken from a shared counter by
+// worker threads, each band reading just the rows it needs; the inner
+// loops run over edge-padded row copies without branches so the
+// compiler can vectorize them.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+
+struct HillshadeParams {
+  double sun_az;      // degrees clockwise from north
+  double sun_alt;     // degrees above the horizon
+  double zfactor;     // vertical exaggeration
+  bool   multi;       // blend four sun directions
+  bool   ao;          // ambient occlusion
+  int    ao_radius;   // cells
+  bool   shadows;     // cast shadows
+
+  HillshadeParams()
+    : sun_az(315), sun_alt(45), zfactor(1), multi(false), ao(false),
+      ao_radius(8), shadows(false)
+  {}
+};
+
+struct HillshadeStats {
+  int    nthreads;
+  int    nbands;
+  double seconds;
+  double shadow_seconds;  // of 'seconds', the tree's and the rays'
+
+  HillshadeStats()
+    : nthreads(0), nbands(0), seconds(0), shadow_seconds(0)
+  {}
+
+  void print(FILE* fp, const std::string& what) const;
+};
+
+// fill 'dst' with rows [y0, y0 + nrows) of the grid (all inside it),
+// nx cells a row; false on a read error.  Called from several threads
+// at once.
+typedef std::function<bool(int y0, int nrows, float* dst)> RowReader;
+
+// shade the 'nx' by 'ny' grid 'z' (row 0 is north) with cells
+// 'cellx' by 'celly' apart (same units as z) into 'gray' (nx*ny bytes,
+// row 0 first), on 'nthreads' threads (0 = all cores)
+void hillshade(const std::vector<float>& z, const int nx, const int ny,
+               const double cellx, const double celly,
+               const HillshadeParams& p, std::vector<unsigned char>& gray,
+               HillshadeStats& stats, const int nthreads = 0);
+
+// the same with the grid read band by band from 'rows' (each band with
+// the few rows around it the stencils need), so the grid itself never
+// has to fit in memory; no shadows; false if a read failed
+bool hillshade(const RowReader& rows, const int nx, const int ny,
+               const double cellx, const double celly,
+               const HillshadeParams& p, std::vector<unsigned char>& gray,
+               HillshadeStats& stats, const int nthreads = 0);
+
+#endif // HILLSHADE_H
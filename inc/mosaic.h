@@ -0,0 +1,82 @@
+#ifndef MOSAIC_H
+#define MOSAIC_H
+
+// Mosaic mode: several adjacent data sets (quads) merged into one grid.
+//
+// layout() places every source on the grid of the union of their
+// extents (from each data set's geotransform); the sources must be
+// north up, share one cell size and coordinate system, and sit on a
+// common cell grid.  read_row() then merges the grid one row at a
+// time, top down: each source keeps a small block of its own rows
+// (see mosaic.cc), so memory is a few rows per source plus one mosaic
+// row, however large the mosaic.
+//
+// Adjacent quads usually repeat their edge rows and columns.  A cell
+// that more than one source covers gets the mean of the sources that
+// hold data there (a source's no-data cells don't count), and the
+// largest disagreement seen on such shared cells is kept as a check on
+// the seams.  Cells no source covers are NODATA.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gdal_priv.h"
+
+class Mosaic {
+public:
+  // value of cells without data from any source
+  static const float NODATA;
+
+  Mosaic();
+
+  // place the data sets ('names' for messages); false (with a message)
+  // if they can't be merged
+  bool layout(const std::vector<GDALDataset*>& sets,
+              const std::vector<std::string>& names);
+
+  int nx() const { return width; }
+  int ny() const { return height; }
+
+  // the next row (nx() cells, top down); false on a read error
+  bool read_row(float* row);
+
+  // size and origin, rows read so far, cells shared by sources and
+  // the largest difference between sources on a shared cell
+  void print(FILE* fp) const;
+
+private:
+  Mosaic(const Mosaic&);
+  Mosaic& operator=(const Mosaic&);
+
+  struct Source {
+    std::string        name;
+    GDALRasterBand*    band;
+    int                nx;
+    int                ny;
+    int                col0;      // placement in the mosaic
+    int                row0;
+    bool               has_nodata;
+    float              nodata;
+    std::vector<float> block;     // rows [first, first + nrows)
+    int                first;
+    int                nrows;
+  };
+
+  std::vector<Source> sources;
+  int                 width;
+  int                 height;
+  double              gt[6];      // as GDALDataset::GetGeoTransform()
+  int                 next;       // next row read_row() returns
+
+  // per cell of the current row
+  std::vector<float>         sum;
+  std::vector<float>         lo;
+  std::vector<float>         hi;
+  std::vector<unsigned char> count;
+
+  long long shared;
+  double    max_seam;
+};
+
+#endif // MOSAIC_H
@@ -0,0 +1,168 @@
+#ifndef OUTPUT_STAGES_H
+#define OUTPUT_STAGES_H
+
+// The stages that turn X.asc into the BRL-CAD outputs for '--name=X'
+// (see the usage text in sdtsdem2asc.cc), and the dependency graph
+// connecting them:
+//
+//   asc -> dsp --+
+//    |           +--> png
+//    |  g -------+
+//    +--> hillshade
+//    +--> bot
+//    +--> los
+//   info
+//   mged-script
+//
+// The dsp stage runs 'tac X.asc | asc2dsp /dev/stdin X.dsp' (see
+// pipeline.h): asc2dsp wants the south row first, and the reversed
+// grid only passes through the pipe, never written to disk.
+//
+// The .g is written in-process (see g_database.h); X.mged is still
+// written as a readable record of what the .g holds.  The png stage
+// loads and preps the .g once and ray traces all views together,
+// encoding each as it renders (see rt_render.h, png_writer.h); the raw
+// X-azA-elE.pix files are only written with 'keep_pix'.  With the
+// hillshade preview (see hillshade.h) the png stage is replaced by one
+// shading X.asc directly into X-hillshade.png.  Given 'grid' (a
+// reader over a tile cache on the data set, see tile_cache.h), the
+// hillshade stage shades the cells read from that instead, without
+// waiting for X.asc.
+//
+// In the streaming mode the conversion writes X.dsp itself, each row
+// put in its place as it comes (see DspRows in dsp_tiles.h), in place
+// of the asc and dsp stages, so the text grid is never written to disk
+// or spooled anywhere.
+//
+// With tiling (see dsp_tiles.h) a 'tiles' stage writes the tile DSPs
+// straight from the data set, in place of the dsp stage
+// and without waiting for X.asc; the .g and the script hold one placed
+// DSP solid per tile, all in the combination X.c, which X.r holds.
+// 'asc' (the conversion itself) is added by the caller.
+//
+// The pyramid levels' DSPs (see pyramid.h) are written by the
+// conversion too, from the rows it converts; the .g and the script
+// hold a solid and a region for each next to the full grid's.
+//
+// With '--bot' a 'bot' stage meshes the grid (see bot_mesh.h) into a
+// database of its own, X-bot.g, holding the solid X-bot.s and the
+// region X-bot.r; like the hillshade stage it reads 'grid' if given,
+// X.asc otherwise.  Likewise with '--los' or '--los-bench' a 'los'
+// stage answers the sight lines over the grid (see height_tree.h) into
+// X-los.txt.  Unlike the hillshade, which shades a band of rows at a
+// time, both need the whole grid in memory (as floats) whichever way
+// it is read: the cache only spares them waiting for X.asc.
+//
+// In the incremental mode every stage gets a key (see
+// build_manifest.h) from the option values it uses and the keys of the
+// stages it depends on; stages whose artifact is up to date are
+// marked cached in the graph.
+
+#include <string>
+#include <vector>
+
+#include "task_graph.h"
+#include "build_manifest.h"
+#include "hillshade.h"
+#include "dsp_tiles.h"
+#include "pyramid.h"
+#include "height_tree.h"
+
+// one preview view and its files
+struct OutputView {
+  double      az;
+  double      el;
+  std::string pix;        // X-azA-elE.pix (only with keep_pix)
+  std::string png;        // X-azA-elE.png
+};
+
+// output file names plus the values the stages write into them
+struct OutputFiles {
+  std::string basename;
+  std::string asc;        // X.asc
+  std::string info;       // X.info
+  std::string dsp;        // X.dsp
+  std::string mged;       // X.mged
+  std::string g;          // X.g
+  std::string solid;      // X.s (in X.g)
+  std::string region;     // X.r (in X.g)
+  std::string comb;       // X.c (in X.g, the tiles' solids)
+  std::vector<OutputView> views;
+  std::string hillshade;  // X-hillshade.png
+  std::string bot_g;      // X-bot.g (only with bot_error)
+  std::string bot_solid;  // X-bot.s (in X-bot.g)
+  std::string bot_region; // X-bot.r (in X-bot.g)
+  std::string los;        // X-los.txt (only with sight lines)
+
+  int nx;
+  int ny;
+  double scalex;          // cell size, meters
+  double scaley;
+  double scalez;          // meters per DSP height unit
+  int pixsize;
+  int png_level;          // zlib level, 0-9 (-1 = zlib's default)
+  bool keep_pix;
+  bool stream;            // no X.asc (see above)
+
+  // the preview: ray traced views, or shaded relief
+  enum Preview { PREVIEW_RT, PREVIEW_HILLSHADE };
+  Preview preview;
+  HillshadeParams shade;
+  RowReader grid;         // the grid's values, if not from X.asc
+  std::vector<DspTile> tiles;   // none: one DSP of the whole grid
+  TileCells tile_cells;
+  std::vector<PyramidLevel> lods;  // written by the conversion
+  double bot_error;       // the mesh's, meters (0: no mesh)
+  std::vector<Sightline> sightlines;
+  int los_bench;          // random sight lines to time (0: none)
+  int threads;            // for each stage (0: all cores)
+
+  OutputFiles(const std::string& base, const int size);
+
+  // add a view from azimuth/elevation (degrees)
+  void add_view(const double az, const double el);
+
+  // all files, in the order they are reported at the end
+  std::vector<std::string> list() const;
+};
+
+// the stages; each returns false on failure
+bool write_info_file(const OutputFiles& o);
+bool write_dsp(const OutputFiles& o);
+bool write_tiles(const OutputFiles& o);
+bool write_mged_script(const OutputFiles& o);
+bool write_g(const OutputFiles& o);
+bool render_png(const OutputFiles& o);
+bool render_hillshade(const OutputFiles& o);
+bool write_bot(const OutputFiles& o);
+bool write_los(const OutputFiles& o);
+
+// task ids of the stages in the graph
+struct OutputTasks {
+  int asc;
+  int info;
+  int script;
+  int dsp;        // the conversion itself when streaming, the tiles
+                  // when tiling
+  int g;
+  int png;        // -1 with the hillshade preview
+  int hillshade;  // -1 with the ray traced preview
+  int bot;        // -1 without a mesh
+  int los;        // -1 without sight lines
+};
+
+// add all stages after 'asc' (the task id of the conversion) to 'graph';
+// when streaming, that task must write X.dsp (see DspRows)
+OutputTasks add_output_stages(TaskGraph& graph, const OutputFiles& o,
+                              const int asc);
+
+// incremental mode: 'input' is the key of the conversion (input data
+// set contents and conversion options)
+void mark_up_to_date(TaskGraph& graph, const OutputTasks& t,
+                     const OutputFiles& o, const BuildManifest& m,
+                     const Hash input);
+void update_manifest(const TaskGraph& graph, const OutputTasks& t,
+                     const OutputFiles& o, BuildManifest& m,
+                     const Hash input);
+
+#endif // OUTPUT_STAGES_H
@@ -0,0 +1,46 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Runs the external tools the output stages still use ('tac | asc2dsp'
+// for X.dsp), with posix_spawnp() instead of system(): no shell, and
+// argv words are passed as they are (file names with spaces or quotes
+// are safe).
+//
+// A Pipeline connects its commands stdout to stdin with pipes, like
+// 'a | b | c' in the shell, so an intermediate flows from one tool to
+// the next without ever being written to disk.  It also hands the
+// caller the first command's stdin as a stdio stream.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+typedef std::vector<std::string> Argv;
+
+class Pipeline {
+public:
+  Pipeline();
+  ~Pipeline();  // closes the input and waits
+
+  // start 'cmds'; the last one's stdout goes to 'outfile' unless empty
+  bool start(const std::vector<Argv>& cmds,
+             const std::string& outfile = "");
+
+  // the first command's stdin (0 if not started)
+  FILE* input() { return in; }
+
+  // close the input and wait for all commands; true only if every one
+  // exited with status 0
+  bool finish();
+
+private:
+  Pipeline(const Pipeline&);
+  Pipeline& operator=(const Pipeline&);
+
+  FILE*              in;
+  std::vector<pid_t> pids;
+};
+
+#endif // PIPELINE_H
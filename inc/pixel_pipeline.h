@@ -0,0 +1,214 @@
+#ifndef PIXEL_PIPELINE_H
+#define PIXEL_PIPELINE_H
+
+// Compile-time composed per-pixel operations for the scanline loop.
+//
+// Each stage is a type with a static 'apply' member; a pipeline is a
+// Loki typelist of stages (built with Seq<...>) which Fuse<> folds into
+// a single inlined expression.  RowKernel<> wraps the fused expression
+// in the per-row loop, so a given combination of user options compiles
+// to one branch-free inner loop.  The combination is picked once at
+// startup with select_row_kernel().
+
+#include "NullType.h"
+#include "Typelist.h"
+#include "Sequence.h"
+#include "TypeManip.h"
+#include "TypeTraits.h"
+
+// run-time values used by the stages; set once per data set
+struct PixelParams {
+  double nodata;   // band no-data value (NodataMask)
+  float  zscale;   // vertical scale factor (Scale)
+  float  zunits;   // output units per meter (Step)
+  int    base;     // subtracted from every elevation (Chop)
+  int    lo;       // clamp limits (Clamp)
+  int    hi;
+
+  PixelParams()
+    : nodata(0), zscale(1), zunits(1), base(0), lo(0), hi(65535)
+  {}
+};
+
+// Stages take each cell at the band's native type.  Integer cells are
+// widened to int as soon as a stage needs room below (or above) the
+// native range; float cells stay in their own precision until
+// Quantize.
+template <class V>
+struct Widen {
+  typedef typename Loki::Select<Loki::TypeTraits<V>::isStdFloat,
+                                V, int>::Result Result;
+};
+
+template <class V>
+struct ScaleType {
+  typedef typename Loki::Select<Loki::TypeTraits<V>::isStdFloat,
+                                V, float>::Result Result;
+};
+
+// the stages (in pipeline order)
+
+// replace no-data cells with a value far below any real elevation so
+// they end up as 0 after clamping (or are skipped in debug output)
+struct NodataMask {
+  template <class V>
+  static typename Widen<V>::Result apply(V v, const PixelParams& p)
+  {
+    typedef typename Widen<V>::Result W;
+    return v == static_cast<V>(p.nodata) ? static_cast<W>(-1000000)
+                                         : static_cast<W>(v);
+  }
+};
+
+// vertical exaggeration
+struct Scale {
+  template <class V>
+  static typename ScaleType<V>::Result apply(V v, const PixelParams& p)
+  {
+    typedef typename ScaleType<V>::Result S;
+    return static_cast<S>(v) * static_cast<S>(p.zscale);
+  }
+};
+
+// heights in units of a sub-meter step instead of whole meters, plus
+// a half away from zero so Quantize's truncation (toward zero) rounds
+// them to the nearest step on both sides of sea level
+struct Step {
+  template <class V>
+  static typename ScaleType<V>::Result apply(V v, const PixelParams& p)
+  {
+    typedef typename ScaleType<V>::Result S;
+    const S s = static_cast<S>(v) * static_cast<S>(p.zunits);
+    return s + (s < 0 ? static_cast<S>(-0.5) : static_cast<S>(0.5));
+  }
+};
+
+// truncate to whole meters or steps (same as the former
+// static_cast<int>); float input saturates so masked or scaled values
+// cannot overflow an int, integer input is a plain conversion
+template <class V, bool IsFloat = Loki::TypeTraits<V>::isStdFloat>
+struct QuantizeImpl {
+  static int apply(V v)
+  {
+    v = v < static_cast<V>(-1.0e9) ? static_cast<V>(-1.0e9) : v;
+    v = v > static_cast<V>( 1.0e9) ? static_cast<V>( 1.0e9) : v;
+    return static_cast<int>(v);
+  }
+};
+
+template <class V>
+struct QuantizeImpl<V, false> {
+  static int apply(V v)
+  { return static_cast<int>(v); }
+};
+
+struct Quantize {
+  template <class V>
+  static int apply(V v, const PixelParams&)
+  { return QuantizeImpl<V>::apply(v); }
+};
+
+// adjust elevation to a base level below the minimum height
+struct Chop {
+  static int apply(int v, const PixelParams& p)
+  { return v - p.base; }
+};
+
+// keep values in the range a DSP can hold
+struct Clamp {
+  static int apply(int v, const PixelParams& p)
+  {
+    v = v < p.lo ? p.lo : v;
+    return v > p.hi ? p.hi : v;
+  }
+};
+
+// fold a typelist of stages into one expression
+template <class TList> struct Fuse;
+
+template <>
+struct Fuse<Loki::NullType> {
+  template <class V>
+  static V apply(V v, const PixelParams&)
+  { return v; }
+};
+
+template <class Head, class Tail>
+struct Fuse<Loki::Typelist<Head, Tail> > {
+  template <class V>
+  static auto apply(V v, const PixelParams& p)
+    -> decltype(Fuse<Tail>::apply(Head::apply(v, p), p))
+  { return Fuse<Tail>::apply(Head::apply(v, p), p); }
+};
+
+// one fused loop over a scanline
+template <class TList>
+struct RowKernel {
+  template <class In>
+  static void run(const In* in, int* out, const int n, const PixelParams& p)
+  {
+    for (int j = 0; j < n; ++j)
+      out[j] = Fuse<TList>::apply(in[j], p);
+  }
+};
+
+// option bits selecting the optional stages
+enum {
+  PIX_MASK  = 1 << 0,
+  PIX_SCALE = 1 << 1,
+  PIX_CHOP  = 1 << 2,
+  PIX_CLAMP = 1 << 3,
+  PIX_STEP  = 1 << 4,
+  PIX_NCOMBOS = 1 << 5
+};
+
+// the stage list for one combination of option bits; disabled stages
+// are dropped from the list so they cost nothing
+template <unsigned F>
+struct PipelineFor {
+private:
+  typedef typename Loki::Seq<
+    typename Loki::Select<(F & PIX_MASK)  != 0, NodataMask, Loki::NullType>::Result,
+    typename Loki::Select<(F & PIX_SCALE) != 0, Scale,      Loki::NullType>::Result,
+    typename Loki::Select<(F & PIX_STEP)  != 0, Step,       Loki::NullType>::Result,
+    Quantize,
+    typename Loki::Select<(F & PIX_CHOP)  != 0, Chop,       Loki::NullType>::Result,
+    typename Loki::Select<(F & PIX_CLAMP) != 0, Clamp,      Loki::NullType>::Result
+    >::Type AllStages;
+public:
+  typedef typename Loki::TL::EraseAll<AllStages, Loki::NullType>::Result Stages;
+};
+
+// a table with one instantiation per combination, indexed by option bits
+template <class In>
+struct RowKernelTable {
+  typedef void (*Func)(const In*, int*, const int, const PixelParams&);
+
+  template <unsigned F, bool Done = (F == PIX_NCOMBOS)>
+  struct Fill {
+    static void fill(Func* t)
+    {
+      t[F] = &RowKernel<typename PipelineFor<F>::Stages>::template run<In>;
+      Fill<F + 1>::fill(t);
+    }
+  };
+  template <unsigned F>
+  struct Fill<F, true> {
+    static void fill(Func*) {}
+  };
+
+  Func funcs[PIX_NCOMBOS];
+
+  RowKernelTable() { Fill<0>::fill(funcs); }
+};
+
+// pick the fused row kernel for a combination of PIX_* bits
+template <class In>
+typename RowKernelTable<In>::Func
+select_row_kernel(const unsigned flags)
+{
+  static const RowKernelTable<In> table;
+  return table.funcs[flags & (PIX_NCOMBOS - 1)];
+}
+
+#endif // PIXEL_PIPELINE_H
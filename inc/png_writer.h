@@ -0,0 +1,54 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+// Streaming 8-bit RGB or gray PNG encoder on zlib (replaces 'pix-png').
+//
+// Rows are given top to bottom as they become available; each is
+// filtered (PNG filter type 1, "Sub"), fed to deflate, and the
+// compressed data is written out in IDAT chunks as the output buffer
+// fills, so the whole image is never held twice.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+class PngWriter {
+public:
+  PngWriter();
+  ~PngWriter();
+
+  // 'level' is the zlib compression level, 0 (none) to 9 (best);
+  // 'channels' is 3 (RGB) or 1 (gray)
+  bool open(const std::string& fname, const int width, const int height,
+            const int level = Z_DEFAULT_COMPRESSION,
+            const int channels = 3);
+
+  // one row of width*channels bytes
+  bool write_row(const unsigned char* rgb);
+
+  // finish the stream; false if any step failed or rows are missing
+  bool close();
+
+private:
+  PngWriter(const PngWriter&);
+  PngWriter& operator=(const PngWriter&);
+
+  bool write_chunk(const char* type, const unsigned char* data,
+                   const size_t n);
+  bool deflate_buf(const int flush);
+
+  FILE*                      fp;
+  z_stream                   zs;
+  bool                       zinit;
+  bool                       ok;
+  int                        width;
+  int                        height;
+  int                        channels;
+  int                        rows;
+  std::vector<unsigned char> line;  // filter byte + filtered row
+  std::vector<unsigned char> out;   // deflate output (one IDAT)
+};
+
+#endif // PNG_WRITER_H
@@ -0,0 +1,62 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+// Reduced-resolution DSPs (for '--pyramid=N'): level k holds the grid
+// 2^k times coarser (2x, 4x, 8x, ...) as its own DSP file, solid and
+// region, for quick interactive work in mged while the full grid is
+// kept for final renders.
+//
+// The levels are built from the conversion's own rows as they stream
+// past, so the data set is read once for all of them.  Each level
+// takes the 2x2 box mean of the level below it (a 2^k box of the
+// grid), a pair of rows at a time; an odd last row or column is paired
+// with itself.  The loops run over whole rows without branches so the
+// compiler can vectorize them.
+
+#include <string>
+#include <vector>
+
+struct PyramidLevel {
+  int         factor;   // 2^k
+  int         nx;
+  int         ny;
+  std::string dsp;      // X-lodK.dsp
+  std::string solid;    // X-lodK.s
+  std::string region;   // X-lodK.r
+};
+
+// up to 'levels' levels of an nx by ny grid; fewer if a level would
+// have less than 2 cells a side
+std::vector<PyramidLevel> layout_pyramid(const std::string& base,
+                                         const int nx, const int ny,
+                                         const int levels);
+
+class Pyramid {
+public:
+  // the grid is nx cells wide
+  Pyramid(const int nx, const std::vector<PyramidLevel>& levels);
+
+  // the grid's next row (row 0 north)
+  void add_row(const int* row);
+
+  // flush the last rows and write every level's DSP file
+  bool write();
+
+private:
+  struct Level {
+    const PyramidLevel* info;
+    int                 width;    // cells of the level below
+    std::vector<int>    pending;  // an unpaired row of the level below
+    bool                have;
+    std::vector<int>    sum;
+    std::vector<int>    cells;    // this level, row 0 north
+    int                 rows;
+  };
+
+  // add a row of the level below 'k'
+  void push(const size_t k, const int* row);
+
+  std::vector<Level> levels;
+};
+
+#endif // PYRAMID_H
@@ -0,0 +1,192 @@
+#ifndef RASTER_KERNELS_H
+#define RASTER_KERNELS_H
+
+// Per data type raster kernels.
+//
+// GDAL reports the band's cell type at run time
+// (GDALRasterBand::GetRasterDataType()); dispatch_data_type() maps it
+// onto a template instantiation so every kernel (read, stats,
+// transform, serialize) runs on the native cell type instead of
+// converting each cell to float32 on the way in.  KernelTraits<> uses
+// Loki::TypeTraits to pick the parameter and accumulator types for a
+// cell type.
+
+#include <vector>
+
+#include "TypeManip.h"
+#include "TypeTraits.h"
+#include "gdal_priv.h"
+
+// C++ cell type for a GDAL data type
+template <GDALDataType> struct GdalCell;
+template <> struct GdalCell<GDT_Byte>    { typedef unsigned char  Type; };
+template <> struct GdalCell<GDT_UInt16>  { typedef unsigned short Type; };
+template <> struct GdalCell<GDT_Int16>   { typedef short          Type; };
+template <> struct GdalCell<GDT_UInt32>  { typedef unsigned int   Type; };
+template <> struct GdalCell<GDT_Int32>   { typedef int            Type; };
+template <> struct GdalCell<GDT_Float32> { typedef float          Type; };
+template <> struct GdalCell<GDT_Float64> { typedef double         Type; };
+
+// GDAL data type for a C++ cell type (the RasterIO buffer type)
+template <class T> struct GdalTypeOf;
+template <> struct GdalTypeOf<unsigned char>  { static const GDALDataType value = GDT_Byte; };
+template <> struct GdalTypeOf<unsigned short> { static const GDALDataType value = GDT_UInt16; };
+template <> struct GdalTypeOf<short>          { static const GDALDataType value = GDT_Int16; };
+template <> struct GdalTypeOf<unsigned int>   { static const GDALDataType value = GDT_UInt32; };
+template <> struct GdalTypeOf<int>            { static const GDALDataType value = GDT_Int32; };
+template <> struct GdalTypeOf<float>          { static const GDALDataType value = GDT_Float32; };
+template <> struct GdalTypeOf<double>         { static const GDALDataType value = GDT_Float64; };
+
+template <class T>
+struct KernelTraits {
+  // how to pass a single cell
+  typedef typename Loki::TypeTraits<T>::ParameterType ParamType;
+  // wide enough to sum a whole raster of cells without overflow
+  typedef typename Loki::Select<Loki::TypeTraits<T>::isStdFloat, double,
+          typename Loki::Select<Loki::TypeTraits<T>::isStdSignedInt,
+                                long long,
+                                unsigned long long>::Result>::Result
+    AccumType;
+};
+
+// a float cell holding NaN, which is no data whatever the band's
+// no-data value (a NaN no-data value never compares equal, even to
+// itself, so 'v == nodata' can't catch it)
+template <class T>
+inline bool is_nan_cell(const T) { return false; }
+inline bool is_nan_cell(const float v) { return v != v; }
+inline bool is_nan_cell(const double v) { return v != v; }
+
+// Call v.run<T>() for the band's cell type T.  Returns false (and
+// calls nothing) for data types the kernels don't handle.
+template <class Visitor>
+bool
+dispatch_data_type(const GDALDataType t, Visitor& v)
+{
+  switch (t) {
+  case GDT_Byte:    v.template run<GdalCell<GDT_Byte>::Type>();    return true;
+  case GDT_UInt16:  v.template run<GdalCell<GDT_UInt16>::Type>();  return true;
+  case GDT_Int16:   v.template run<GdalCell<GDT_Int16>::Type>();   return true;
+  case GDT_UInt32:  v.template run<GdalCell<GDT_UInt32>::Type>();  return true;
+  case GDT_Int32:   v.template run<GdalCell<GDT_Int32>::Type>();   return true;
+  case GDT_Float32: v.template run<GdalCell<GDT_Float32>::Type>(); return true;
+  case GDT_Float64: v.template run<GdalCell<GDT_Float64>::Type>(); return true;
+  default:
+    return false;
+  }
+}
+
+// read kernel: fill 'buf' with nrows scanlines starting at 'row' in
+// the native cell type
+template <class T>
+CPLErr
+read_rows(GDALRasterBand* band, const int row, const int nrows, T* buf)
+{
+  const int nx = band->GetXSize();
+  return band->RasterIO(GF_Read,     // Either GF_Read to read a region of
+                                     // data, or GF_Write to write a region
+                                     // of data.
+                        0,           // The pixel offset to the top left
+                                     // corner of the region of the band to
+                                     // be accessed.
+                        row,         // The line offset to the top left
+                                     // corner of the region.
+                        nx,          // The width of the region of the band
+                                     // to be accessed in pixels.
+                        nrows,       // The height of the region of the band
+                                     // to be accessed in lines.
+                        buf,         // The buffer into which the data should
+                                     // be read, left to right, top to
+                                     // bottom pixel order.
+                        nx,          // The width of the buffer image.
+                        nrows,       // The height of the buffer image.
+                        GdalTypeOf<T>::value,
+                                     // The type of the pixel values in
+                                     // the buffer: the band's own type,
+                                     // so GDAL does no translation.
+                        0,           // default pixel spacing
+                        0            // default line spacing
+                        );
+}
+
+// stats kernel: running min/max/sum over rows of cells, skipping NaN
+// cells and those equal to 'nodata' if 'mask'
+template <class T>
+struct RowStats {
+  typedef typename KernelTraits<T>::ParamType ParamType;
+  typedef typename KernelTraits<T>::AccumType AccumType;
+
+  T         min;
+  T         max;
+  AccumType sum;
+  long long count;
+  bool      mask;
+  T         nodata;
+
+  RowStats(const bool m = false, const T nd = T(0))
+    : min(0), max(0), sum(0), count(0), mask(m), nodata(nd)
+  {}
+
+  void add(const T* row, const int n)
+  {
+    T lo(min);
+    T hi(max);
+    AccumType s(0);
+    long long c(count);
+    for (int j = 0; j < n; ++j) {
+      ParamType v = row[j];
+      if ((mask && v == nodata) || is_nan_cell(v))
+        continue;
+      if (!c++)
+        lo = hi = v;
+      lo = v < lo ? v : lo;
+      hi = v > hi ? v : hi;
+      s += v;
+    }
+    min = lo;
+    max = hi;
+    sum += s;
+    count = c;
+  }
+};
+
+// exact min/max of a whole band's data cells, read at its native type;
+// 'err' is the first read error, 'count' the cells that aren't no-data
+// (if none, the range is 0 to 0)
+struct BandMinMax {
+  GDALRasterBand* band;
+  bool            have_nodata;
+  double          nodata;
+  double          minmax[2];
+  long long       count;
+  CPLErr          err;
+
+  explicit BandMinMax(GDALRasterBand* b)
+    : band(b), have_nodata(false), nodata(0), count(0), err(CE_None)
+  {
+    int success(0);
+    nodata = band->GetNoDataValue(&success);
+    have_nodata = success != 0;
+    minmax[0] = minmax[1] = 0;
+  }
+
+  template <class T>
+  void run()
+  {
+    const int nx = band->GetXSize();
+    const int ny = band->GetYSize();
+    std::vector<T> row(nx);
+    RowStats<T> stats(have_nodata, static_cast<T>(nodata));
+    for (int i = 0; i < ny; ++i) {
+      err = read_rows(band, i, 1, &row[0]);
+      if (err != CE_None)
+        return;
+      stats.add(&row[0], nx);
+    }
+    minmax[0] = static_cast<double>(stats.min);
+    minmax[1] = static_cast<double>(stats.max);
+    count = stats.count;
+  }
+};
+
+#endif // RASTER_KERNELS_H
@@ -0,0 +1,279 @@
+#ifndef RASTER_STATS_H
+#define RASTER_STATS_H
+
+// Exact full-raster statistics (for '--info --stats').
+//
+// The band is cut into row ranges which worker threads take from a
+// shared counter; each worker opens its own handle on the data set
+// since a GDALDataset must not be read from two threads at once.
+// Every row is reduced to (count, mean, M2) with a two-pass sum over
+// the row buffer, rows and ranges are combined with the pairwise
+// (Chan et al.) update, and the per-range results are merged as a
+// balanced tree in range order so the result doesn't depend on thread
+// timing.  A second pass over the same ranges fills the histogram
+// once the exact min/max are known.  NaN cells of float bands count as
+// no data, and infinite ones are left out of the histogram.  If a worker can't open its handle
+// or read a range, every worker stops and 'failed' is set; the result
+// is then incomplete and must not be reported.
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+#include "raster_kernels.h"
+
+// count/mean/M2 (sum of squared deviations) plus extremes
+struct Moments {
+  long long n;
+  double    mean;
+  double    m2;
+  double    min;
+  double    max;
+
+  Moments()
+    : n(0), mean(0), m2(0),
+      min(std::numeric_limits<double>::max()),
+      max(-std::numeric_limits<double>::max())
+  {}
+
+  void merge(const Moments& b);
+  double variance() const { return n > 1 ? m2 / n : 0; }
+};
+
+struct RasterStats {
+  Moments                 moments;
+  long long               nodata_count;
+  std::vector<long long>  hist;        // equal bins over [min, max]
+  double                  seconds;
+  int                     nthreads;
+
+  RasterStats()
+    : nodata_count(0), seconds(0), nthreads(0)
+  {}
+
+  void print(FILE* fp) const;
+};
+
+// merge a vector of partial results as a balanced tree
+Moments merge_pairwise(const std::vector<Moments>& parts);
+
+// number of worker threads to use (0 = all cores)
+int stats_thread_count(const int requested, const int nranges);
+
+// the per-type reducer; run through dispatch_data_type()
+struct BandStats {
+  std::string     fname;      // each worker opens its own handle
+  int             nx;
+  int             ny;
+  bool            have_nodata;
+  double          nodata;
+  int             nbins;
+  int             nthreads;   // 0 = all cores
+  RasterStats     result;
+  bool            failed;     // a handle or range couldn't be read
+
+  BandStats(const std::string& f, GDALRasterBand* band, const int bins,
+            const int threads)
+    : fname(f), nx(band->GetXSize()), ny(band->GetYSize()),
+      have_nodata(false), nodata(0), nbins(bins), nthreads(threads),
+      failed(false)
+  {
+    int success(0);
+    nodata = band->GetNoDataValue(&success);
+    have_nodata = success != 0;
+  }
+
+  template <class T>
+  void run();
+
+private:
+  // rows per range: small enough to balance, big enough to amortize
+  // the RasterIO call
+  enum { ROWS_PER_RANGE = 64 };
+
+  template <class T>
+  void reduce_ranges(const int nranges, std::vector<Moments>& parts,
+                     std::vector<long long>& nodata_counts);
+  template <class T>
+  void histogram_ranges(const int nranges, const Moments& m,
+                        std::vector<std::vector<long long> >& hists);
+};
+
+template <class T>
+void
+BandStats::reduce_ranges(const int nranges, std::vector<Moments>& parts,
+                         std::vector<long long>& nodata_counts)
+{
+  typedef typename KernelTraits<T>::AccumType AccumType;
+
+  std::atomic<int> next(0);
+  std::atomic<bool> error(false);
+  const T nd = static_cast<T>(nodata);
+  const bool use_nd = have_nodata;
+  // float rows are always filtered, for NaN cells
+  const bool mask = have_nodata || Loki::TypeTraits<T>::isStdFloat;
+
+  auto worker = [&]() {
+    GDALDataset* ds
+      = static_cast<GDALDataset*>(GDALOpen(fname.c_str(), GA_ReadOnly));
+    if (!ds) {
+      error = true;
+      return;
+    }
+    GDALRasterBand* band = ds->GetRasterBand(1);
+    std::vector<T> buf(static_cast<size_t>(nx) * ROWS_PER_RANGE);
+    std::vector<T> valid(nx);
+    for (int r = next++; r < nranges && !error; r = next++) {
+      const int row0 = r * ROWS_PER_RANGE;
+      const int nrows = std::min(static_cast<int>(ROWS_PER_RANGE), ny - row0);
+      if (read_rows(band, row0, nrows, &buf[0]) != CE_None) {
+        error = true;
+        break;
+      }
+
+      Moments acc;
+      long long nnd(0);
+      for (int i = 0; i < nrows; ++i) {
+        const T* row = &buf[static_cast<size_t>(i) * nx];
+        // drop no-data cells, then a two-pass reduction of the row
+        int nv(0);
+        if (mask) {
+          for (int j = 0; j < nx; ++j) {
+            valid[nv] = row[j];
+            nv += !(use_nd && row[j] == nd) && !is_nan_cell(row[j]);
+          }
+          nnd += nx - nv;
+          row = &valid[0];
+        }
+        else {
+          nv = nx;
+        }
+        if (!nv)
+          continue;
+
+        Moments m;
+        AccumType sum(0);
+        T lo(row[0]), hi(row[0]);
+        for (int j = 0; j < nv; ++j) {
+          sum += row[j];
+          lo = row[j] < lo ? row[j] : lo;
+          hi = row[j] > hi ? row[j] : hi;
+        }
+        m.n = nv;
+        m.mean = static_cast<double>(sum) / nv;
+        double m2(0);
+        for (int j = 0; j < nv; ++j) {
+          const double d = static_cast<double>(row[j]) - m.mean;
+          m2 += d * d;
+        }
+        m.m2 = m2;
+        m.min = static_cast<double>(lo);
+        m.max = static_cast<double>(hi);
+        acc.merge(m);
+      }
+      parts[r] = acc;
+      nodata_counts[r] = nnd;
+    }
+    GDALClose(ds);
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 1; t < result.nthreads; ++t)
+    pool.push_back(std::thread(worker));
+  worker();
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+  failed = failed || error;
+}
+
+template <class T>
+void
+BandStats::histogram_ranges(const int nranges, const Moments& m,
+                            std::vector<std::vector<long long> >& hists)
+{
+  std::atomic<int> next(0);
+  std::atomic<bool> error(false);
+  const T nd = static_cast<T>(nodata);
+  const bool mask = have_nodata;
+  const double lo = m.min;
+  const double width = m.max > m.min ? (m.max - m.min) / nbins : 1;
+  const double inv = 1 / width;
+  const int last = nbins - 1;
+
+  auto worker = [&](std::vector<long long>& hist) {
+    GDALDataset* ds
+      = static_cast<GDALDataset*>(GDALOpen(fname.c_str(), GA_ReadOnly));
+    if (!ds) {
+      error = true;
+      return;
+    }
+    GDALRasterBand* band = ds->GetRasterBand(1);
+    std::vector<T> buf(static_cast<size_t>(nx) * ROWS_PER_RANGE);
+    for (int r = next++; r < nranges && !error; r = next++) {
+      const int row0 = r * ROWS_PER_RANGE;
+      const int nrows = std::min(static_cast<int>(ROWS_PER_RANGE), ny - row0);
+      const size_t ncells = static_cast<size_t>(nx) * nrows;
+      if (read_rows(band, row0, nrows, &buf[0]) != CE_None) {
+        error = true;
+        break;
+      }
+      for (size_t k = 0; k < ncells; ++k) {
+        const double v = static_cast<double>(buf[k]);
+        if ((mask && buf[k] == nd) || !std::isfinite(v))
+          continue;
+        int b = static_cast<int>((v - lo) * inv);
+        hist[b > last ? last : b] += 1;
+      }
+    }
+    GDALClose(ds);
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 1; t < result.nthreads; ++t)
+    pool.push_back(std::thread(worker, std::ref(hists[t])));
+  worker(hists[0]);
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+  failed = failed || error;
+}
+
+template <class T>
+void
+BandStats::run()
+{
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  const int nranges = (ny + ROWS_PER_RANGE - 1) / ROWS_PER_RANGE;
+  result.nthreads = stats_thread_count(nthreads, nranges);
+
+  std::vector<Moments> parts(nranges);
+  std::vector<long long> nodata_counts(nranges, 0);
+  reduce_ranges<T>(nranges, parts, nodata_counts);
+
+  result.moments = merge_pairwise(parts);
+  for (int r = 0; r < nranges; ++r)
+    result.nodata_count += nodata_counts[r];
+
+  result.hist.assign(nbins, 0);
+  // (no bins over an infinite range)
+  if (!failed && result.moments.n && nbins > 0
+      && std::isfinite(result.moments.min)
+      && std::isfinite(result.moments.max)) {
+    std::vector<std::vector<long long> >
+      hists(result.nthreads, std::vector<long long>(nbins, 0));
+    histogram_ranges<T>(nranges, result.moments, hists);
+    for (size_t t = 0; t < hists.size(); ++t)
+      for (int b = 0; b < nbins; ++b)
+        result.hist[b] += hists[t][b];
+  }
+  result.seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - t0).count();
+}
+
+#endif // RASTER_STATS_H
@@ -0,0 +1,128 @@
+#ifndef REPROJECT_H
+#define REPROJECT_H
+
+// Reprojection (for '--project=utm|EPSG:N'): a data set in another
+// coordinate system, geographic (arc-second) DEMs above all, resampled
+// onto a north-up grid of square meter cells in the target system, in
+// the one conversion pass instead of a separate gdalwarp run.
+//
+// The target grid covers the data set's whole footprint (its edges
+// transformed at a few dozen points each), its corners on multiples of
+// the cell size.  Rather than a PROJ call per cell, the source pixel
+// position of every STEP-th cell each way is worked out once, up
+// front, and the positions in between interpolated bilinearly; STEP
+// starts coarse and is halved until the interpolation is within an
+// eighth of a source cell of the exact transform midway between
+// nodes.  Cells then sample the source with the nearest, bilinear or
+// bicubic kernel (see resample.h).  Cells outside the data set, or
+// with a no-data cell under a tap of non-zero weight, are NODATA.
+//
+// The source window under a block of output rows is read in one
+// RasterIO() call; the block's rows are then resampled by worker
+// threads taking bands of rows from a shared counter.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gdal_priv.h"
+#include "resample.h"
+
+class OGRCoordinateTransformation;
+
+class Reprojector {
+public:
+  // value of cells without data
+  static const float NODATA;
+
+  Reprojector();
+  ~Reprojector();
+
+  // Lay out the grid of 'set' in 'target' ('utm' for the WGS 84 UTM
+  // zone of the set's center, or 'EPSG:N') with 'cell' meter cells (0:
+  // the set's own cell size at its center, the smaller way); 'name' is
+  // for messages.  False (with a message) if it can't be.
+  bool setup(GDALDataset* set, const std::string& target, const double cell,
+             const ResampleKernel kernel, const std::string& name,
+             const int nthreads = 0);
+
+  int nx() const { return width; }
+  int ny() const { return height; }
+  double cell() const { return size; }
+
+  // the grid's top left corner, in the target system
+  double left() const { return x0; }
+  double top() const { return y0; }
+
+  // the transform grid's error: the farthest (source cells) its
+  // interpolated positions were found from the exact ones
+  double error() const { return max_error; }
+
+  // the target system, as given ('utm' resolved to its EPSG code)
+  const std::string& target() const { return target_name; }
+
+  // the next row (nx() cells, top down); false on a read error
+  bool read_row(float* row);
+
+  // target, grid, transform grid and time spent
+  void print(FILE* fp, const std::string& what) const;
+
+private:
+  Reprojector(const Reprojector&);
+  Reprojector& operator=(const Reprojector&);
+
+  // source pixel positions (cell centers at whole numbers) of the
+  // nodes every 'step' cells; false if a transform fails everywhere
+  bool make_nodes(const int step);
+  // largest distance (source cells) between the exact and the
+  // interpolated positions midway between nodes
+  double node_error();
+  // the interpolated source position of output cell (j, i)
+  void position(const int j, const int i, double& u, double& v) const;
+
+  bool read_block();
+  void reproject_row(const int y, float* dst, std::vector<float>& u,
+                     std::vector<float>& v) const;
+
+  GDALRasterBand*              band;
+  OGRCoordinateTransformation* inverse;   // target to source
+  double                       gt[6];     // the source's geotransform
+  std::string                  target_name;
+  ResampleKernel               kernel;
+  bool                         has_nodata;
+  float                        nodata;
+  int                          band_nx;
+  int                          band_ny;
+  int                          width;
+  int                          height;
+  double                       size;      // cell, meters
+  double                       x0;        // target grid's top left corner
+  double                       y0;
+  int                          nthreads;
+
+  // the transform grid: (gx by gy nodes), every 'step' cells
+  int                 step;
+  int                 gx;
+  int                 gy;
+  std::vector<double> node_u;
+  std::vector<double> node_v;
+  double              max_error;
+
+  // band window [wx0, wx0 + ww) x [wy0, wy0 + wh) under the block
+  std::vector<float>  src;
+  int                 wx0;
+  int                 wy0;
+  int                 ww;
+  int                 wh;
+  std::vector<float>  block;     // output rows [first, first + nrows)
+  int                 first;
+  int                 nrows;
+  int                 next;      // next row read_row() returns
+
+  double    setup_seconds;
+  double    read_seconds;
+  double    resample_seconds;
+  long long cells_read;
+};
+
+#endif // REPROJECT_H
@@ -0,0 +1,102 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+// Resampling to square cells (for '--cell=M', and for data sets whose
+// cells aren't square): the band's cellx by celly meter cells become
+// 'cell' meter cells covering the same extent, in the one conversion
+// pass instead of a separate gdalwarp run.
+//
+// The kernels (nearest neighbor, bilinear, or Keys' bicubic with
+// a = -0.5) are separable: every output row is first the weighted sum
+// of its source rows, then every output cell the weighted sum of its
+// columns of that, with the taps of each output row and column worked
+// out once.  Taps past the edge repeat the edge cells.  An output cell
+// with a no-data cell under a tap of non-zero weight is no-data.
+//
+// The source rows for a block of output rows are read in one window;
+// the block's rows are then resampled by worker threads taking bands
+// of rows from a shared counter, the inner loops running over whole
+// rows without branches so the compiler can vectorize them.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gdal_priv.h"
+
+enum ResampleKernel { RESAMPLE_NEAREST, RESAMPLE_BILINEAR, RESAMPLE_BICUBIC };
+
+// the taps of kernel 'k' at position 'u' along an axis of 'n' cells
+// (cell i's center at i; taps past the edges repeat the edge cells):
+// their count (at most 4), cell indices and weights
+int kernel_taps(const ResampleKernel k, const double u, const int n,
+                int* index, float* weight);
+
+class Resampler {
+public:
+  Resampler(GDALRasterBand* band, const double cellx, const double celly,
+            const double cell, const ResampleKernel kernel,
+            const bool has_nodata, const double nodata,
+            const int nthreads = 0);
+
+  int nx() const { return width; }
+  int ny() const { return height; }
+
+  // the next row (nx() cells, top down); false on a read error
+  bool read_row(float* row);
+
+  // sizes, kernel and time spent reading and resampling
+  void print(FILE* fp, const std::string& what) const;
+
+private:
+  Resampler(const Resampler&);
+  Resampler& operator=(const Resampler&);
+
+  // each output cell's 'n' source indices and weights along one axis,
+  // tap k of cell j at [k * count + j]
+  struct Taps {
+    int                n;
+    int                count;
+    std::vector<int>   index;
+    std::vector<float> weight;
+    std::vector<float> live;    // 1 where the weight isn't 0
+  };
+
+  void make_taps(const int nout, const int nsrc, const double ratio,
+                 Taps& t) const;
+  bool read_block();
+  // output row 'y' into 'dst'; the rest is scratch space (the band's
+  // width, twice, and the output's)
+  void resample_row(const int y, float* dst, std::vector<float>& sum,
+                    std::vector<float>& bad, std::vector<float>& nbad) const;
+
+  GDALRasterBand*      band;
+  const double         cellx;
+  const double         celly;
+  const double         cell;
+  const ResampleKernel kernel;
+  const float          nodata;
+  const float          match;     // compares equal to no-data cells only
+  const int            band_nx;
+  const int            band_ny;
+  const int            width;
+  const int            height;
+  int                  nthreads;
+
+  Taps                 xtaps;
+  Taps                 ytaps;
+
+  std::vector<float>   src;       // band rows [src_y0, src_y0 + src_rows)
+  int                  src_y0;
+  int                  src_rows;
+  std::vector<float>   block;     // output rows [first, first + nrows)
+  int                  first;
+  int                  nrows;
+  int                  next;      // next row read_row() returns
+
+  double read_seconds;
+  double resample_seconds;
+  long long band_rows;            // band rows read
+};
+
+#endif // RESAMPLE_H
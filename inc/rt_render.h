@@ -0,0 +1,124 @@
+#ifndef RT_RENDER_H
+#define RT_RENDER_H
+
+// In-process ray traced preview on librt (replaces running 'rt').
+//
+// RtScene::load() builds the directory, gets the tree and preps it
+// once; render() then shoots one ray per pixel on all cores.  The image
+// is cut into square tiles handed to the worker threads from a shared
+// counter, each worker with its own librt resource.  The camera
+// matches rt's defaults for '-a az -e el': orthographic, looking at the
+// center of the model's bounding box, view size the box's diagonal.
+// Shading is a head light (Lambert plus ambient) on a black
+// background.
+//
+// Tiles are handed out top band first.  When given a RowSink, render()
+// passes it each finished row, top to bottom, as soon as every tile of
+// its band is done, so an encoder can run while the rest of the image
+// is still being shot.
+//
+// Several views of one prepped scene can be rendered in one call: the
+// tiles of all views share the one queue, so the views run
+// concurrently and no core idles at the end of a single view.
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct rt_i;
+struct resource;
+
+// 8-bit RGB image; row 0 is the bottom row, as in a .pix file
+struct Framebuffer {
+  int                        width;
+  int                        height;
+  std::vector<unsigned char> rgb;
+
+  Framebuffer()
+    : width(0), height(0)
+  {}
+
+  void resize(const int w, const int h)
+  {
+    width = w;
+    height = h;
+    rgb.assign(static_cast<size_t>(w) * h * 3, 0);
+  }
+
+  unsigned char* row(const int y)
+  { return &rgb[static_cast<size_t>(y) * width * 3]; }
+  const unsigned char* row(const int y) const
+  { return &rgb[static_cast<size_t>(y) * width * 3]; }
+
+  bool write_pix(const std::string& fname) const;
+};
+
+struct RenderStats {
+  long long rays;
+  long long hits;
+  int       nthreads;
+  int       ntiles;
+  double    prep_seconds;
+  double    shoot_seconds;
+
+  RenderStats()
+    : rays(0), hits(0), nthreads(0), ntiles(0),
+      prep_seconds(0), shoot_seconds(0)
+  {}
+
+  void print(FILE* fp, const std::string& what) const;
+};
+
+// takes one finished RGB row (top to bottom); false aborts the sink
+typedef std::function<bool(const unsigned char* rgb)> RowSink;
+
+// one view of a batch; 'fb' is resized to 'size' x 'size'
+struct RenderView {
+  double       az;
+  double       el;
+  int          size;
+  Framebuffer* fb;
+  RowSink      sink;
+
+  RenderView(const double a, const double e, const int s,
+             Framebuffer* f, const RowSink& k = RowSink())
+    : az(a), el(e), size(s), fb(f), sink(k)
+  {}
+};
+
+class RtScene {
+public:
+  RtScene();
+  ~RtScene();
+
+  // load and prep 'objects' from 'gfile' for up to 'nthreads'
+  // threads (0 = all cores)
+  bool load(const std::string& gfile,
+            const std::vector<std::string>& objects,
+            const int nthreads = 0);
+
+  // render a 'size' x 'size' view from azimuth/elevation (degrees);
+  // false if the scene is not loaded or 'sink' failed
+  bool render(const double az, const double el, const int size,
+              Framebuffer& fb, RenderStats& stats,
+              const RowSink& sink = RowSink());
+
+  // render all 'views' together; 'stats' covers the whole batch
+  bool render(const std::vector<RenderView>& views, RenderStats& stats);
+
+  int threads() const { return static_cast<int>(resources.size()); }
+
+private:
+  RtScene(const RtScene&);
+  RtScene& operator=(const RtScene&);
+
+  struct rt_i*                   rtip;
+  std::vector<struct resource*>  resources;  // one per thread
+  double                         prep_seconds;
+};
+
+// tile edge in pixels
+const int RT_TILE_SIZE = 32;
+
+#endif // RT_RENDER_H
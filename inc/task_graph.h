@@ -0,0 +1,62 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+// A small dependency-graph executor for the output stages.
+//
+// Each task is a named action returning true on success and may depend
+// on earlier tasks.  run() starts every task whose dependencies are done
+// on a pool of worker threads, so independent stages overlap.  After
+// the first failure no new task is started (tasks already running are
+// allowed to finish) and the remaining ones are reported as skipped.
+// A task marked cached (its output is known to be up to date) counts
+// as done without running.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+
+class TaskGraph {
+public:
+  typedef std::function<bool()> Action;
+
+  enum State { PENDING, RUNNING, DONE, FAILED, SKIPPED, CACHED };
+
+  TaskGraph()
+    : total_seconds(0)
+  {}
+
+  // add a task; returns its id for use in later 'deps' lists
+  int add(const std::string& name, const Action& action,
+          const std::vector<int>& deps = std::vector<int>());
+
+  // don't run task 'id', treat it as already done
+  void mark_cached(const int id) { tasks[id].cached = true; }
+
+  // run all tasks on up to 'nthreads' workers (0 = all cores);
+  // returns false if any task failed
+  bool run(const int nthreads = 0);
+
+  // per-task state and wall time
+  void report(FILE* fp) const;
+
+  size_t size() const { return tasks.size(); }
+  State state(const int id) const { return tasks[id].state; }
+  const std::string& name(const int id) const { return tasks[id].name; }
+
+private:
+  struct Task {
+    std::string      name;
+    Action           action;
+    std::vector<int> dependents;
+    int              ndeps;
+    State            state;
+    bool             cached;
+    double           seconds;
+  };
+
+  std::vector<Task> tasks;
+  double            total_seconds;
+};
+
+#endif // TASK_GRAPH_H
@@ -0,0 +1,121 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+// A tile cache between the band reader and the kernels that need
+// neighborhood access (for '--cache'), so a raster larger than memory
+// can still be read in windows.
+//
+// The grid is cut into fixed-size square tiles of float cells.  Tiles
+// are read on first use, kept in least recently used order, and
+// evicted once their bytes pass the budget (tiles being copied from or
+// still loading are never evicted).  After each window read the cache
+// guesses the scan direction from where the previous window was and
+// queues the tiles just past the window that way; a prefetch thread
+// reads them while the kernel works on the window it has.
+//
+// The reader is only ever called with the cache's own I/O lock held,
+// so it can be a GDAL band (which must not be read from two threads at
+// once); read() itself may be called from any number of threads.
+
+#include <cstdio>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+// fill 'dst' with the cells of [x0, x0 + w) x [y0, y0 + h) (all inside
+// the grid), w cells a row; false on a read error
+typedef std::function<bool(int x0, int y0, int w, int h, float* dst)>
+  TileReader;
+
+class TileCache {
+public:
+  TileCache(const int nx, const int ny, const TileReader& reader,
+            const size_t budget, const int tile = 256);
+  ~TileCache();
+
+  int nx() const { return width; }
+  int ny() const { return height; }
+
+  // copy [x0, x0 + w) x [y0, y0 + h) into 'dst', w cells a row; cells
+  // outside the grid take the value of the nearest edge cell.  False if
+  // a tile can't be read.
+  bool read(const int x0, const int y0, const int w, const int h,
+            float* dst);
+
+  // hit, miss, eviction and prefetch counters
+  void print(FILE* fp, const std::string& what) const;
+
+private:
+  TileCache(const TileCache&);
+  TileCache& operator=(const TileCache&);
+
+  enum State { LOADING, READY, FAILED };
+
+  struct Tile {
+    int                tx;
+    int                ty;
+    State              state;
+    int                users;       // read() calls copying from it
+    bool               prefetched;  // and not used since
+    std::vector<float> cells;
+    std::list<Tile*>::iterator lru;
+  };
+
+  long long key(const int tx, const int ty) const
+  { return static_cast<long long>(ty) * ntx + tx; }
+
+  // the tile pinned for reading (loaded if need be), or 0 on error
+  Tile* acquire(const int tx, const int ty);
+  void release(Tile* t);
+
+  // read a tile's cells (with the I/O lock)
+  bool load(Tile* t);
+
+  // with 'lock' held: a new LOADING tile, and eviction down to budget
+  Tile* insert(const int tx, const int ty);
+  void evict();
+
+  // queue the tiles past a window in the direction the scan moves
+  void queue_prefetch(const int tx0, const int ty0, const int tx1,
+                      const int ty1, const int dx, const int dy);
+  void prefetcher();
+
+  const int    width;
+  const int    height;
+  const int    size;      // tile edge, cells
+  const int    ntx;
+  const int    nty;
+  TileReader   reader;
+  const size_t budget;
+
+  mutable std::mutex                  lock;
+  std::mutex                          io_lock;
+  std::condition_variable             loaded;
+  std::condition_variable             wake;
+  std::unordered_map<long long, Tile*> tiles;
+  std::list<Tile*>                    order;    // most recent first
+  size_t                              bytes;
+  std::deque<long long>               pending;  // tiles to prefetch
+  bool                                stop;
+  int                                 last_x0;
+  int                                 last_y0;
+  bool                                have_last;
+
+  long long hits;
+  long long misses;
+  long long waits;          // hits on tiles still loading
+  long long evictions;
+  long long prefetches;
+  long long prefetch_hits;
+  size_t    peak_bytes;
+
+  std::thread worker;       // the prefetcher
+};
+
+#endif // TILE_CACHE_H
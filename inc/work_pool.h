@@ -0,0 +1,107 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+// A work-stealing pool for batch mode.
+//
+// Top-level jobs wait in one list, taken in the order submitted (the
+// caller submits the largest first).  A running job can split part of
+// its work into subtasks (a Group); they go on the back of the
+// spawning worker's own deque, or of a shared deque when spawned from
+// a thread outside the pool (a task graph stage).  A worker takes
+// from the back of its own deque, then starts the next job, and only
+// when no job is left steals from the front of the other deques, so
+// the workers that finish early help with the jobs still running
+// instead of sitting idle at the end of a batch.  Group::wait() runs
+// subtasks too rather than block, but never starts a new job, so a
+// job never ends up waiting behind another.
+
+#include <cstdio>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <functional>
+
+class WorkPool {
+public:
+  typedef std::function<void()> Task;
+
+  class Group {
+  public:
+    // tasks are run inline, in spawn(), if 'p' is 0
+    explicit Group(WorkPool* p)
+      : pool(p), pending(0)
+    {}
+    ~Group() { wait(); }
+
+    void spawn(const Task& t);
+
+    // until every spawned task is done, run subtasks
+    void wait();
+
+  private:
+    Group(const Group&);
+    Group& operator=(const Group&);
+
+    friend class WorkPool;
+    WorkPool*        pool;
+    std::atomic<int> pending;
+  };
+
+  explicit WorkPool(const int nworkers);
+
+  int workers() const { return static_cast<int>(stats.size()); }
+
+  // queue a top-level job (before run())
+  void submit(const Task& job);
+
+  // run until every job and subtask is done; the calling thread is
+  // worker 0
+  void run();
+
+  // the pool the calling thread is a worker of, or 0
+  static WorkPool* current();
+
+  // per-worker busy time, jobs, subtasks and steals
+  void report(FILE* fp) const;
+
+private:
+  WorkPool(const WorkPool&);
+  WorkPool& operator=(const WorkPool&);
+
+  struct Entry {
+    Task   task;
+    Group* group;   // 0 for a top-level job
+  };
+
+  struct Queue {
+    std::mutex        lock;
+    std::deque<Entry> q;
+  };
+
+  struct WorkerStats {
+    double    busy;       // seconds in tasks
+    int       jobs;
+    long long subtasks;
+    long long steals;
+
+    WorkerStats()
+      : busy(0), jobs(0), subtasks(0), steals(0)
+    {}
+  };
+
+  // the next entry for worker 'self' (-1 for an outside thread); with
+  // 'subtasks_only' jobs are left alone
+  bool take(const int self, const bool subtasks_only, Entry& e);
+  void execute(const int self, Entry& e);
+  void worker(const int self);
+
+  Queue                               jobs;
+  std::vector<std::unique_ptr<Queue> > queues;  // per worker, then shared
+  std::vector<WorkerStats>            stats;
+  std::atomic<long long>              pending;  // queued or running
+  double                              wall;
+};
+
+#endif // WORK_POOL_H
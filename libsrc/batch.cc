@@ -0,0 +1,233 @@
+// batch mode helpers (see batch.h)
+
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "SafeFormat.h"
+#include "batch.h"
+
+using namespace std;
+using namespace Loki;
+
+namespace {
+
+bool
+is_dir(const string& path)
+{
+  struct stat sb;
+  return stat(path.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode);
+}
+
+// SDTS transfers name their catalog module 'nnnnCATD.DDF'
+bool
+is_catd(const string& fname)
+{
+  static const string suffix("CATD.DDF");
+  if (fname.size() < suffix.size())
+    return false;
+  string tail(fname.substr(fname.size() - suffix.size()));
+  for (size_t i = 0; i < tail.size(); ++i)
+    tail[i] = static_cast<char>(toupper(static_cast<unsigned char>(tail[i])));
+  return tail == suffix;
+}
+
+void
+find_catd(const string& dir, vector<string>& found)
+{
+  DIR* d = opendir(dir.c_str());
+  if (!d)
+    return;
+  vector<string> names;
+  while (struct dirent* e = readdir(d)) {
+    const string name(e->d_name);
+    if (name != "." && name != "..")
+      names.push_back(name);
+  }
+  closedir(d);
+
+  // directory order is arbitrary; keep batches reproducible
+  sort(names.begin(), names.end());
+  for (size_t i = 0; i < names.size(); ++i) {
+    const string path(dir + "/" + names[i]);
+    if (is_dir(path))
+      find_catd(path, found);
+    else if (is_catd(names[i]))
+      found.push_back(path);
+  }
+}
+
+bool
+expand(const string& arg, vector<string>& inputs, bool& expanded,
+       const int depth)
+{
+  if (arg.size() > 1 && arg[0] == '@') {
+    if (depth > 0) {
+      Printf("ERROR:  Nested input list '%s'.\n")(arg);
+      return false;
+    }
+    const string lfil(arg.substr(1));
+    FILE* fp = fopen(lfil.c_str(), "r");
+    if (!fp) {
+      Printf("ERROR:  Unable to read input list '%s'.\n")(lfil);
+      return false;
+    }
+    expanded = true;
+    bool ok = true;
+    char buf[PATH_MAX + 2];
+    while (ok && fgets(buf, sizeof(buf), fp)) {
+      string line(buf);
+      const string::size_type b = line.find_first_not_of(" \t\r\n");
+      if (b == string::npos || line[b] == '#')
+        continue;
+      const string::size_type e = line.find_last_not_of(" \t\r\n");
+      // a list may name directories but not other lists
+      ok = expand(line.substr(b, e - b + 1), inputs, expanded, depth + 1);
+    }
+    fclose(fp);
+    return ok;
+  }
+
+  if (is_dir(arg)) {
+    expanded = true;
+    vector<string> found;
+    find_catd(arg, found);
+    if (found.empty()) {
+      Printf("ERROR:  No '*CATD.DDF' file under '%s'.\n")(arg);
+      return false;
+    }
+    inputs.insert(inputs.end(), found.begin(), found.end());
+    return true;
+  }
+
+  inputs.push_back(arg);
+  return true;
+}
+
+// last path component, without a trailing '/'
+string
+last_component(string path)
+{
+  while (path.size() > 1 && path[path.size() - 1] == '/')
+    path.erase(path.size() - 1);
+  const string::size_type slash = path.rfind('/');
+  return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+bool
+collect_inputs(const vector<string>& args, vector<string>& inputs,
+               bool& expanded)
+{
+  expanded = false;
+  for (size_t i = 0; i < args.size(); ++i)
+    if (!expand(args[i], inputs, expanded, 0))
+      return false;
+  return true;
+} // collect_inputs
+
+string
+output_name(const string& pattern, const string& input, const int index)
+{
+  // the directory as an absolute path, so 'X.DDF' alone still has one
+  const string::size_type slash = input.rfind('/');
+  string dir(slash == string::npos ? string(".")
+             : slash == 0 ? string("/") : input.substr(0, slash));
+  char buf[PATH_MAX];
+  if (realpath(dir.c_str(), buf))
+    dir = buf;
+
+  string base(last_component(input));
+  const string::size_type dot = base.rfind('.');
+  if (dot != string::npos && dot > 0)
+    base.erase(dot);
+
+  string name;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    if (pattern[i] != '%' || i + 1 == pattern.size()) {
+      name += pattern[i];
+      continue;
+    }
+    switch (pattern[++i]) {
+    case 'd': name += last_component(dir); break;
+    case 'b': name += base; break;
+    case 'n': SPrintf(name, "%d")(index + 1); break;
+    case '%': name += '%'; break;
+    default:  name += '%'; name += pattern[i]; break;
+    }
+  }
+  return name;
+} // output_name
+
+void
+run_pool(const int njobs, const int nworkers,
+         const function<void(int)>& job)
+{
+  int n = nworkers > 0 ? nworkers
+                       : static_cast<int>(thread::hardware_concurrency());
+  n = max(1, min(n, njobs));
+
+  atomic<int> next(0);
+  auto worker = [&]() {
+    for (int i = next++; i < njobs; i = next++)
+      job(i);
+  };
+  vector<thread> pool;
+  for (int t = 1; t < n; ++t)
+    pool.push_back(thread(worker));
+  worker();
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+} // run_pool
+
+long long
+file_size(const string& fname)
+{
+  struct stat sb;
+  return stat(fname.c_str(), &sb) == 0 ? static_cast<long long>(sb.st_size)
+                                       : 0;
+} // file_size
+
+void
+print_summary(FILE* fp, const vector<JobResult>& results, const int nworkers,
+              const double wall)
+{
+  const double MB = 1024.0 * 1024.0;
+  int nok(0);
+  long long in_bytes(0), out_bytes(0);
+  double cpu(0);
+  for (size_t i = 0; i < results.size(); ++i) {
+    nok += results[i].ok ? 1 : 0;
+    in_bytes += results[i].in_bytes;
+    out_bytes += results[i].out_bytes;
+    cpu += results[i].seconds;
+  }
+
+  fprintf(fp, "\nBatch summary:\n");
+  fprintf(fp, "  %4s  %-32s %-20s %11s %9s %9s %9s  %s\n",
+          "#", "input", "output", "cells", "in MB", "out MB", "seconds",
+          "status");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const JobResult& r = results[i];
+    string cells;
+    if (r.nx)
+      SPrintf(cells, "%dx%d")(r.nx)(r.ny);
+    fprintf(fp, "  %4d  %-32s %-20s %11s %9.1f %9.1f %9.2f  %s\n",
+            static_cast<int>(i + 1), r.input.c_str(), r.name.c_str(),
+            cells.c_str(), r.in_bytes / MB, r.out_bytes / MB, r.seconds,
+            r.ok ? "ok" : ("FAILED: " + r.error).c_str());
+  }
+  fprintf(fp, "  %d input%s: %d ok, %d failed; %.1f MB in, %.1f MB out;\n"
+          "  %.2f s wall on %d worker%s (%.2f s summed)\n",
+          static_cast<int>(results.size()), results.size() == 1 ? "" : "s",
+          nok, static_cast<int>(results.size()) - nok,
+          in_bytes / MB, out_bytes / MB,
+          wall, nworkers, nworkers == 1 ? "" : "s", cpu);
+} // print_summary
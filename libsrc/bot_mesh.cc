@@ -0,0 +1,396 @@
+// adaptive triangle mesh export (see bot_mesh.h)
+
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <algorithm>
+
+#include "bot_mesh.h"
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// the largest squares, 2^SQUARE_LOG2 cells a side
+const int SQUARE_LOG2 = 8;
+
+// run 'f(i)' for every i in [0, n) on 'nthreads' threads
+template <class F>
+void
+for_each_index(const int n, const int nthreads, F f)
+{
+  atomic<int> next(0);
+  auto worker = [&]() {
+    for (int i = next++; i < n; i = next++)
+      f(i);
+  };
+  vector<thread> pool;
+  for (int t = 1; t < min(nthreads, n); ++t)
+    pool.push_back(thread(worker));
+  worker();
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+}
+
+// a = max(a, e); squares sharing an edge both write its points
+inline void
+raise(atomic<float>& a, const float e)
+{
+  float old = a.load(memory_order_relaxed);
+  while (e > old && !a.compare_exchange_weak(old, e, memory_order_relaxed))
+    ;
+}
+
+// widen [xl, xr] to where row y crosses edge p-q (edges are level,
+// upright or at 45 degrees, so the crossing is a whole cell)
+inline void
+span(const int px, const int py, const int qx, const int qy, const int y,
+     int& xl, int& xr)
+{
+  if (y < min(py, qy) || y > max(py, qy))
+    return;
+  if (py == qy) {
+    xl = min(xl, min(px, qx));
+    xr = max(xr, max(px, qx));
+    return;
+  }
+  const int x = px + (y - py) * (qx - px) / (qy - py);
+  xl = min(xl, x);
+  xr = max(xr, x);
+}
+
+} // namespace
+
+BotMesh::BotMesh(const vector<float>& zz, const int w, const int h,
+                 const double cx, const double cy, const double zu,
+                 const int nt)
+  : z(zz), nx(w), ny(h), cellx(cx), celly(cy), zunit(zu),
+    nthreads(nt > 0 ? nt : static_cast<int>(thread::hardware_concurrency())),
+    error(new atomic<float>[static_cast<size_t>(w) * h]),
+    error_seconds(0), mesh_seconds(0), top_faces(0), nfaces(0), nvertices(0)
+{
+  const Clock::time_point t0 = Clock::now();
+  nthreads = max(1, nthreads);
+  const int s = 1 << SQUARE_LOG2;
+  for (int y0 = 0; y0 < ny - 1; y0 += s)
+    for (int x0 = 0; x0 < nx - 1; x0 += s)
+      add_squares(x0, y0, SQUARE_LOG2);
+
+  const size_t n = static_cast<size_t>(nx) * ny;
+  for (size_t i = 0; i < n; ++i)
+    error[i].store(0, memory_order_relaxed);
+  // every square's corners split whatever they lie on
+  const float always = numeric_limits<float>::infinity();
+  for (size_t i = 0; i < squares.size(); ++i) {
+    const Square& q = squares[i];
+    const int e = 1 << q.k;
+    error[static_cast<size_t>(q.y0) * nx + q.x0].store(always);
+    error[static_cast<size_t>(q.y0) * nx + q.x0 + e].store(always);
+    error[static_cast<size_t>(q.y0 + e) * nx + q.x0].store(always);
+    error[static_cast<size_t>(q.y0 + e) * nx + q.x0 + e].store(always);
+  }
+
+  // smallest triangles first: every size's children are final, on
+  // both sides of the squares' edges, before it is worked out
+  const int nsquares = static_cast<int>(squares.size());
+  for (int size = 1; size <= 2 * SQUARE_LOG2; ++size)
+    for_each_index(nsquares, nthreads, [&](const int i) {
+        split_errors(squares[i], size);
+      });
+  error_seconds = chrono::duration<double>(Clock::now() - t0).count();
+} // BotMesh::BotMesh
+
+void
+BotMesh::add_squares(const int x0, const int y0, const int k)
+{
+  // the grid's cells are [0, nx - 1) by [0, ny - 1)
+  const int s = 1 << k;
+  if (x0 >= nx - 1 || y0 >= ny - 1)
+    return;
+  if (x0 + s <= nx - 1 && y0 + s <= ny - 1) {
+    Square q = { x0, y0, k };
+    squares.push_back(q);
+    return;
+  }
+  // partly off the grid (never with one cell): its quarters
+  const int h = s / 2;
+  add_squares(x0, y0, k - 1);
+  add_squares(x0 + h, y0, k - 1);
+  add_squares(x0, y0 + h, k - 1);
+  add_squares(x0 + h, y0 + h, k - 1);
+} // BotMesh::add_squares
+
+BotMesh::Tri
+BotMesh::triangle(const Square& q, const int d, const int i) const
+{
+  // the bit above the d path bits picks the half of the square, each
+  // path bit the half of the triangle (as in Mapbox's Martini)
+  const int s = 1 << q.k;
+  Tri t;
+  if ((i >> d) & 1) {
+    t.ax = 0; t.ay = 0; t.bx = s; t.by = s; t.cx = s; t.cy = 0;
+  }
+  else {
+    t.ax = s; t.ay = s; t.bx = 0; t.by = 0; t.cx = 0; t.cy = s;
+  }
+  for (int b = d - 1; b >= 0; --b) {
+    const int mx = (t.ax + t.bx) >> 1;
+    const int my = (t.ay + t.by) >> 1;
+    if ((i >> b) & 1) {
+      t.bx = t.ax; t.by = t.ay; t.ax = t.cx; t.ay = t.cy;
+    }
+    else {
+      t.ax = t.bx; t.ay = t.by; t.bx = t.cx; t.by = t.cy;
+    }
+    t.cx = mx;
+    t.cy = my;
+  }
+  t.ax += q.x0; t.bx += q.x0; t.cx += q.x0;
+  t.ay += q.y0; t.by += q.y0; t.cy += q.y0;
+  return t;
+} // BotMesh::triangle
+
+float
+BotMesh::plane_error(const Tri& t) const
+{
+  const float ha = z[static_cast<size_t>(t.ay) * nx + t.ax];
+  const float hb = z[static_cast<size_t>(t.by) * nx + t.bx];
+  const float hc = z[static_cast<size_t>(t.cy) * nx + t.cx];
+  const double e1x = t.bx - t.ax;
+  const double e1y = t.by - t.ay;
+  const double e2x = t.cx - t.ax;
+  const double e2y = t.cy - t.ay;
+  const double det = e1x * e2y - e1y * e2x;
+  const double gx = ((hb - ha) * e2y - (hc - ha) * e1y) / det;
+  const double gy = ((hc - ha) * e1x - (hb - ha) * e2x) / det;
+
+  float err(0);
+  const int y0 = min(t.ay, min(t.by, t.cy));
+  const int y1 = max(t.ay, max(t.by, t.cy));
+  for (int y = y0; y <= y1; ++y) {
+    int xl = nx;
+    int xr = -1;
+    span(t.ax, t.ay, t.bx, t.by, y, xl, xr);
+    span(t.bx, t.by, t.cx, t.cy, y, xl, xr);
+    span(t.cx, t.cy, t.ax, t.ay, y, xl, xr);
+    const float* row = &z[static_cast<size_t>(y) * nx + xl];
+    const float p0 = static_cast<float>(ha + (xl - t.ax) * gx
+                                        + (y - t.ay) * gy);
+    const float dp = static_cast<float>(gx);
+    const int n = xr - xl + 1;
+    for (int j = 0; j < n; ++j) {
+      const float d = fabs(row[j] - (p0 + j * dp));
+      err = d > err ? d : err;
+    }
+  }
+  return err;
+} // BotMesh::plane_error
+
+void
+BotMesh::split_errors(const Square& q, const int size)
+{
+  // 'size' 2j - 1: hypotenuses 2^j cells along a row or column, 2j:
+  // across a 2^j cell square; at depth 2k - size in a 2^k square
+  const int d = 2 * q.k - size;
+  if (d < 0)
+    return;
+  const int n = 2 << d;
+  for (int i = 0; i < n; ++i) {
+    const Tri t = triangle(q, d, i);
+    float e = plane_error(t);
+    if (size > 1) {
+      // the children's midpoints, on this triangle's legs
+      e = max(e, error[static_cast<size_t>((t.ay + t.cy) >> 1) * nx
+                       + ((t.ax + t.cx) >> 1)].load(memory_order_relaxed));
+      e = max(e, error[static_cast<size_t>((t.by + t.cy) >> 1) * nx
+                       + ((t.bx + t.cx) >> 1)].load(memory_order_relaxed));
+    }
+    raise(error[static_cast<size_t>((t.ay + t.by) >> 1) * nx
+                + ((t.ax + t.bx) >> 1)], e);
+  }
+} // BotMesh::split_errors
+
+void
+BotMesh::top(const Tri& t, const int size, const float tol,
+             vector<int>* points, long long& n) const
+{
+  if (size >= 1) {
+    const int mx = (t.ax + t.bx) >> 1;
+    const int my = (t.ay + t.by) >> 1;
+    if (error[static_cast<size_t>(my) * nx + mx].load(memory_order_relaxed)
+        > tol) {
+      const Tri left = { t.cx, t.cy, t.ax, t.ay, mx, my };
+      const Tri right = { t.bx, t.by, t.cx, t.cy, mx, my };
+      top(left, size - 1, tol, points, n);
+      top(right, size - 1, tol, points, n);
+      return;
+    }
+  }
+  ++n;
+  if (points) {
+    points->push_back(t.ay * nx + t.ax);
+    points->push_back(t.by * nx + t.bx);
+    points->push_back(t.cy * nx + t.cx);
+  }
+} // BotMesh::top
+
+void
+BotMesh::top(const Square& q, const float tol, vector<int>* points,
+             long long& n) const
+{
+  top(triangle(q, 0, 0), 2 * q.k, tol, points, n);
+  top(triangle(q, 0, 1), 2 * q.k, tol, points, n);
+} // BotMesh::top
+
+long long
+BotMesh::count(const double max_error) const
+{
+  const float tol = static_cast<float>(max_error / zunit);
+  vector<long long> n(squares.size(), 0);
+  for_each_index(static_cast<int>(squares.size()), nthreads,
+                 [&](const int i) { top(squares[i], tol, 0, n[i]); });
+  long long sum(0);
+  for (size_t i = 0; i < n.size(); ++i)
+    sum += n[i];
+  return sum;
+} // BotMesh::count
+
+void
+BotMesh::extract(const double max_error, vector<double>& vertices,
+                 vector<int>& faces)
+{
+  const Clock::time_point t0 = Clock::now();
+  const float tol = static_cast<float>(max_error / zunit);
+  vector<vector<int> > parts(squares.size());
+  for_each_index(static_cast<int>(squares.size()), nthreads,
+                 [&](const int i) {
+                   long long n(0);
+                   top(squares[i], tol, &parts[i], n);
+                 });
+
+  // the top's cells, numbered in order
+  vector<int> points;
+  for (size_t i = 0; i < parts.size(); ++i)
+    points.insert(points.end(), parts[i].begin(), parts[i].end());
+  vector<int> cells(points);
+  sort(cells.begin(), cells.end());
+  cells.erase(unique(cells.begin(), cells.end()), cells.end());
+
+  vertices.clear();
+  faces.clear();
+  auto height = [&](const int p) {
+    return max(0.0f, min(65535.0f, z[p])) * zunit;
+  };
+  auto add_vertex = [&](const double x, const double y, const double h) {
+    vertices.push_back(x);
+    vertices.push_back(y);
+    vertices.push_back(h);
+    return static_cast<int>(vertices.size() / 3 - 1);
+  };
+  for (size_t i = 0; i < cells.size(); ++i) {
+    const int p = cells[i];
+    add_vertex((p % nx) * cellx, (ny - 1 - p / nx) * celly, height(p));
+  }
+  auto id = [&](const int p) {
+    return static_cast<int>(lower_bound(cells.begin(), cells.end(), p)
+                            - cells.begin());
+  };
+
+  // a face whose normal points along (hx, hy, hz), unless it has none
+  auto add_face = [&](int a, int b, int c, const double hx, const double hy,
+                      const double hz) {
+    const double* pa = &vertices[3 * static_cast<size_t>(a)];
+    const double* pb = &vertices[3 * static_cast<size_t>(b)];
+    const double* pc = &vertices[3 * static_cast<size_t>(c)];
+    const double ux = pb[0] - pa[0], uy = pb[1] - pa[1], uz = pb[2] - pa[2];
+    const double vx = pc[0] - pa[0], vy = pc[1] - pa[1], vz = pc[2] - pa[2];
+    const double nxx = uy * vz - uz * vy;
+    const double nyy = uz * vx - ux * vz;
+    const double nzz = ux * vy - uy * vx;
+    const double dot = nxx * hx + nyy * hy + nzz * hz;
+    if (a == b || b == c || c == a || dot == 0)
+      return;
+    if (dot < 0)
+      swap(b, c);
+    faces.push_back(a);
+    faces.push_back(b);
+    faces.push_back(c);
+  };
+  for (size_t i = 0; i < points.size(); i += 3)
+    add_face(id(points[i]), id(points[i + 1]), id(points[i + 2]), 0, 0, 1);
+  top_faces = static_cast<long long>(faces.size() / 3);
+
+  // the top's edge cells counter-clockwise seen from above (south row
+  // west to east first), each side with its outward direction
+  vector<int> loop;
+  vector<int> side;
+  const int last = nx * (ny - 1);
+  for (size_t i = 0; i < cells.size(); ++i)
+    if (cells[i] >= last && cells[i] < last + nx - 1) {
+      loop.push_back(cells[i]);
+      side.push_back(0);
+    }
+  for (int j = static_cast<int>(cells.size()) - 1; j >= 0; --j)
+    if (cells[j] % nx == nx - 1 && cells[j] > nx - 1) {
+      loop.push_back(cells[j]);
+      side.push_back(1);
+    }
+  for (int j = static_cast<int>(cells.size()) - 1; j >= 0; --j)
+    if (cells[j] < nx && cells[j] > 0) {
+      loop.push_back(cells[j]);
+      side.push_back(2);
+    }
+  for (size_t i = 0; i < cells.size(); ++i)
+    if (cells[i] % nx == 0 && cells[i] < last) {
+      loop.push_back(cells[i]);
+      side.push_back(3);
+    }
+  static const double out[4][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+
+  // the sides down to 0 (sharing the top's vertices already there)
+  const size_t n = loop.size();
+  vector<int> upper(n), lower(n);
+  for (size_t i = 0; i < n; ++i) {
+    upper[i] = id(loop[i]);
+    const double* v = &vertices[3 * static_cast<size_t>(upper[i])];
+    lower[i] = v[2] > 0 ? add_vertex(v[0], v[1], 0) : upper[i];
+  }
+  for (size_t i = 0; i < n; ++i) {
+    const size_t j = (i + 1) % n;
+    const double hx = out[side[i]][0];
+    const double hy = out[side[i]][1];
+    add_face(upper[i], lower[i], lower[j], hx, hy, 0);
+    add_face(upper[i], lower[j], upper[j], hx, hy, 0);
+  }
+
+  // the bottom
+  const int center = add_vertex(0.5 * (nx - 1) * cellx,
+                                0.5 * (ny - 1) * celly, 0);
+  for (size_t i = 0; i < n; ++i)
+    add_face(center, lower[i], lower[(i + 1) % n], 0, 0, -1);
+
+  nfaces = static_cast<long long>(faces.size() / 3);
+  nvertices = static_cast<long long>(vertices.size() / 3);
+  mesh_seconds = chrono::duration<double>(Clock::now() - t0).count();
+} // BotMesh::extract
+
+void
+BotMesh::print(FILE* fp, const string& what, const double max_error) const
+{
+  const long long dsp = 2LL * (nx - 1) * (ny - 1);
+  fprintf(fp, "%s: %lld of the DSP's %lld triangles (%.2f%%) within %g m;"
+          " %lld vertices, %lld faces closed\n",
+          what.c_str(), top_faces, dsp,
+          dsp ? 100.0 * top_faces / dsp : 0.0, max_error, nvertices, nfaces);
+  static const double factors[4] = { 0.25, 0.5, 2, 4 };
+  fprintf(fp, "  triangles within");
+  for (int i = 0; i < 4; ++i)
+    fprintf(fp, "%s %g m: %lld", i ? "," : "", factors[i] * max_error,
+            count(factors[i] * max_error));
+  fprintf(fp, "\n  %d squares on %d thread%s: errors %.3f s, mesh %.3f s\n",
+          static_cast<int>(squares.size()), nthreads,
+          nthreads > 1 ? "s" : "", error_seconds, mesh_seconds);
+} // BotMesh::print
@@ -0,0 +1,109 @@
+// content-hash manifest for the incremental mode (see build_manifest.h)
+
+#include <cstdio>
+#include <vector>
+#include <unistd.h> // access
+
+#include "build_manifest.h"
+
+using namespace std;
+
+Hash
+hash_bytes(const void* data, const size_t n, const Hash seed)
+{
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  Hash h(seed);
+  for (size_t i = 0; i < n; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+} // hash_bytes
+
+Hash
+hash_string(const string& s, const Hash seed)
+{
+  // include the length so ("ab","c") and ("a","bc") differ
+  return hash_bytes(s.data(), s.size(), hash_int(s.size(), seed));
+} // hash_string
+
+Hash
+hash_int(const long long v, const Hash seed)
+{
+  return hash_bytes(&v, sizeof(v), seed);
+} // hash_int
+
+bool
+hash_file(const string& path, Hash& h)
+{
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+  vector<char> buf(1 << 16);
+  size_t n;
+  while ((n = fread(&buf[0], 1, buf.size(), fp)) > 0)
+    h = hash_bytes(&buf[0], n, h);
+  bool ok = !ferror(fp);
+  fclose(fp);
+  return ok;
+} // hash_file
+
+BuildManifest::BuildManifest(const string& f)
+  : fname(f)
+{
+} // BuildManifest::BuildManifest
+
+void
+BuildManifest::load()
+{
+  keys.clear();
+  FILE* fp = fopen(fname.c_str(), "r");
+  if (!fp)
+    return;
+  char line[4096];
+  while (fgets(line, sizeof(line), fp)) {
+    unsigned long long key;
+    int n(0);
+    if (sscanf(line, "%llx %n", &key, &n) != 1 || !n)
+      continue;
+    string name(line + n);
+    while (!name.empty() && name[name.size()-1] == '\n')
+      name.erase(name.size()-1);
+    if (!name.empty())
+      keys[name] = key;
+  }
+  fclose(fp);
+} // BuildManifest::load
+
+bool
+BuildManifest::save() const
+{
+  FILE* fp = fopen(fname.c_str(), "w");
+  if (!fp)
+    return false;
+  for (map<string, Hash>::const_iterator i = keys.begin();
+       i != keys.end(); ++i)
+    fprintf(fp, "%016llx %s\n", i->second, i->first.c_str());
+  return fclose(fp) == 0;
+} // BuildManifest::save
+
+bool
+BuildManifest::up_to_date(const string& artifact, const Hash key) const
+{
+  map<string, Hash>::const_iterator i = keys.find(artifact);
+  if (i == keys.end() || i->second != key)
+    return false;
+  return access(artifact.c_str(), F_OK) == 0;
+} // BuildManifest::up_to_date
+
+void
+BuildManifest::record(const string& artifact, const Hash key)
+{
+  keys[artifact] = key;
+} // BuildManifest::record
+
+void
+BuildManifest::forget(const string& artifact)
+{
+  keys.erase(artifact);
+} // BuildManifest::forget
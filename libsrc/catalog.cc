@@ -0,0 +1,282 @@
+// machine-readable data set info (see catalog.h)
+
+#include <cmath>
+#include <mutex>
+#include <chrono>
+
+#include "catalog.h"
+#include "batch.h"
+#include "SafeFormat.h"
+#include "ogr_spatialref.h"
+#include "cpl_error.h"
+
+using namespace std;
+using namespace Loki;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// JSON string literal for 's'
+string
+quote(const string& s)
+{
+  string q("\"");
+  for (size_t i = 0; i < s.size(); ++i) {
+    const unsigned char c = static_cast<unsigned char>(s[i]);
+    switch (c) {
+    case '"':  q += "\\\""; break;
+    case '\\': q += "\\\\"; break;
+    case '\n': q += "\\n"; break;
+    case '\r': q += "\\r"; break;
+    case '\t': q += "\\t"; break;
+    default:
+      if (c < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        q += buf;
+      }
+      else {
+        q += static_cast<char>(c);
+      }
+      break;
+    }
+  }
+  return q + "\"";
+}
+
+// JSON number for 'v' (null if it has none)
+string
+number(const double v)
+{
+  if (!std::isfinite(v))
+    return "null";
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.17g", v);
+  return buf;
+}
+
+string
+number(const long long v)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%lld", v);
+  return buf;
+}
+
+// the SRS node's value, or ""
+string
+srs_value(const OGRSpatialReference& sp, const char* node)
+{
+  const char* v = sp.GetAttrValue(node, 0);
+  return v ? v : "";
+}
+
+} // namespace
+
+bool
+probe_dataset(const string& fname, const int nbins, const int nthreads,
+              DatasetInfo& d)
+{
+  d = DatasetInfo();
+  d.file = fname;
+  const Clock::time_point t0 = Clock::now();
+  // GDAL keeps the last error per thread, so each worker gets its own
+  CPLErrorReset();
+  GDALDataset* dataset
+    = static_cast<GDALDataset*>(GDALOpen(fname.c_str(), GA_ReadOnly));
+  d.open_ms = 1000 * chrono::duration<double>(Clock::now() - t0).count();
+  if (!dataset) {
+    const char* msg = CPLGetLastErrorMsg();
+    d.error = msg && *msg ? msg : "unable to open";
+    return false;
+  }
+
+  d.driver = dataset->GetDriver()->GetDescription();
+  char** flist = dataset->GetFileList();
+  for (int i = 0; flist && flist[i]; ++i) {
+    d.files.push_back(flist[i]);
+    d.bytes += file_size(flist[i]);
+  }
+  CSLDestroy(flist);
+
+  d.nx = dataset->GetRasterXSize();
+  d.ny = dataset->GetRasterYSize();
+  d.nbands = dataset->GetRasterCount();
+  d.has_transform = dataset->GetGeoTransform(d.transform) == CE_None;
+
+  const char* wkt = dataset->GetProjectionRef();
+  if (wkt && *wkt) {
+    d.wkt = wkt;
+    OGRSpatialReference sp(wkt);
+    d.projcs = srs_value(sp, "PROJCS");
+    d.geogcs = srs_value(sp, "GEOGCS");
+    d.datum = srs_value(sp, "DATUM");
+    const char* auth = sp.GetAuthorityName(0);
+    const char* code = sp.GetAuthorityCode(0);
+    if (auth && code && string(auth) == "EPSG")
+      d.epsg = code;
+    if (sp.IsGeographic()) {
+      d.xy_unit = srs_value(sp, "UNIT");
+    }
+    else {
+      const char* unit(0);
+      d.xy_meters = sp.GetLinearUnits(&unit);
+      d.xy_unit = unit ? unit : "";
+    }
+  }
+
+  if (d.nbands < 1) {
+    d.error = "no raster band";
+    GDALClose(dataset);
+    return false;
+  }
+  GDALRasterBand* band = dataset->GetRasterBand(1);
+  band->GetBlockSize(&d.blockx, &d.blocky);
+  d.data_type = GDALGetDataTypeName(band->GetRasterDataType());
+  const char* z_unit = band->GetUnitType();
+  d.z_unit = z_unit ? z_unit : "";
+  d.z_scale = band->GetScale();
+  d.z_offset = band->GetOffset();
+  int got(0);
+  d.nodata = band->GetNoDataValue(&got);
+  d.has_nodata = got != 0;
+  int got_min(0), got_max(0);
+  d.min = band->GetMinimum(&got_min);
+  d.max = band->GetMaximum(&got_max);
+  d.has_range = got_min && got_max;
+  d.noverviews = band->GetOverviewCount();
+
+  bool ok(true);
+  if (nbins > 0) {
+    BandStats bs(fname, band, nbins, nthreads);
+    if (!dispatch_data_type(band->GetRasterDataType(), bs)) {
+      d.error = "unsupported cell data type for stats";
+      ok = false;
+    }
+    else if (bs.failed) {
+      d.error = "unable to read the cells for stats";
+      ok = false;
+    }
+    else {
+      d.has_stats = true;
+      d.stats = bs.result;
+    }
+  }
+  GDALClose(dataset);
+  d.ok = ok;
+  return ok;
+} // probe_dataset
+
+string
+to_json(const DatasetInfo& d)
+{
+  string s("{\"file\": " + quote(d.file));
+  s += ", \"ok\": ";
+  s += d.ok ? "true" : "false";
+  if (!d.error.empty())
+    s += ", \"error\": " + quote(d.error);
+  s += ", \"open_ms\": " + number(d.open_ms);
+  if (d.driver.empty())
+    return s + "}";
+
+  s += ", \"driver\": " + quote(d.driver);
+  s += ", \"files\": [";
+  for (size_t i = 0; i < d.files.size(); ++i)
+    s += (i ? ", " : "") + quote(d.files[i]);
+  s += "], \"bytes\": " + number(d.bytes);
+  SPrintf(s, ", \"size\": [%d, %d], \"bands\": %d")(d.nx)(d.ny)(d.nbands);
+
+  s += ", \"geotransform\": ";
+  if (d.has_transform) {
+    s += "[";
+    for (int i = 0; i < 6; ++i)
+      s += (i ? ", " : "") + number(d.transform[i]);
+    s += "]";
+  }
+  else {
+    s += "null";
+  }
+
+  s += ", \"srs\": ";
+  if (!d.wkt.empty()) {
+    s += "{\"projcs\": " + quote(d.projcs);
+    s += ", \"geogcs\": " + quote(d.geogcs);
+    s += ", \"datum\": " + quote(d.datum);
+    s += ", \"epsg\": ";
+    if (d.epsg.empty())
+      s += "null";
+    else if (d.epsg.find_first_not_of("0123456789") == string::npos)
+      s += d.epsg;
+    else
+      s += quote(d.epsg);
+    s += ", \"wkt\": " + quote(d.wkt) + "}";
+  }
+  else {
+    s += "null";
+  }
+  s += ", \"units\": {\"xy\": " + quote(d.xy_unit);
+  s += ", \"xy_meters\": " + (d.xy_meters > 0 ? number(d.xy_meters)
+                                              : string("null"));
+  s += ", \"z\": " + quote(d.z_unit);
+  s += ", \"z_scale\": " + number(d.z_scale);
+  s += ", \"z_offset\": " + number(d.z_offset) + "}";
+
+  if (d.nbands < 1)
+    return s + "}";
+  SPrintf(s, ", \"block\": [%d, %d]")(d.blockx)(d.blocky);
+  s += ", \"type\": " + quote(d.data_type);
+  s += ", \"nodata\": " + (d.has_nodata ? number(d.nodata) : string("null"));
+  s += ", \"min\": " + (d.has_range ? number(d.min) : string("null"));
+  s += ", \"max\": " + (d.has_range ? number(d.max) : string("null"));
+  SPrintf(s, ", \"overviews\": %d")(d.noverviews);
+
+  if (d.has_stats) {
+    const Moments& m = d.stats.moments;
+    s += ", \"stats\": {\"count\": " + number(m.n);
+    s += ", \"nodata_count\": " + number(d.stats.nodata_count);
+    if (m.n > 0) {
+      s += ", \"min\": " + number(m.min);
+      s += ", \"max\": " + number(m.max);
+      s += ", \"mean\": " + number(m.mean);
+      s += ", \"stddev\": " + number(sqrt(m.variance()));
+    }
+    s += ", \"hist\": [";
+    for (size_t i = 0; i < d.stats.hist.size(); ++i)
+      s += (i ? ", " : "") + number(d.stats.hist[i]);
+    s += "], \"seconds\": " + number(d.stats.seconds) + "}";
+  }
+  return s + "}";
+} // to_json
+
+int
+write_catalog(const vector<string>& inputs, const int nbins,
+              const int nworkers, FILE* fp)
+{
+  // records wait for those before them, so the output is in input
+  // order however the workers finish
+  const int n = static_cast<int>(inputs.size());
+  vector<string> lines(n);
+  vector<char> done(n, 0);
+  int next(0);
+  int nfailed(0);
+  mutex lock;
+
+  // many data sets at a time: each one's statistics on one thread
+  const int stats_threads = n > 1 && nworkers != 1 ? 1 : 0;
+  run_pool(n, nworkers, [&](const int i) {
+      DatasetInfo d;
+      const bool ok = probe_dataset(inputs[i], nbins, stats_threads, d);
+      const string line = to_json(d);
+      lock_guard<mutex> hold(lock);
+      nfailed += ok ? 0 : 1;
+      lines[i] = line;
+      done[i] = 1;
+      for (; next < n && done[next]; ++next) {
+        fprintf(fp, "%s\n", lines[next].c_str());
+        string().swap(lines[next]);
+      }
+      fflush(fp);
+    });
+  return nfailed;
+} // write_catalog
@@ -0,0 +1,162 @@
+// decimated band reader (see decimate.h)
+
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+#include "decimate.h"
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// decimated rows read from an overview at a time
+const int BLOCK_ROWS = 16;
+
+} // namespace
+
+Decimator::Decimator(GDALRasterBand* b, const int f, const DecimateMode m,
+                     const bool has_nd, const double nd)
+  : band(b), factor(max(1, f)), mode(m), has_nodata(has_nd),
+    nodata(static_cast<float>(nd)),
+    band_nx(b->GetXSize()), band_ny(b->GetYSize()),
+    width((band_nx + factor - 1) / factor),
+    height((band_ny + factor - 1) / factor),
+    use_overview(false), next(0), first(0), nrows(0),
+    seconds(0), band_rows(0)
+{
+  // GDAL reads the coarsest overview at least as fine as the buffer;
+  // with none, it would read every cell to pick one of N^2
+  for (int i = 0; i < band->GetOverviewCount(); ++i) {
+    GDALRasterBand* ov = band->GetOverview(i);
+    if (ov && ov->GetXSize() >= width && ov->GetXSize() < band_nx
+        && ov->GetYSize() >= height)
+      use_overview = true;
+  }
+  if (!use_overview) {
+    rows.resize(static_cast<size_t>(factor) * band_nx);
+    acc.resize(band_nx);
+    count.resize(band_nx);
+  }
+} // Decimator::Decimator
+
+bool
+Decimator::read_row(float* row)
+{
+  if (next >= height)
+    return false;
+  const Clock::time_point t0 = Clock::now();
+  bool ok;
+  if (use_overview) {
+    ok = next < first + nrows || read_overview_block();
+    if (ok)
+      copy(&block[static_cast<size_t>(next - first) * width],
+           &block[static_cast<size_t>(next - first + 1) * width], row);
+  }
+  else {
+    ok = reduce_row(row);
+  }
+  ++next;
+  seconds += chrono::duration<double>(Clock::now() - t0).count();
+  return ok;
+} // Decimator::read_row
+
+bool
+Decimator::read_overview_block()
+{
+  first = next;
+  nrows = min(BLOCK_ROWS, height - first);
+  block.resize(static_cast<size_t>(nrows) * width);
+  const int y0 = first * factor;
+  const int wrows = min(band_ny - y0, nrows * factor);
+  return band->RasterIO(GF_Read, 0, y0, band_nx, wrows, &block[0],
+                        width, nrows, GDT_Float32, 0, 0) == CE_None;
+} // Decimator::read_overview_block
+
+bool
+Decimator::reduce_row(float* row)
+{
+  const int y0 = next * factor;
+  const int n = min(factor, band_ny - y0);
+  if (band->RasterIO(GF_Read, 0, y0, band_nx, n, &rows[0], band_nx, n,
+                     GDT_Float32, 0, 0) != CE_None)
+    return false;
+  band_rows += n;
+
+  // no cell compares equal to NaN: without a no-data value every cell
+  // counts
+  const float nd = has_nodata ? nodata : numeric_limits<float>::quiet_NaN();
+  const int w = band_nx;
+  float* a = &acc[0];
+  float* c = &count[0];
+
+  // down the columns
+  if (mode == DECIMATE_MEAN) {
+    fill(a, a + w, 0.0f);
+    fill(c, c + w, 0.0f);
+    for (int r = 0; r < n; ++r) {
+      const float* v = &rows[static_cast<size_t>(r) * w];
+      for (int x = 0; x < w; ++x) {
+        a[x] += v[x] != nd ? v[x] : 0.0f;
+        c[x] += v[x] != nd ? 1.0f : 0.0f;
+      }
+    }
+  }
+  else {
+    const bool lo = mode == DECIMATE_MIN;
+    const float init = lo ? numeric_limits<float>::infinity()
+                          : -numeric_limits<float>::infinity();
+    fill(a, a + w, init);
+    for (int r = 0; r < n; ++r) {
+      const float* v = &rows[static_cast<size_t>(r) * w];
+      if (lo) {
+        for (int x = 0; x < w; ++x)
+          a[x] = v[x] != nd && v[x] < a[x] ? v[x] : a[x];
+      }
+      else {
+        for (int x = 0; x < w; ++x)
+          a[x] = v[x] != nd && v[x] > a[x] ? v[x] : a[x];
+      }
+    }
+  }
+
+  // then across each block of columns
+  for (int j = 0; j < width; ++j) {
+    const int x0 = j * factor;
+    const int x1 = min(w, x0 + factor);
+    if (mode == DECIMATE_MEAN) {
+      float s = 0;
+      float k = 0;
+      for (int x = x0; x < x1; ++x) {
+        s += a[x];
+        k += c[x];
+      }
+      row[j] = k > 0 ? s / k : nodata;
+    }
+    else {
+      float v = a[x0];
+      for (int x = x0 + 1; x < x1; ++x)
+        v = mode == DECIMATE_MIN ? min(v, a[x]) : max(v, a[x]);
+      row[j] = std::isinf(v) ? nodata : v;
+    }
+  }
+  return true;
+} // Decimator::reduce_row
+
+void
+Decimator::print(FILE* fp, const string& what) const
+{
+  static const char* const modes[] = { "mean", "minimum", "maximum" };
+  if (use_overview)
+    fprintf(fp, "%s: decimated %dx%d to %dx%d (1/%d) from an overview,"
+            " %.3f s reading\n",
+            what.c_str(), band_nx, band_ny, width, height, factor, seconds);
+  else
+    fprintf(fp, "%s: decimated %dx%d to %dx%d (1/%d, block %s),"
+            " %lld rows read, %.3f s reading\n",
+            what.c_str(), band_nx, band_ny, width, height, factor,
+            modes[mode], band_rows, seconds);
+} // Decimator::print
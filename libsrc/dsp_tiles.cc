@@ -0,0 +1,169 @@
+// tiled DSP output (see dsp_tiles.h)
+
+#include <cstdio>
+#include <sys/types.h> // off_t
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "SafeFormat.h"
+#include "dsp_tiles.h"
+
+using namespace std;
+using namespace Loki;
+
+namespace {
+
+// the start of every tile along one axis of n cells
+vector<int>
+tile_starts(const int n, const int size, const int overlap)
+{
+  vector<int> starts;
+  const int step = size - overlap;
+  for (int s = 0; ; s += step) {
+    // never a last tile of a single post, which spans no cell
+    starts.push_back(max(0, min(s, n - 2)));
+    if (s + size >= n)
+      break;
+  }
+  return starts;
+}
+
+// one row of a DSP: big-endian 16 bit cells, clamped
+void
+pack_row(const int* row, const int nx, unsigned char* buf)
+{
+  for (int x = 0; x < nx; ++x) {
+    const int v = row[x] < 0 ? 0 : row[x] > 65535 ? 65535 : row[x];
+    buf[2 * x] = static_cast<unsigned char>(v >> 8);
+    buf[2 * x + 1] = static_cast<unsigned char>(v & 0xff);
+  }
+}
+
+} // namespace
+
+vector<DspTile>
+layout_tiles(const string& base, const int nx, const int ny,
+             const DspTiling& t)
+{
+  vector<DspTile> tiles;
+  if (t.overlap < 1 || t.overlap >= min(t.w, t.h) || nx < 1 || ny < 1)
+    return tiles;
+  const vector<int> xs(tile_starts(nx, t.w, t.overlap));
+  const vector<int> ys(tile_starts(ny, t.h, t.overlap));
+  for (size_t r = 0; r < ys.size(); ++r) {
+    for (size_t c = 0; c < xs.size(); ++c) {
+      DspTile d;
+      d.row = static_cast<int>(r);
+      d.col = static_cast<int>(c);
+      d.x0 = xs[c];
+      d.y0 = ys[r];
+      d.nx = min(t.w, nx - d.x0);
+      d.ny = min(t.h, ny - d.y0);
+      string name;
+      SPrintf(name, "%s-r%d-c%d")(base)(d.row)(d.col);
+      d.dsp = name + ".dsp";
+      d.solid = name + ".s";
+      tiles.push_back(d);
+    }
+  }
+  return tiles;
+} // layout_tiles
+
+bool
+write_dsp_file(const string& fname, const int* cells, const int nx,
+               const int ny)
+{
+  FILE* fp = fopen(fname.c_str(), "wb");
+  if (!fp)
+    return false;
+  vector<unsigned char> buf(2 * static_cast<size_t>(nx));
+  bool ok = true;
+  // south row first
+  for (int y = ny - 1; y >= 0 && ok; --y) {
+    pack_row(cells + static_cast<size_t>(y) * nx, nx, &buf[0]);
+    ok = fwrite(&buf[0], 1, buf.size(), fp) == buf.size();
+  }
+  return fclose(fp) == 0 && ok;
+} // write_dsp_file
+
+DspRows::DspRows(const string& f, const int w, const int h)
+  : fname(f), nx(w), ny(h), fp(0), buf(2 * static_cast<size_t>(w)),
+    rows(0), ok(false)
+{
+} // DspRows::DspRows
+
+DspRows::~DspRows()
+{
+  if (fp)
+    fclose(fp);
+} // DspRows::~DspRows
+
+bool
+DspRows::open()
+{
+  fp = fopen(fname.c_str(), "wb");
+  rows = 0;
+  ok = fp != 0;
+  return ok;
+} // DspRows::open
+
+void
+DspRows::add_row(const int* row)
+{
+  if (!ok || rows >= ny) {
+    ok = false;
+    return;
+  }
+  // row i (from the north) goes ny - 1 - i rows into the file
+  pack_row(row, nx, &buf[0]);
+  const off_t at = static_cast<off_t>(ny - 1 - rows) * buf.size();
+  ok = fseeko(fp, at, SEEK_SET) == 0
+    && fwrite(&buf[0], 1, buf.size(), fp) == buf.size();
+  ++rows;
+} // DspRows::add_row
+
+bool
+DspRows::close()
+{
+  if (!fp)
+    return false;
+  const bool closed = fclose(fp) == 0;
+  fp = 0;
+  return closed && ok && rows == ny;
+} // DspRows::close
+
+bool
+write_dsp_tiles(const vector<DspTile>& tiles, const TileCells& cells,
+                const int nthreads)
+{
+  const int ntiles = static_cast<int>(tiles.size());
+  int nt = nthreads > 0 ? nthreads
+                        : static_cast<int>(thread::hardware_concurrency());
+  nt = max(1, min(nt, ntiles));
+
+  atomic<int> next(0);
+  atomic<bool> failed(false);
+  auto worker = [&](const int w) {
+    vector<int> buf;
+    for (int i = next++; i < ntiles && !failed; i = next++) {
+      const DspTile& t = tiles[i];
+      buf.resize(static_cast<size_t>(t.nx) * t.ny);
+      if (!cells(w, t, buf)) {
+        Printf("ERROR:  Unable to read the cells of '%s'.\n")(t.dsp);
+        failed = true;
+      }
+      else if (!write_dsp_file(t.dsp, &buf[0], t.nx, t.ny)) {
+        Printf("ERROR:  Unable to write '%s'.\n")(t.dsp);
+        failed = true;
+      }
+    }
+  };
+  vector<thread> pool;
+  for (int t = 1; t < nt; ++t)
+    pool.push_back(thread(worker, t));
+  worker(0);
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+  return !failed;
+} // write_dsp_tiles
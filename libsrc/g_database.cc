@@ -0,0 +1,138 @@
+// in-process .g writer on libwdb (see g_database.h)
+
+#include <cstdio>
+#include <mutex>
+
+#include "common.h"
+#include "vmath.h"
+#include "raytrace.h"
+#include "wdb.h"
+
+#include "g_database.h"
+
+using namespace std;
+
+namespace {
+
+// BRL-CAD stores lengths in millimeters
+const double MM_PER_M = 1000.0;
+
+} // namespace
+
+mutex&
+brlcad_lock()
+{
+  // libwdb/librt are not thread safe
+  static mutex m;
+  return m;
+} // brlcad_lock
+
+GDatabase::GDatabase()
+  : wdbp(0)
+{
+} // GDatabase::GDatabase
+
+GDatabase::~GDatabase()
+{
+  close();
+} // GDatabase::~GDatabase
+
+bool
+GDatabase::open(const string& fname, const string& title)
+{
+  close();
+  lock_guard<mutex> lock(brlcad_lock());
+  // wdb_fopen() creates a new, empty database
+  wdbp = wdb_fopen(fname.c_str());
+  if (!wdbp)
+    return false;
+  return mk_id_units(wdbp, title.c_str(), "m") == 0;
+} // GDatabase::open
+
+bool
+GDatabase::close()
+{
+  if (!wdbp)
+    return true;
+  lock_guard<mutex> lock(brlcad_lock());
+  // wdb_close() returns nothing: flush the file first so a full disk
+  // or a write error shows up here instead of being lost
+  FILE* fp = wdbp->dbip ? wdbp->dbip->dbi_fp : 0;
+  const bool ok = !fp || (fflush(fp) == 0 && !ferror(fp));
+  wdb_close(wdbp);
+  wdbp = 0;
+  return ok;
+} // GDatabase::close
+
+bool
+GDatabase::add_dsp(const string& name, const string& dspfile,
+                   const int nx, const int ny,
+                   const double cell, const double zscale,
+                   const double origin[3])
+{
+  if (!wdbp)
+    return false;
+  lock_guard<mutex> lock(brlcad_lock());
+
+  struct rt_dsp_internal* dsp;
+  BU_ALLOC(dsp, struct rt_dsp_internal);
+  dsp->magic = RT_DSP_INTERNAL_MAGIC;
+  bu_vls_init(&dsp->dsp_name);
+  bu_vls_strcpy(&dsp->dsp_name, dspfile.c_str());
+  dsp->dsp_datasrc = RT_DSP_SRC_FILE;
+  dsp->dsp_xcnt = nx;
+  dsp->dsp_ycnt = ny;
+  dsp->dsp_smooth = 0;
+  dsp->dsp_cuttype = DSP_CUT_DIR_ADAPT;
+
+  // solid to model: scale cells to cell size and height units to
+  // zscale, then move to the origin
+  MAT_IDN(dsp->dsp_stom);
+  dsp->dsp_stom[0] = cell * MM_PER_M;
+  dsp->dsp_stom[5] = cell * MM_PER_M;
+  dsp->dsp_stom[10] = zscale * MM_PER_M;
+  if (origin) {
+    dsp->dsp_stom[MDX] = origin[0] * MM_PER_M;
+    dsp->dsp_stom[MDY] = origin[1] * MM_PER_M;
+    dsp->dsp_stom[MDZ] = origin[2] * MM_PER_M;
+  }
+  bn_mat_inv(dsp->dsp_mtos, dsp->dsp_stom);
+
+  // the matrix is already in mm; wdb_export() frees 'dsp'
+  return wdb_export(wdbp, name.c_str(), dsp, ID_DSP, 1.0) == 0;
+} // GDatabase::add_dsp
+
+bool
+GDatabase::add_bot(const string& name, const vector<double>& vertices,
+                   const vector<int>& faces)
+{
+  if (!wdbp || vertices.empty() || faces.empty())
+    return false;
+
+  // mk_bot() takes millimeters, and arrays it may modify
+  vector<fastf_t> mm(vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i)
+    mm[i] = vertices[i] * MM_PER_M;
+  vector<int> f(faces);
+
+  lock_guard<mutex> lock(brlcad_lock());
+  return mk_bot(wdbp, name.c_str(), RT_BOT_SOLID, RT_BOT_CCW, 0,
+                mm.size() / 3, f.size() / 3, &mm[0], &f[0], NULL, NULL) == 0;
+} // GDatabase::add_bot
+
+bool
+GDatabase::add_comb(const string& name, const vector<string>& members,
+                    const bool region)
+{
+  if (!wdbp)
+    return false;
+  lock_guard<mutex> lock(brlcad_lock());
+
+  struct wmember head;
+  BU_LIST_INIT(&head.l);
+  for (size_t i = 0; i < members.size(); ++i)
+    mk_addmember(members[i].c_str(), &head.l, NULL, WMOP_UNION);
+
+  return mk_lcomb(wdbp, name.c_str(), &head, region ? 1 : 0,
+                  NULL, NULL, NULL, 0) == 0;
+} // GDatabase::add_comb
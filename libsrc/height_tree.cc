@@ -0,0 +1,407 @@
+// min/max quadtree for ray casting over the height grid (see
+// height_tree.h)
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+
+#include "height_tree.h"
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// nodes a 64-byte line
+const int LINE_NODES = 8;
+
+// sight lines a unit of benchmark work
+const int BENCH_CHUNK = 1024;
+
+// run 'f(i)' for every i in [0, n) on 'nthreads' threads
+template <class F>
+void
+for_each_index(const int n, const int nthreads, F f)
+{
+  atomic<int> next(0);
+  auto worker = [&]() {
+    for (int i = next++; i < n; i = next++)
+      f(i);
+  };
+  vector<thread> pool;
+  for (int t = 1; t < min(nthreads, n); ++t)
+    pool.push_back(thread(worker));
+  worker();
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+}
+
+int
+all_threads(const int nthreads)
+{
+  const int n = nthreads > 0
+    ? nthreads : static_cast<int>(thread::hardware_concurrency());
+  return max(1, n);
+}
+
+// the surface's height at (x, y) (inside the grid)
+double
+ground(const vector<float>& z, const int nx, const int ny, const double x,
+       const double y)
+{
+  const int cx = min(max(static_cast<int>(floor(x)), 0), nx - 2);
+  const int cy = min(max(static_cast<int>(floor(y)), 0), ny - 2);
+  const double u = x - cx;
+  const double v = y - cy;
+  const float* r0 = &z[static_cast<size_t>(cy) * nx + cx];
+  const float* r1 = r0 + nx;
+  if (u >= v)
+    return r0[0] + u * (r0[1] - r0[0]) + v * (r1[1] - r0[1]);
+  return r0[0] + u * (r1[1] - r1[0]) + v * (r1[0] - r0[0]);
+}
+
+} // namespace
+
+HeightTree::HeightTree(const vector<float>& zz, const int w, const int h,
+                       const int nthreads)
+  : z(zz), nx(w), ny(h), base(0), seconds(0)
+{
+  const Clock::time_point t0 = Clock::now();
+  if (nx < 2 || ny < 2)
+    return;
+
+  // levels of ceil(cells / 2^l) nodes a side, up to one node
+  size_t total(0);
+  for (int l = 1; ; ++l) {
+    Level v;
+    v.w = ((nx - 1) + (1 << l) - 1) >> l;
+    v.h = ((ny - 1) + (1 << l) - 1) >> l;
+    v.stride = (v.w + LINE_NODES - 1) / LINE_NODES * LINE_NODES;
+    v.offset = total;
+    total += static_cast<size_t>(v.stride) * v.h;
+    level.push_back(v);
+    if (v.w == 1 && v.h == 1)
+      break;
+  }
+  nodes.resize(total + LINE_NODES);
+  const uintptr_t addr = reinterpret_cast<uintptr_t>(&nodes[0]);
+  const size_t line = LINE_NODES * sizeof(Range);
+  base = &nodes[0] + (line - addr % line) % line / sizeof(Range);
+
+  // level 1 from the samples, the rest from the level below
+  const int nt = all_threads(nthreads);
+  for (size_t l = 0; l < level.size(); ++l) {
+    const Level& v = level[l];
+    for_each_index(v.h, nt, [&](const int y) {
+        Range* out = base + v.offset + static_cast<size_t>(y) * v.stride;
+        for (int x = 0; x < v.w; ++x) {
+          float lo = numeric_limits<float>::infinity();
+          float hi = -lo;
+          if (l == 0) {
+            const int x1 = min(2 * x + 2, nx - 1);
+            const int y1 = min(2 * y + 2, ny - 1);
+            for (int sy = 2 * y; sy <= y1; ++sy) {
+              const float* row = &z[static_cast<size_t>(sy) * nx];
+              for (int sx = 2 * x; sx <= x1; ++sx) {
+                lo = min(lo, row[sx]);
+                hi = max(hi, row[sx]);
+              }
+            }
+          }
+          else {
+            const Level& c = level[l - 1];
+            for (int cy = 2 * y; cy <= min(2 * y + 1, c.h - 1); ++cy)
+              for (int cx = 2 * x; cx <= min(2 * x + 1, c.w - 1); ++cx) {
+                const Range& r = node(static_cast<int>(l), cx, cy);
+                lo = min(lo, r.lo);
+                hi = max(hi, r.hi);
+              }
+          }
+          out[x].lo = lo;
+          out[x].hi = hi;
+        }
+      });
+  }
+  seconds = chrono::duration<double>(Clock::now() - t0).count();
+} // HeightTree::HeightTree
+
+bool
+HeightTree::clip(const double p[3], const double d[3], const double tmin,
+                 double& t0, double& t1) const
+{
+  if (nx < 2 || ny < 2)
+    return false;
+  t0 = tmin;
+  t1 = 1;
+  const double hi[2] = { static_cast<double>(nx - 1),
+                         static_cast<double>(ny - 1) };
+  for (int k = 0; k < 2; ++k) {
+    if (d[k] == 0) {
+      if (p[k] < 0 || p[k] > hi[k])
+        return false;
+      continue;
+    }
+    double a = -p[k] / d[k];
+    double b = (hi[k] - p[k]) / d[k];
+    if (a > b)
+      swap(a, b);
+    t0 = max(t0, a);
+    t1 = min(t1, b);
+  }
+  return t0 <= t1;
+} // HeightTree::clip
+
+bool
+HeightTree::cell(const int x, const int y, const double p[3],
+                 const double d[3], const double t0, const double t1,
+                 double& t) const
+{
+  const float* r0 = &z[static_cast<size_t>(y) * nx + x];
+  const float* r1 = r0 + nx;
+
+  // the ray's height over either triangle's plane, a + b t; the
+  // triangles meet where u = v
+  const double u0 = p[0] - x;
+  const double v0 = p[1] - y;
+  double ts[3] = { t0, t1, t1 };
+  int n = 2;
+  if (d[0] != d[1]) {
+    const double tm = (v0 - u0) / (d[0] - d[1]);
+    if (tm > t0 && tm < t1) {
+      ts[1] = tm;
+      n = 3;
+    }
+  }
+  for (int i = 0; i + 1 < n; ++i) {
+    const double a0 = ts[i];
+    const double a1 = ts[i + 1];
+    const double m = 0.5 * (a0 + a1);
+    double h0, hu, hv;
+    if (u0 + m * d[0] >= v0 + m * d[1]) {
+      h0 = r0[0]; hu = r0[1] - r0[0]; hv = r1[1] - r0[1];
+    }
+    else {
+      h0 = r0[0]; hu = r1[1] - r1[0]; hv = r1[0] - r0[0];
+    }
+    const double a = p[2] - h0 - hu * u0 - hv * v0;
+    const double b = d[2] - hu * d[0] - hv * d[1];
+    const double f0 = a + b * a0;
+    if (f0 <= 0) {
+      t = a0;
+      return true;
+    }
+    if (a + b * a1 <= 0) {
+      t = min(max(-a / b, a0), a1);
+      return true;
+    }
+  }
+  return false;
+} // HeightTree::cell
+
+bool
+HeightTree::descend(const int l, const int x, const int y, const double p[3],
+                    const double d[3], const double t0, const double t1,
+                    double& t, long long& visits) const
+{
+  ++visits;
+  const Range& r = node(l, x, y);
+  if (min(p[2] + t0 * d[2], p[2] + t1 * d[2]) > r.hi)
+    return false;
+
+  // split where the segment crosses the children's middle lines, then
+  // take the pieces in order
+  const int half = 1 << (l - 1);
+  const int mx = (2 * x + 1) * half;
+  const int my = (2 * y + 1) * half;
+  double ts[4] = { t0, t1, t1, t1 };
+  int n = 1;
+  if (d[0] != 0 && mx < nx - 1) {
+    const double tx = (mx - p[0]) / d[0];
+    if (tx > t0 && tx < t1)
+      ts[n++] = tx;
+  }
+  if (d[1] != 0 && my < ny - 1) {
+    const double ty = (my - p[1]) / d[1];
+    if (ty > t0 && ty < t1)
+      ts[n++] = ty;
+  }
+  if (n == 3 && ts[2] < ts[1])
+    swap(ts[1], ts[2]);
+  ts[n++] = t1;
+
+  for (int i = 0; i + 1 < n; ++i) {
+    const double a0 = ts[i];
+    const double a1 = ts[i + 1];
+    const double m = 0.5 * (a0 + a1);
+    const int cx = 2 * x + (p[0] + m * d[0] >= mx ? 1 : 0);
+    const int cy = 2 * y + (p[1] + m * d[1] >= my ? 1 : 0);
+    if (l > 1) {
+      const Level& c = level[l - 2];
+      if (descend(l - 1, min(cx, c.w - 1), min(cy, c.h - 1), p, d, a0, a1,
+                  t, visits))
+        return true;
+    }
+    else {
+      ++visits;
+      if (cell(min(cx, nx - 2), min(cy, ny - 2), p, d, a0, a1, t))
+        return true;
+    }
+  }
+  return false;
+} // HeightTree::descend
+
+bool
+HeightTree::intersect(const double p[3], const double d[3], double& t,
+                      const double tmin, long long* visits) const
+{
+  double t0, t1;
+  if (!clip(p, d, tmin, t0, t1))
+    return false;
+  long long n(0);
+  const bool hit = descend(levels(), 0, 0, p, d, t0, t1, t, n);
+  if (visits)
+    *visits += n;
+  return hit;
+} // HeightTree::intersect
+
+bool
+HeightTree::march(const double p[3], const double d[3], double& t,
+                  const double tmin, long long* visits) const
+{
+  double t0, t1;
+  if (!clip(p, d, tmin, t0, t1))
+    return false;
+
+  // cell to cell, as in Amanatides and Woo
+  int cx = min(max(static_cast<int>(floor(p[0] + t0 * d[0])), 0), nx - 2);
+  int cy = min(max(static_cast<int>(floor(p[1] + t0 * d[1])), 0), ny - 2);
+  const int sx = d[0] > 0 ? 1 : -1;
+  const int sy = d[1] > 0 ? 1 : -1;
+  const double inf = numeric_limits<double>::infinity();
+  long long n(0);
+  bool hit(false);
+  for (double a0 = t0; ; ) {
+    const double tx = d[0] == 0 ? inf : (cx + (sx > 0) - p[0]) / d[0];
+    const double ty = d[1] == 0 ? inf : (cy + (sy > 0) - p[1]) / d[1];
+    const double a1 = min(t1, min(tx, ty));
+    ++n;
+    if (cell(cx, cy, p, d, a0, max(a0, a1), t)) {
+      hit = true;
+      break;
+    }
+    if (a1 >= t1)
+      break;
+    if (tx <= ty)
+      cx += sx;
+    if (ty <= tx)
+      cy += sy;
+    if (cx < 0 || cx > nx - 2 || cy < 0 || cy > ny - 2)
+      break;
+    a0 = max(a0, a1);
+  }
+  if (visits)
+    *visits += n;
+  return hit;
+} // HeightTree::march
+
+void
+sightlines(const vector<float>& z, const int nx, const int ny,
+           const double cellx, const double celly, const double zunit,
+           const vector<Sightline>& lines, const int bench, FILE* fp,
+           FILE* log, const string& what, const int nthreads)
+{
+  const HeightTree tree(z, nx, ny, nthreads);
+  fprintf(log, "%s: %d levels, %.1f MB, built in %.3f s\n", what.c_str(),
+          tree.levels(), tree.bytes() / 1048576.0, tree.build_seconds());
+
+  // both ends above the ground; a hit short of the far end blocks it
+  auto segment = [&](const Sightline& s, double p[3], double d[3]) {
+    p[0] = s.x1;
+    p[1] = s.y1;
+    p[2] = ground(z, nx, ny, s.x1, s.y1) + s.h / zunit;
+    d[0] = s.x2 - s.x1;
+    d[1] = s.y2 - s.y1;
+    d[2] = ground(z, nx, ny, s.x2, s.y2) + s.h / zunit - p[2];
+  };
+
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const Sightline& s = lines[i];
+    fprintf(fp, "%g,%g -> %g,%g (%g m up): ", s.x1, s.y1, s.x2, s.y2, s.h);
+    if (min(min(s.x1, s.x2), min(s.y1, s.y2)) < 0 || max(s.x1, s.x2) > nx - 1
+        || max(s.y1, s.y2) > ny - 1) {
+      fprintf(fp, "outside the %d x %d grid\n", nx, ny);
+      continue;
+    }
+    double p[3], d[3], t;
+    segment(s, p, d);
+    if (!tree.intersect(p, d, t) || t >= 1) {
+      fprintf(fp, "visible\n");
+      continue;
+    }
+    const double x = p[0] + t * d[0];
+    const double y = p[1] + t * d[1];
+    fprintf(fp, "blocked at %.2f,%.2f (%.1f m high), %.1f m away\n", x, y,
+            ground(z, nx, ny, x, y) * zunit,
+            t * hypot(d[0] * cellx, d[1] * celly));
+  }
+  if (bench <= 0 || nx < 2 || ny < 2)
+    return;
+
+  // random sight lines 2 m up, the same ones both ways
+  const int nt = all_threads(nthreads);
+  vector<Sightline> random(bench);
+  mt19937 gen(1);
+  uniform_real_distribution<double> rx(0, nx - 1), ry(0, ny - 1);
+  for (int i = 0; i < bench; ++i) {
+    Sightline& s = random[i];
+    s.x1 = rx(gen);
+    s.y1 = ry(gen);
+    s.x2 = rx(gen);
+    s.y2 = ry(gen);
+    s.h = 2;
+  }
+  const int nchunks = (bench + BENCH_CHUNK - 1) / BENCH_CHUNK;
+  vector<double> tt(bench), tm(bench);
+  vector<long long> vt(nchunks, 0), vm(nchunks, 0);
+  auto run = [&](const bool use_tree, vector<double>& out,
+                 vector<long long>& visits) {
+    const Clock::time_point t0 = Clock::now();
+    for_each_index(nchunks, nt, [&](const int c) {
+        const int end = min(bench, (c + 1) * BENCH_CHUNK);
+        for (int i = c * BENCH_CHUNK; i < end; ++i) {
+          double p[3], d[3], t;
+          segment(random[i], p, d);
+          const bool hit = use_tree ? tree.intersect(p, d, t, 0, &visits[c])
+                                    : tree.march(p, d, t, 0, &visits[c]);
+          out[i] = hit && t < 1 ? t : 1;
+        }
+      });
+    return chrono::duration<double>(Clock::now() - t0).count();
+  };
+  const double tree_seconds = run(true, tt, vt);
+  const double march_seconds = run(false, tm, vm);
+
+  int blocked(0), differ(0);
+  long long tree_visits(0), march_visits(0);
+  for (int i = 0; i < bench; ++i) {
+    blocked += tt[i] < 1;
+    differ += fabs(tt[i] - tm[i]) > 1e-9;
+  }
+  for (int c = 0; c < nchunks; ++c) {
+    tree_visits += vt[c];
+    march_visits += vm[c];
+  }
+  fprintf(log, "  %d random sight lines (%d blocked) on %d thread%s:"
+          " tree %.3f s (%.1f nodes and cells each), marching %.3f s"
+          " (%.1f cells each), %.1fx; %d differ\n",
+          bench, blocked, nt, nt > 1 ? "s" : "", tree_seconds,
+          static_cast<double>(tree_visits) / bench, march_seconds,
+          static_cast<double>(march_visits) / bench,
+          tree_seconds > 0 ? march_seconds / tree_seconds : 0.0, differ);
+} // sightlines
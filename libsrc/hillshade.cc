@@ -0,0 +1,277 @@
+// shaded relief from the height grid (see hillshade.h)
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "hillshade.h"
+#include "height_tree.h"
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// rows per band of work
+const int BAND_ROWS = 64;
+
+// most suns blended
+const int MAX_SUNS = 4;
+
+// light left in cast shadows
+const float SHADOW_LIGHT = 0.5f;
+
+// how far above its cell a shadow ray starts (height units)
+const double SHADOW_LIFT = 1e-3;
+
+// copy a row with its edge cells repeated on both sides:
+// dst[0] .. dst[n+1]
+void
+pad_row(const float* src, const int nx, float* dst)
+{
+  dst[0] = src[0];
+  copy(src, src + nx, dst + 1);
+  dst[nx + 1] = src[nx - 1];
+}
+
+// run 'f(band)' for every band on 'nthreads' threads
+template <class F>
+void
+for_bands(const int nbands, const int nthreads, F f)
+{
+  atomic<int> next(0);
+  auto worker = [&]() {
+    for (int b = next++; b < nbands; b = next++)
+      f(b);
+  };
+  vector<thread> pool;
+  for (int t = 1; t < nthreads; ++t)
+    pool.push_back(thread(worker));
+  worker();
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+}
+
+} // namespace
+
+void
+HillshadeStats::print(FILE* fp, const string& what) const
+{
+  fprintf(fp, "%s: %d bands on %d thread%s: shade %.3f s",
+          what.c_str(), nbands, nthreads, nthreads > 1 ? "s" : "", seconds);
+  if (shadow_seconds > 0)
+    fprintf(fp, " (shadows %.3f s)", shadow_seconds);
+  fprintf(fp, "\n");
+} // HillshadeStats::print
+
+void
+hillshade(const vector<float>& z, const int nx, const int ny,
+          const double cellx, const double celly,
+          const HillshadeParams& p, vector<unsigned char>& gray,
+          HillshadeStats& stats, const int nthreads)
+{
+  hillshade([&](const int y0, const int nrows, float* dst) {
+      const float* src = &z[static_cast<size_t>(y0) * nx];
+      copy(src, src + static_cast<size_t>(nrows) * nx, dst);
+      return true;
+    }, nx, ny, cellx, celly, p, gray, stats, nthreads);
+  if (!p.shadows || p.sun_alt >= 90 || nx < 2 || ny < 2)
+    return;
+
+  // a ray from every cell toward the sun, long enough to leave the
+  // grid; the tree's top node ends it once it clears the highest cell
+  const Clock::time_point t0 = Clock::now();
+  const HeightTree tree(z, nx, ny, nthreads);
+  const double az = p.sun_az * M_PI / 180;
+  const double alt = p.sun_alt * M_PI / 180;
+  const double reach = nx * cellx + ny * celly;
+  const double d[3] = { reach * sin(az) / cellx, -reach * cos(az) / celly,
+                        reach * tan(alt) / p.zfactor };
+  for_bands((ny + BAND_ROWS - 1) / BAND_ROWS, stats.nthreads,
+            [&](const int b) {
+    const int y1 = min(ny, (b + 1) * BAND_ROWS);
+    for (int y = b * BAND_ROWS; y < y1; ++y) {
+      unsigned char* out = &gray[static_cast<size_t>(y) * nx];
+      for (int x = 0; x < nx; ++x) {
+        const double o[3] = { static_cast<double>(x), static_cast<double>(y),
+                              z[static_cast<size_t>(y) * nx + x]
+                                + SHADOW_LIFT };
+        double t;
+        if (tree.intersect(o, d, t))
+          out[x] = static_cast<unsigned char>(out[x] * SHADOW_LIGHT + 0.5f);
+      }
+    }
+  });
+  stats.shadow_seconds = chrono::duration<double>(Clock::now() - t0).count();
+  stats.seconds += stats.shadow_seconds;
+} // hillshade
+
+bool
+hillshade(const RowReader& rows, const int nx, const int ny,
+          const double cellx, const double celly,
+          const HillshadeParams& p, vector<unsigned char>& gray,
+          HillshadeStats& stats, const int nthreads)
+{
+  const Clock::time_point t0 = Clock::now();
+  gray.assign(static_cast<size_t>(nx) * ny, 0);
+  if (nx < 1 || ny < 1)
+    return true;
+
+  const int nbands = (ny + BAND_ROWS - 1) / BAND_ROWS;
+  int nt = nthreads > 0 ? nthreads
+                        : static_cast<int>(thread::hardware_concurrency());
+  nt = max(1, min(nt, nbands));
+
+  // the suns: light vector (lx, ly, lz) and horizontal unit
+  // direction (cx, cy), x east, y north
+  const int nsuns = p.multi ? MAX_SUNS : 1;
+  float lx[MAX_SUNS], ly[MAX_SUNS], lz[MAX_SUNS], cx[MAX_SUNS], cy[MAX_SUNS];
+  for (int k = 0; k < nsuns; ++k) {
+    const double az = (p.sun_az - 45 * (nsuns - 1 - k)) * M_PI / 180;
+    const double alt = p.sun_alt * M_PI / 180;
+    cx[k] = static_cast<float>(sin(az));
+    cy[k] = static_cast<float>(cos(az));
+    lx[k] = static_cast<float>(sin(az) * cos(alt));
+    ly[k] = static_cast<float>(cos(az) * cos(alt));
+    lz[k] = static_cast<float>(sin(alt));
+  }
+
+  // Horn's weights folded into the gradient scale
+  const float kx = static_cast<float>(p.zfactor / (8 * cellx));
+  const float ky = static_cast<float>(p.zfactor / (8 * celly));
+
+  const int R = max(1, p.ao_radius);
+  const float inv_area = 1.0f / ((2 * R + 1) * (2 * R + 1));
+  const float ao_scale
+    = static_cast<float>(p.zfactor / (R * 0.5 * (cellx + celly)));
+
+  // rows a band reads beyond its own: one for the stencil, R (and the
+  // one the running sum looks ahead) for the occlusion
+  const int halo = p.ao ? R + 1 : 1;
+  atomic<bool> failed(false);
+
+  for_bands(nbands, nt, [&](const int b) {
+    const int y0 = b * BAND_ROWS;
+    const int y1 = min(ny, y0 + BAND_ROWS);
+    vector<float> t(nx + 2), m(nx + 2), u(nx + 2);
+    vector<float> ao(nx, 1.0f), shade(nx);
+
+    // the band's rows plus the halo, from the reader; rows outside the
+    // grid repeat its edge rows
+    const int wlo = max(0, y0 - halo);
+    const int whi = min(ny - 1, y1 - 1 + halo);
+    vector<float> wz(static_cast<size_t>(whi - wlo + 1) * nx);
+    if (failed || !rows(wlo, whi - wlo + 1, &wz[0])) {
+      failed = true;
+      return;
+    }
+    auto zrow = [&](const int y) {
+      return &wz[static_cast<size_t>(min(max(y, 0), ny - 1) - wlo) * nx];
+    };
+
+    // ambient occlusion, first pass: horizontal box sums of the rows
+    vector<float> hsum;
+    if (p.ao) {
+      hsum.resize(wz.size());
+      vector<double> prefix(nx + 2 * R + 1, 0);
+      for (int y = wlo; y <= whi; ++y) {
+        const float* row = zrow(y);
+        for (int i = 0; i < nx + 2 * R; ++i) {
+          const int x = min(max(i - R, 0), nx - 1);
+          prefix[i + 1] = prefix[i] + row[x];
+        }
+        float* out = &hsum[static_cast<size_t>(y - wlo) * nx];
+        for (int x = 0; x < nx; ++x)
+          out[x] = static_cast<float>(prefix[x + 2 * R + 1] - prefix[x]);
+      }
+    }
+    auto hrow = [&](const int y) {
+      return &hsum[static_cast<size_t>(min(max(y, 0), ny - 1) - wlo) * nx];
+    };
+
+    // ambient occlusion, second pass: running vertical sums of the
+    // horizontal sums, rows clamped to the grid
+    vector<double> colsum;
+    if (p.ao) {
+      colsum.assign(nx, 0);
+      for (int k = y0 - R; k <= y0 + R; ++k) {
+        const float* h = hrow(k);
+        for (int x = 0; x < nx; ++x)
+          colsum[x] += h[x];
+      }
+    }
+
+    for (int y = y0; y < y1; ++y) {
+      pad_row(zrow(y - 1), nx, &t[0]);
+      pad_row(zrow(y), nx, &m[0]);
+      pad_row(zrow(y + 1), nx, &u[0]);
+      const float* T = &t[0];
+      const float* M = &m[0];
+      const float* U = &u[0];
+      float* S = &shade[0];
+
+      if (nsuns == 1) {
+        const float Lx = lx[0], Ly = ly[0], Lz = lz[0];
+        for (int x = 0; x < nx; ++x) {
+          const float gx = ((T[x + 2] + 2 * M[x + 2] + U[x + 2])
+                            - (T[x] + 2 * M[x] + U[x])) * kx;
+          const float gy = ((T[x] + 2 * T[x + 1] + T[x + 2])
+                            - (U[x] + 2 * U[x + 1] + U[x + 2])) * ky;
+          // unit normal is (-gx, -gy, 1) / sqrt(1 + gx^2 + gy^2)
+          const float s = (Lz - Lx * gx - Ly * gy)
+                          / sqrtf(1 + gx * gx + gy * gy);
+          S[x] = s > 0 ? s : 0;
+        }
+      }
+      else {
+        for (int x = 0; x < nx; ++x) {
+          const float gx = ((T[x + 2] + 2 * M[x + 2] + U[x + 2])
+                            - (T[x] + 2 * M[x] + U[x])) * kx;
+          const float gy = ((T[x] + 2 * T[x + 1] + T[x + 2])
+                            - (U[x] + 2 * U[x + 1] + U[x + 2])) * ky;
+          const float h2 = gx * gx + gy * gy;
+          const float r = 1 / sqrtf(1 + h2);
+          // weight sin^2(aspect - sun azimuth); over four suns 45
+          // degrees apart the weights sum to 2 (flat cells: 0.5 each)
+          const float inv_h2 = 1 / (h2 + 1e-12f);
+          float sum = 0;
+          for (int k = 0; k < MAX_SUNS; ++k) {
+            const float cr = gx * cy[k] - gy * cx[k];
+            const float w = (cr * cr + 0.5e-12f) * inv_h2;
+            float s = (lz[k] - lx[k] * gx - ly[k] * gy) * r;
+            s = s > 0 ? s : 0;
+            sum += w * s;
+          }
+          S[x] = 0.5f * sum;
+        }
+      }
+
+      if (p.ao) {
+        // the neighborhood mean rising above the cell, as a slope over
+        // the radius: 45 degrees halves the light
+        const float* zr = &M[1];
+        for (int x = 0; x < nx; ++x) {
+          const float d = (static_cast<float>(colsum[x]) * inv_area - zr[x])
+                          * ao_scale;
+          ao[x] = 1 / (1 + (d > 0 ? d : 0));
+        }
+        const float* add = hrow(y + R + 1);
+        const float* sub = hrow(y - R);
+        for (int x = 0; x < nx; ++x)
+          colsum[x] += add[x] - sub[x];
+      }
+
+      unsigned char* out = &gray[static_cast<size_t>(y) * nx];
+      for (int x = 0; x < nx; ++x)
+        out[x] = static_cast<unsigned char>(S[x] * ao[x] * 255 + 0.5f);
+    }
+  });
+
+  stats.nthreads = nt;
+  stats.nbands = nbands;
+  stats.seconds = chrono::duration<double>(Clock::now() - t0).count();
+  return !failed;
+} // hillshade
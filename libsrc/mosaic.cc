@@ -0,0 +1,201 @@
+// merged grid of adjacent data sets (see mosaic.h)
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "SafeFormat.h"
+#include "mosaic.h"
+
+using namespace std;
+using namespace Loki;
+
+namespace {
+
+// rows a source reads at a time
+const int BLOCK_ROWS = 16;
+
+// how far (in cells) a source's corner may be from the common grid
+const double GRID_TOLERANCE = 0.01;
+
+// relative difference allowed between cell sizes
+const double CELL_TOLERANCE = 1.0e-6;
+
+bool
+same_size(const double a, const double b)
+{
+  return fabs(a - b) <= CELL_TOLERANCE * fabs(a);
+}
+
+// 'v' as a whole number of cells, or false if it is off the grid
+bool
+grid_offset(const double v, int& cells)
+{
+  const double r = floor(v + 0.5);
+  if (fabs(v - r) > GRID_TOLERANCE)
+    return false;
+  cells = static_cast<int>(r);
+  return true;
+}
+
+} // namespace
+
+const float Mosaic::NODATA = -32767;
+
+Mosaic::Mosaic()
+  : width(0), height(0), next(0), shared(0), max_seam(0)
+{
+  for (int i = 0; i < 6; ++i)
+    gt[i] = 0;
+} // Mosaic::Mosaic
+
+bool
+Mosaic::layout(const vector<GDALDataset*>& sets, const vector<string>& names)
+{
+  if (sets.empty())
+    return false;
+
+  // every source's geotransform and extent
+  vector<double> gts(6 * sets.size());
+  double west(0), east(0), north(0), south(0);
+  for (size_t i = 0; i < sets.size(); ++i) {
+    double* g = &gts[6 * i];
+    if (sets[i]->GetGeoTransform(g) != CE_None) {
+      Printf("ERROR:  No geotransform in '%s'.\n")(names[i]);
+      return false;
+    }
+    if (g[2] != 0 || g[4] != 0) {
+      Printf("ERROR:  '%s' is not north up.\n")(names[i]);
+      return false;
+    }
+    if (i > 0 && !(same_size(g[1], gts[1]) && same_size(g[5], gts[5]))) {
+      Printf("ERROR:  Cell size of '%s' (%g x %g) differs from '%s'"
+             " (%g x %g).\n")
+        (names[i])(g[1])(-g[5])(names[0])(gts[1])(-gts[5]);
+      return false;
+    }
+    const char* wkt0 = sets[0]->GetProjectionRef();
+    const char* wkt = sets[i]->GetProjectionRef();
+    if (strcmp(wkt0 ? wkt0 : "", wkt ? wkt : "") != 0) {
+      Printf("ERROR:  Coordinate system of '%s' differs from '%s'.\n")
+        (names[i])(names[0]);
+      return false;
+    }
+    const double w = g[0];
+    const double e = g[0] + sets[i]->GetRasterXSize() * g[1];
+    const double n = g[3];
+    const double s = g[3] + sets[i]->GetRasterYSize() * g[5];
+    west = i ? min(west, w) : w;
+    east = i ? max(east, e) : e;
+    north = i ? max(north, n) : n;
+    south = i ? min(south, s) : s;
+  }
+
+  const double cellx = gts[1];
+  const double celly = -gts[5];
+  if (!grid_offset((east - west) / cellx, width)
+      || !grid_offset((north - south) / celly, height)) {
+    Printf("ERROR:  The inputs' extents are not whole cells.\n");
+    return false;
+  }
+  gt[0] = west;
+  gt[1] = cellx;
+  gt[3] = north;
+  gt[5] = -celly;
+
+  sources.resize(sets.size());
+  for (size_t i = 0; i < sets.size(); ++i) {
+    const double* g = &gts[6 * i];
+    Source& s = sources[i];
+    s.name = names[i];
+    s.band = sets[i]->GetRasterBand(1);
+    s.nx = sets[i]->GetRasterXSize();
+    s.ny = sets[i]->GetRasterYSize();
+    if (!grid_offset((g[0] - west) / cellx, s.col0)
+        || !grid_offset((north - g[3]) / celly, s.row0)) {
+      Printf("ERROR:  '%s' is not on the same cell grid as '%s'.\n")
+        (names[i])(names[0]);
+      return false;
+    }
+    int has(0);
+    s.nodata = static_cast<float>(s.band->GetNoDataValue(&has));
+    s.has_nodata = has != 0;
+    s.first = 0;
+    s.nrows = 0;
+  }
+
+  sum.resize(width);
+  lo.resize(width);
+  hi.resize(width);
+  count.resize(width);
+  next = 0;
+  return true;
+} // Mosaic::layout
+
+bool
+Mosaic::read_row(float* row)
+{
+  if (next >= height)
+    return false;
+  const int y = next++;
+
+  fill(sum.begin(), sum.end(), 0.0f);
+  fill(count.begin(), count.end(), 0);
+  for (size_t k = 0; k < sources.size(); ++k) {
+    Source& s = sources[k];
+    const int r = y - s.row0;
+    if (r < 0 || r >= s.ny)
+      continue;
+
+    // refill the block when the row moves past it
+    if (r < s.first || r >= s.first + s.nrows) {
+      s.first = r;
+      s.nrows = min(BLOCK_ROWS, s.ny - r);
+      s.block.resize(static_cast<size_t>(s.nx) * s.nrows);
+      if (s.band->RasterIO(GF_Read, 0, s.first, s.nx, s.nrows, &s.block[0],
+                           s.nx, s.nrows, GDT_Float32, 0, 0) != CE_None) {
+        Printf("ERROR:  Unable to read rows of '%s'.\n")(s.name);
+        return false;
+      }
+    }
+
+    const float* src = &s.block[static_cast<size_t>(r - s.first) * s.nx];
+    for (int j = 0; j < s.nx; ++j) {
+      const float v = src[j];
+      if (s.has_nodata && v == s.nodata)
+        continue;
+      const int x = s.col0 + j;
+      if (count[x]) {
+        lo[x] = min(lo[x], v);
+        hi[x] = max(hi[x], v);
+      }
+      else {
+        lo[x] = hi[x] = v;
+      }
+      sum[x] += v;
+      ++count[x];
+    }
+  }
+
+  for (int x = 0; x < width; ++x) {
+    if (!count[x]) {
+      row[x] = NODATA;
+      continue;
+    }
+    row[x] = sum[x] / count[x];
+    if (count[x] > 1) {
+      ++shared;
+      max_seam = max(max_seam, static_cast<double>(hi[x] - lo[x]));
+    }
+  }
+  return true;
+} // Mosaic::read_row
+
+void
+Mosaic::print(FILE* fp) const
+{
+  fprintf(fp, "mosaic: %d sources, %dx%d cells from (%.3f,%.3f), %d rows"
+          " read;\n  %lld shared cells, largest seam difference %g\n",
+          static_cast<int>(sources.size()), width, height, gt[0], gt[3],
+          next, shared, max_seam);
+} // Mosaic::print
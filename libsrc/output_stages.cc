@@ -0,0 +1,613 @@
+// output stages for '--name=X' (see output_stages.h)
+
+#include <cstdio>
+#include <cstdlib>  // strtol
+#include <unistd.h> // unlink
+#include <algorithm>
+
+#include "SafeFormat.h"
+#include "output_stages.h"
+#include "g_database.h"
+#include "rt_render.h"
+#include "png_writer.h"
+#include "pipeline.h"
+#include "bot_mesh.h"
+
+using namespace std;
+using namespace Loki;
+
+OutputFiles::OutputFiles(const string& base, const int size)
+  : basename(base),
+    asc(base + ".asc"),
+    info(base + ".info"),
+    dsp(base + ".dsp"),
+    mged(base + ".mged"),
+    g(base + ".g"),
+    solid(base + ".s"),
+    region(base + ".r"),
+    comb(base + ".c"),
+    hillshade(base + "-hillshade.png"),
+    bot_g(base + "-bot.g"),
+    bot_solid(base + "-bot.s"),
+    bot_region(base + "-bot.r"),
+    los(base + "-los.txt"),
+    nx(0), ny(0), scalex(0), scaley(0), scalez(0),
+    pixsize(size),
+    png_level(Z_DEFAULT_COMPRESSION), keep_pix(false), stream(false),
+    preview(PREVIEW_RT), bot_error(0), los_bench(0), threads(0)
+{
+} // OutputFiles::OutputFiles
+
+void
+OutputFiles::add_view(const double az, const double el)
+{
+  OutputView v;
+  v.az = az;
+  v.el = el;
+  SPrintf(v.pix, "%s-az%g-el%g.pix")(basename)(az)(el);
+  SPrintf(v.png, "%s-az%g-el%g.png")(basename)(az)(el);
+  views.push_back(v);
+} // OutputFiles::add_view
+
+vector<string>
+OutputFiles::list() const
+{
+  vector<string> fils;
+  if (!stream)
+    fils.push_back(asc);
+  fils.push_back(info);
+  if (!tiles.empty()) {
+    for (size_t i = 0; i < tiles.size(); ++i)
+      fils.push_back(tiles[i].dsp);
+  }
+  else {
+    fils.push_back(dsp);
+  }
+  for (size_t i = 0; i < lods.size(); ++i)
+    fils.push_back(lods[i].dsp);
+  fils.push_back(mged);
+  fils.push_back(g);
+  if (bot_error > 0)
+    fils.push_back(bot_g);
+  if (!sightlines.empty() || los_bench)
+    fils.push_back(los);
+  if (preview == PREVIEW_HILLSHADE) {
+    fils.push_back(hillshade);
+    return fils;
+  }
+  for (size_t i = 0; i < views.size(); ++i) {
+    if (keep_pix)
+      fils.push_back(views[i].pix);
+    fils.push_back(views[i].png);
+  }
+  return fils;
+} // OutputFiles::list
+
+bool
+write_info_file(const OutputFiles& o)
+{
+  FILE* fp = fopen(o.info.c_str(), "w");
+  if (!fp)
+    return false;
+  fprintf(fp, "pixels: %d wide X %d high; scale: %g m X %g m X %g m\n",
+          o.nx, o.ny, o.scalex, o.scaley, o.scalez);
+  return fclose(fp) == 0;
+} // write_info_file
+
+bool
+write_dsp(const OutputFiles& o)
+{
+  // the south row first, through a pipe instead of X-reversed.asc
+  vector<Argv> cmds;
+  cmds.push_back(Argv{"tac", o.asc});
+  cmds.push_back(Argv{"asc2dsp", "/dev/stdin", o.dsp});
+  Pipeline tools;
+  const bool started = tools.start(cmds);
+  // tac reads X.asc, not the pipeline's input
+  return tools.finish() && started;
+} // write_dsp
+
+bool
+write_tiles(const OutputFiles& o)
+{
+  for (size_t i = 0; i < o.tiles.size(); ++i)
+    unlink(o.tiles[i].dsp.c_str());
+  return write_dsp_tiles(o.tiles, o.tile_cells, o.threads);
+} // write_tiles
+
+bool
+write_mged_script(const OutputFiles& o)
+{
+  FILE* fp = fopen(o.mged.c_str(), "w");
+  if (!fp)
+    return false;
+  FPrintf(fp, "units m\n");
+  if (o.tiles.empty()) {
+    FPrintf(fp,
+            "in %s dsp f %s %d %d 0 ad %.10g %.10g\n"
+            "r %s u %s\n"
+            )
+      (o.solid)(o.dsp)(o.nx)(o.ny)(o.scalex)(o.scalez)
+      (o.region)(o.solid)
+      ;
+  }
+
+  // each tile's solid moved to its place, all in one combination
+  for (size_t i = 0; i < o.tiles.size(); ++i) {
+    const DspTile& t = o.tiles[i];
+    FPrintf(fp,
+            "in %s dsp f %s %d %d 0 ad %.10g %.10g\n"
+            "sed %s\n"
+            "translate %.10g %.10g 0\n"
+            "accept\n"
+            )
+      (t.solid)(t.dsp)(t.nx)(t.ny)(o.scalex)(o.scalez)
+      (t.solid)
+      (t.x0 * o.scalex)((o.ny - t.y0 - t.ny) * o.scaley)
+      ;
+  }
+  if (!o.tiles.empty()) {
+    FPrintf(fp, "comb %s u")(o.comb);
+    for (size_t i = 0; i < o.tiles.size(); ++i)
+      FPrintf(fp, " %s%s")(i ? "u " : "")(o.tiles[i].solid);
+    FPrintf(fp, "\nr %s u %s\n")(o.region)(o.comb);
+  }
+
+  // the coarser levels, their cells 2^k times as far apart
+  for (size_t i = 0; i < o.lods.size(); ++i) {
+    const PyramidLevel& l = o.lods[i];
+    FPrintf(fp,
+            "in %s dsp f %s %d %d 0 ad %.10g %.10g\n"
+            "r %s u %s\n"
+            )
+      (l.solid)(l.dsp)(l.nx)(l.ny)(o.scalex * l.factor)(o.scalez)
+      (l.region)(l.solid)
+      ;
+  }
+  return fclose(fp) == 0;
+} // write_mged_script
+
+bool
+write_g(const OutputFiles& o)
+{
+  // the same objects the mged script makes, written directly
+  unlink(o.g.c_str());
+  GDatabase db;
+  if (!db.open(o.g, o.basename))
+    return false;
+  bool ok(true);
+  if (o.tiles.empty()) {
+    ok = db.add_dsp(o.solid, o.dsp, o.nx, o.ny, o.scalex, o.scalez)
+      && db.add_region(o.region, o.solid);
+  }
+
+  vector<string> solids;
+  for (size_t i = 0; i < o.tiles.size() && ok; ++i) {
+    const DspTile& t = o.tiles[i];
+    const double origin[3] = {
+      static_cast<double>(t.x0) * o.scalex,
+      static_cast<double>(o.ny - t.y0 - t.ny) * o.scaley,
+      0
+    };
+    ok = db.add_dsp(t.solid, t.dsp, t.nx, t.ny, o.scalex, o.scalez,
+                    origin);
+    solids.push_back(t.solid);
+  }
+  if (!o.tiles.empty()) {
+    ok = ok && db.add_comb(o.comb, solids, false)
+            && db.add_region(o.region, o.comb);
+  }
+
+  for (size_t i = 0; i < o.lods.size() && ok; ++i) {
+    const PyramidLevel& l = o.lods[i];
+    ok = db.add_dsp(l.solid, l.dsp, l.nx, l.ny,
+                    o.scalex * l.factor, o.scalez)
+      && db.add_region(l.region, l.solid);
+  }
+  return db.close() && ok;
+} // write_g
+
+bool
+render_png(const OutputFiles& o)
+{
+  // ray trace in-process (see rt_render.h) and encode the rows as
+  // they finish; no rt, no pix-png, no .pix unless asked for
+  const size_t n = o.views.size();
+  for (size_t i = 0; i < n; ++i) {
+    unlink(o.views[i].png.c_str());
+    unlink(o.views[i].pix.c_str());
+  }
+  if (!n)
+    return true;
+
+  RtScene scene;
+  if (!scene.load(o.g, vector<string>(1, o.region), o.threads)) {
+    Printf("ERROR:  Unable to load '%s' from '%s'.\n")(o.region)(o.g);
+    return false;
+  }
+
+  // all views from the one prepped scene, in one batch
+  vector<PngWriter> pngs(n);
+  vector<Framebuffer> fbs(n);
+  vector<RenderView> views;
+  for (size_t i = 0; i < n; ++i) {
+    const OutputView& v = o.views[i];
+    if (!pngs[i].open(v.png, o.pixsize, o.pixsize, o.png_level)) {
+      Printf("ERROR:  Unable to open '%s'.\n")(v.png);
+      return false;
+    }
+    PngWriter* png = &pngs[i];
+    views.push_back(RenderView(v.az, v.el, o.pixsize, &fbs[i],
+                               [png](const unsigned char* row) {
+                                 return png->write_row(row);
+                               }));
+  }
+
+  RenderStats stats;
+  bool ok = scene.render(views, stats);
+  for (size_t i = 0; i < n; ++i)
+    ok = pngs[i].close() && ok;
+  if (!ok)
+    return false;
+
+  string what;
+  if (n > 1)
+    SPrintf(what, "%d views")(static_cast<int>(n));
+  else
+    what = o.views[0].png;
+  stats.print(stdout, what);
+
+  for (size_t i = 0; i < n && o.keep_pix; ++i)
+    if (!fbs[i].write_pix(o.views[i].pix))
+      return false;
+  return true;
+} // render_png
+
+namespace {
+
+// read the nx by ny cells of X.asc (see write_row())
+bool
+read_asc(const OutputFiles& o, vector<float>& z)
+{
+  FILE* fp = fopen(o.asc.c_str(), "rb");
+  if (!fp)
+    return false;
+  vector<char> text;
+  char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    text.insert(text.end(), buf, buf + n);
+  fclose(fp);
+  text.push_back('\0');
+
+  const size_t ncells = static_cast<size_t>(o.nx) * o.ny;
+  z.resize(ncells);
+  const char* p = &text[0];
+  for (size_t i = 0; i < ncells; ++i) {
+    char* end;
+    const long v = strtol(p, &end, 10);
+    if (end == p)
+      return false;
+    z[i] = static_cast<float>(v);
+    p = end;
+  }
+  return true;
+}
+
+// All cells, from 'grid' or X.asc, for the stage writing 'what': the
+// mesher and the quadtree work on the whole grid at once, so unlike
+// the hillshade these stages hold all of it in memory even when they
+// read through the tile cache.  The cache is read a band of rows at a
+// time so it sees a top-down scan to prefetch for.
+bool
+load_grid(const OutputFiles& o, const string& what, vector<float>& z)
+{
+  if (o.grid) {
+    const int BAND_ROWS = 256;
+    z.resize(static_cast<size_t>(o.nx) * o.ny);
+    for (int y = 0; y < o.ny; y += BAND_ROWS) {
+      const int n = min(BAND_ROWS, o.ny - y);
+      if (!o.grid(y, n, &z[static_cast<size_t>(y) * o.nx])) {
+        Printf("ERROR:  Unable to read the cells for '%s'.\n")(what);
+        return false;
+      }
+    }
+  }
+  else if (!read_asc(o, z)) {
+    Printf("ERROR:  Unable to read %d x %d cells from '%s'.\n")
+      (o.nx)(o.ny)(o.asc);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool
+render_hillshade(const OutputFiles& o)
+{
+  unlink(o.hillshade.c_str());
+  vector<unsigned char> gray;
+  HillshadeStats stats;
+  if (o.grid) {
+    if (!hillshade(o.grid, o.nx, o.ny, o.scalex, o.scaley, o.shade, gray,
+                   stats, o.threads)) {
+      Printf("ERROR:  Unable to read the cells for '%s'.\n")(o.hillshade);
+      return false;
+    }
+  }
+  else {
+    vector<float> z;
+    if (!read_asc(o, z)) {
+      Printf("ERROR:  Unable to read %d x %d cells from '%s'.\n")
+        (o.nx)(o.ny)(o.asc);
+      return false;
+    }
+    hillshade(z, o.nx, o.ny, o.scalex, o.scaley, o.shade, gray, stats,
+              o.threads);
+  }
+  stats.print(stdout, o.hillshade);
+
+  PngWriter png;
+  if (!png.open(o.hillshade, o.nx, o.ny, o.png_level, 1)) {
+    Printf("ERROR:  Unable to open '%s'.\n")(o.hillshade);
+    return false;
+  }
+  for (int y = 0; y < o.ny; ++y)
+    png.write_row(&gray[static_cast<size_t>(y) * o.nx]);
+  return png.close();
+} // render_hillshade
+
+bool
+write_bot(const OutputFiles& o)
+{
+  unlink(o.bot_g.c_str());
+  vector<float> z;
+  if (!load_grid(o, o.bot_g, z))
+    return false;
+  if (o.nx < 2 || o.ny < 2) {
+    Printf("ERROR:  A %d x %d grid has no cells to mesh for '%s'.\n")
+      (o.nx)(o.ny)(o.bot_g);
+    return false;
+  }
+
+  BotMesh mesh(z, o.nx, o.ny, o.scalex, o.scaley, o.scalez, o.threads);
+  vector<double> vertices;
+  vector<int> faces;
+  mesh.extract(o.bot_error, vertices, faces);
+  mesh.print(stdout, o.bot_g, o.bot_error);
+
+  GDatabase db;
+  if (!db.open(o.bot_g, o.basename))
+    return false;
+  const bool ok = db.add_bot(o.bot_solid, vertices, faces)
+    && db.add_region(o.bot_region, o.bot_solid);
+  return db.close() && ok;
+} // write_bot
+
+bool
+write_los(const OutputFiles& o)
+{
+  unlink(o.los.c_str());
+  vector<float> z;
+  if (!load_grid(o, o.los, z))
+    return false;
+  FILE* fp = fopen(o.los.c_str(), "w");
+  if (!fp) {
+    Printf("ERROR:  Unable to open '%s'.\n")(o.los);
+    return false;
+  }
+  sightlines(z, o.nx, o.ny, o.scalex, o.scaley, o.scalez, o.sightlines,
+             o.los_bench, fp, stdout, o.los, o.threads);
+  return fclose(fp) == 0;
+} // write_los
+
+OutputTasks
+add_output_stages(TaskGraph& graph, const OutputFiles& o, const int asc)
+{
+  // the graph outlives this call, 'o' must too: capture by reference
+  OutputTasks t;
+  t.asc = asc;
+  t.info = graph.add("info", [&o]() { return write_info_file(o); });
+  t.script = graph.add("mged-script", [&o]() { return write_mged_script(o); });
+
+  if (!o.tiles.empty()) {
+    // read from the data set, not from X.asc
+    t.dsp = graph.add("tiles", [&o]() { return write_tiles(o); });
+  }
+  else if (o.stream) {
+    // the conversion writes X.dsp itself
+    t.dsp = t.asc;
+  }
+  else {
+    t.dsp = graph.add("dsp", [&o]() { return write_dsp(o); },
+                      vector<int>(1, t.asc));
+  }
+
+  // the .g only refers to the DSP file by name; rt reads it
+  t.g = graph.add("g", [&o]() { return write_g(o); });
+
+  t.png = t.hillshade = -1;
+  if (o.preview == OutputFiles::PREVIEW_HILLSHADE) {
+    // reading through the tile cache it doesn't need X.asc
+    t.hillshade = graph.add("hillshade",
+                            [&o]() { return render_hillshade(o); },
+                            o.grid ? vector<int>() : vector<int>(1, t.asc));
+  }
+  else {
+    vector<int> pngdeps;
+    pngdeps.push_back(t.g);
+    pngdeps.push_back(t.dsp);
+    t.png = graph.add("png", [&o]() { return render_png(o); }, pngdeps);
+  }
+
+  t.bot = -1;
+  if (o.bot_error > 0)
+    t.bot = graph.add("bot", [&o]() { return write_bot(o); },
+                      o.grid ? vector<int>() : vector<int>(1, t.asc));
+
+  t.los = -1;
+  if (!o.sightlines.empty() || o.los_bench)
+    t.los = graph.add("los", [&o]() { return write_los(o); },
+                      o.grid ? vector<int>() : vector<int>(1, t.asc));
+  return t;
+} // add_output_stages
+
+namespace {
+
+struct StageKey {
+  int         task;
+  std::string artifact;
+  Hash        key;
+
+  StageKey(const int t, const string& a, const Hash k)
+    : task(t), artifact(a), key(k)
+  {}
+};
+
+// the key of every stage: its own option values chained with the keys
+// of the stages it reads from
+vector<StageKey>
+stage_keys(const OutputTasks& t, const OutputFiles& o, const Hash input)
+{
+  const Hash asc = hash_string("asc", input);
+
+  Hash info = hash_string("info");
+  info = hash_int(o.nx, info);
+  info = hash_int(o.ny, info);
+  info = hash_bytes(&o.scalex, sizeof(o.scalex), info);
+  info = hash_bytes(&o.scaley, sizeof(o.scaley), info);
+  info = hash_bytes(&o.scalez, sizeof(o.scalez), info);
+
+  Hash script = hash_string("mged-script");
+  script = hash_string(o.solid, script);
+  script = hash_string(o.region, script);
+  script = hash_string(o.dsp, script);
+  script = hash_int(o.nx, script);
+  script = hash_int(o.ny, script);
+  script = hash_bytes(&o.scalex, sizeof(o.scalex), script);
+  script = hash_bytes(&o.scalez, sizeof(o.scalez), script);
+  for (size_t i = 0; i < o.tiles.size(); ++i) {
+    script = hash_string(o.tiles[i].dsp, script);
+    script = hash_int(o.tiles[i].x0, script);
+    script = hash_int(o.tiles[i].y0, script);
+    script = hash_int(o.tiles[i].nx, script);
+    script = hash_int(o.tiles[i].ny, script);
+  }
+  for (size_t i = 0; i < o.lods.size(); ++i) {
+    script = hash_string(o.lods[i].dsp, script);
+    script = hash_int(o.lods[i].factor, script);
+    script = hash_int(o.lods[i].nx, script);
+    script = hash_int(o.lods[i].ny, script);
+  }
+
+  // the tiles are cut from the same values the conversion writes, as
+  // the script lays them out
+  const Hash dsp = o.tiles.empty() ? hash_string("dsp", asc)
+                                   : hash_int(script,
+                                              hash_string("tiles", asc));
+  // the .g holds the same values as the script
+  const Hash g = hash_string("g", script);
+
+  Hash png = hash_int(dsp, hash_string("png", g));
+  png = hash_int(o.pixsize, png);
+  png = hash_int(o.png_level, png);
+
+  vector<StageKey> keys;
+  if (!o.tiles.empty()) {
+    if (!o.stream)
+      keys.push_back(StageKey(t.asc, o.asc, asc));
+    for (size_t i = 0; i < o.tiles.size(); ++i)
+      keys.push_back(StageKey(t.dsp, o.tiles[i].dsp,
+                              hash_int(static_cast<long long>(i), dsp)));
+  }
+  else if (o.stream) {
+    // one task makes the DSP, nothing in between is kept
+    keys.push_back(StageKey(t.dsp, o.dsp, dsp));
+  }
+  else {
+    keys.push_back(StageKey(t.asc, o.asc, asc));
+    keys.push_back(StageKey(t.dsp, o.dsp, dsp));
+  }
+  // the levels come from the same rows as X.asc
+  for (size_t i = 0; i < o.lods.size(); ++i)
+    keys.push_back(StageKey(t.asc, o.lods[i].dsp,
+                            hash_int(o.lods[i].factor,
+                                     hash_string("pyramid", asc))));
+  keys.push_back(StageKey(t.info, o.info, info));
+  keys.push_back(StageKey(t.script, o.mged, script));
+  keys.push_back(StageKey(t.g, o.g, g));
+  if (t.hillshade >= 0) {
+    const HillshadeParams& p = o.shade;
+    Hash shade = hash_string("hillshade", asc);
+    shade = hash_bytes(&p.sun_az, sizeof(p.sun_az), shade);
+    shade = hash_bytes(&p.sun_alt, sizeof(p.sun_alt), shade);
+    shade = hash_bytes(&p.zfactor, sizeof(p.zfactor), shade);
+    shade = hash_int(p.multi, shade);
+    shade = hash_int(p.ao ? p.ao_radius : 0, shade);
+    if (p.shadows)
+      shade = hash_string("shadows", shade);
+    shade = hash_bytes(&o.scalex, sizeof(o.scalex), shade);
+    shade = hash_bytes(&o.scaley, sizeof(o.scaley), shade);
+    shade = hash_int(o.png_level, shade);
+    keys.push_back(StageKey(t.hillshade, o.hillshade, shade));
+  }
+  if (t.bot >= 0) {
+    Hash bot = hash_string("bot", asc);
+    bot = hash_bytes(&o.bot_error, sizeof(o.bot_error), bot);
+    bot = hash_bytes(&o.scalex, sizeof(o.scalex), bot);
+    bot = hash_bytes(&o.scaley, sizeof(o.scaley), bot);
+    bot = hash_bytes(&o.scalez, sizeof(o.scalez), bot);
+    keys.push_back(StageKey(t.bot, o.bot_g, bot));
+  }
+  if (t.los >= 0) {
+    Hash los = hash_string("los", asc);
+    los = hash_bytes(o.sightlines.data(),
+                     o.sightlines.size() * sizeof(Sightline), los);
+    los = hash_int(o.los_bench, los);
+    los = hash_bytes(&o.scalex, sizeof(o.scalex), los);
+    los = hash_bytes(&o.scaley, sizeof(o.scaley), los);
+    los = hash_bytes(&o.scalez, sizeof(o.scalez), los);
+    keys.push_back(StageKey(t.los, o.los, los));
+  }
+  for (size_t i = 0; t.png >= 0 && i < o.views.size(); ++i) {
+    const OutputView& v = o.views[i];
+    Hash view = hash_bytes(&v.az, sizeof(v.az), png);
+    view = hash_bytes(&v.el, sizeof(v.el), view);
+    keys.push_back(StageKey(t.png, v.png, view));
+    if (o.keep_pix)
+      keys.push_back(StageKey(t.png, v.pix, view));
+  }
+  return keys;
+} // stage_keys
+
+} // namespace
+
+void
+mark_up_to_date(TaskGraph& graph, const OutputTasks& t, const OutputFiles& o,
+                const BuildManifest& m, const Hash input)
+{
+  // a stage is cached only if all of its artifacts are up to date
+  vector<StageKey> keys(stage_keys(t, o, input));
+  vector<bool> stale(graph.size(), false);
+  for (size_t i = 0; i < keys.size(); ++i)
+    if (!m.up_to_date(keys[i].artifact, keys[i].key))
+      stale[keys[i].task] = true;
+  for (size_t i = 0; i < keys.size(); ++i)
+    if (!stale[keys[i].task])
+      graph.mark_cached(keys[i].task);
+} // mark_up_to_date
+
+void
+update_manifest(const TaskGraph& graph, const OutputTasks& t,
+                const OutputFiles& o, BuildManifest& m, const Hash input)
+{
+  vector<StageKey> keys(stage_keys(t, o, input));
+  for (size_t i = 0; i < keys.size(); ++i) {
+    TaskGraph::State s = graph.state(keys[i].task);
+    if (s == TaskGraph::DONE || s == TaskGraph::CACHED)
+      m.record(keys[i].artifact, keys[i].key);
+    else
+      m.forget(keys[i].artifact);
+  }
+} // update_manifest
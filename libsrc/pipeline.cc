@@ -0,0 +1,162 @@
+// external tools without a shell (see pipeline.h)
+
+#include <cerrno>
+#include <csignal>
+#include <mutex>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "pipeline.h"
+
+extern char** environ;
+
+using namespace std;
+
+namespace {
+
+// Children must inherit only the descriptors dup2()ed onto their
+// stdin/stdout: everything made here is close-on-exec, and pipes are
+// created and marked under the same lock the spawns take, so a stage
+// spawning on another thread never inherits a pipe end (which would
+// keep the reader from ever seeing end of file).
+mutex&
+spawn_lock()
+{
+  static mutex m;
+  return m;
+}
+
+bool
+cloexec_pipe(int fds[2])
+{
+  if (pipe(fds) != 0)
+    return false;
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  return true;
+}
+
+int
+open_output(const string& fname)
+{
+  int fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd >= 0)
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+// start 'argv' with 'infd'/'outfd' (if >= 0) as its stdin/stdout;
+// returns the pid, or -1
+pid_t
+spawn(const Argv& argv, const int infd, const int outfd)
+{
+  if (argv.empty())
+    return -1;
+  vector<char*> av;
+  for (size_t i = 0; i < argv.size(); ++i)
+    av.push_back(const_cast<char*>(argv[i].c_str()));
+  av.push_back(0);
+
+  posix_spawn_file_actions_t fa;
+  posix_spawn_file_actions_init(&fa);
+  if (infd >= 0)
+    posix_spawn_file_actions_adddup2(&fa, infd, 0);
+  if (outfd >= 0)
+    posix_spawn_file_actions_adddup2(&fa, outfd, 1);
+
+  pid_t pid;
+  int rc = posix_spawnp(&pid, av[0], &fa, 0, &av[0], environ);
+  posix_spawn_file_actions_destroy(&fa);
+  return rc == 0 ? pid : -1;
+}
+
+bool
+wait_ok(const pid_t pid)
+{
+  int status;
+  while (waitpid(pid, &status, 0) < 0)
+    if (errno != EINTR)
+      return false;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace
+
+Pipeline::Pipeline()
+  : in(0)
+{
+} // Pipeline::Pipeline
+
+Pipeline::~Pipeline()
+{
+  finish();
+} // Pipeline::~Pipeline
+
+bool
+Pipeline::start(const vector<Argv>& cmds, const string& outfile)
+{
+  if (in || !pids.empty() || cmds.empty())
+    return false;
+
+  // a reader that dies early must show up as a failed write (and a
+  // failed finish()), not kill the whole program
+  signal(SIGPIPE, SIG_IGN);
+
+  lock_guard<mutex> lock(spawn_lock());
+  int head[2];
+  if (!cloexec_pipe(head))
+    return false;
+  in = fdopen(head[1], "w");
+  if (!in) {
+    close(head[0]);
+    close(head[1]);
+    return false;
+  }
+
+  // each command reads what the one before it writes
+  int infd = head[0];
+  bool ok = true;
+  for (size_t i = 0; i < cmds.size() && ok; ++i) {
+    int outfd = -1;
+    int next[2] = { -1, -1 };
+    if (i + 1 < cmds.size()) {
+      ok = cloexec_pipe(next);
+      outfd = next[1];
+    }
+    else if (!outfile.empty()) {
+      outfd = open_output(outfile);
+      ok = outfd >= 0;
+    }
+    if (ok) {
+      pid_t pid = spawn(cmds[i], infd, outfd);
+      ok = pid > 0;
+      if (ok)
+        pids.push_back(pid);
+    }
+    // the children hold their own copies now
+    close(infd);
+    if (outfd >= 0)
+      close(outfd);
+    infd = next[0];
+  }
+  if (infd >= 0)
+    close(infd);
+  return ok;
+} // Pipeline::start
+
+bool
+Pipeline::finish()
+{
+  bool ok = true;
+  if (in) {
+    ok = fclose(in) == 0;
+    in = 0;
+  }
+  for (size_t i = 0; i < pids.size(); ++i)
+    ok = wait_ok(pids[i]) && ok;
+  pids.clear();
+  return ok;
+} // Pipeline::finish
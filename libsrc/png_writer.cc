@@ -0,0 +1,167 @@
+// streaming PNG encoder (see png_writer.h)
+
+#include <cstring>
+
+#include "png_writer.h"
+
+using namespace std;
+
+namespace {
+
+// IDAT payload size
+const size_t CHUNK_BYTES = 1 << 16;
+
+void
+put_u32(unsigned char* p, const unsigned long v)
+{
+  p[0] = static_cast<unsigned char>(v >> 24);
+  p[1] = static_cast<unsigned char>(v >> 16);
+  p[2] = static_cast<unsigned char>(v >> 8);
+  p[3] = static_cast<unsigned char>(v);
+}
+
+} // namespace
+
+PngWriter::PngWriter()
+  : fp(0), zinit(false), ok(false), width(0), height(0), channels(0),
+    rows(0)
+{
+  memset(&zs, 0, sizeof(zs));
+} // PngWriter::PngWriter
+
+PngWriter::~PngWriter()
+{
+  if (zinit)
+    deflateEnd(&zs);
+  if (fp)
+    fclose(fp);
+} // PngWriter::~PngWriter
+
+bool
+PngWriter::open(const string& fname, const int w, const int h,
+                const int level, const int nc)
+{
+  if (fp || w < 1 || h < 1 || (nc != 1 && nc != 3))
+    return false;
+  fp = fopen(fname.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  width = w;
+  height = h;
+  channels = nc;
+  rows = 0;
+  line.assign(1 + static_cast<size_t>(w) * nc, 0);
+  out.resize(CHUNK_BYTES);
+
+  if (deflateInit(&zs, level) != Z_OK)
+    return false;
+  zinit = true;
+  zs.next_out = &out[0];
+  zs.avail_out = static_cast<uInt>(out.size());
+
+  static const unsigned char sig[8] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+  };
+  ok = fwrite(sig, 1, sizeof(sig), fp) == sizeof(sig);
+
+  // IHDR: size, 8 bits per sample, RGB or gray, deflate, adaptive
+  // filters, no interlace
+  unsigned char ihdr[13];
+  put_u32(ihdr, w);
+  put_u32(ihdr + 4, h);
+  ihdr[8] = 8;
+  ihdr[9] = channels == 3 ? 2 : 0;
+  ihdr[10] = 0;
+  ihdr[11] = 0;
+  ihdr[12] = 0;
+  ok = ok && write_chunk("IHDR", ihdr, sizeof(ihdr));
+  return ok;
+} // PngWriter::open
+
+bool
+PngWriter::write_row(const unsigned char* rgb)
+{
+  if (!ok || rows >= height)
+    return ok = false;
+
+  // "Sub" filter: each byte minus the same channel one pixel left
+  unsigned char* f = &line[0];
+  const int n = width * channels;
+  f[0] = 1;
+  memcpy(f + 1, rgb, channels);
+  for (int i = channels; i < n; ++i)
+    f[1 + i] = static_cast<unsigned char>(rgb[i] - rgb[i - channels]);
+
+  zs.next_in = f;
+  zs.avail_in = static_cast<uInt>(line.size());
+  ++rows;
+  return deflate_buf(Z_NO_FLUSH);
+} // PngWriter::write_row
+
+bool
+PngWriter::close()
+{
+  if (!fp)
+    return false;
+  if (ok && rows != height)
+    ok = false;
+  if (ok)
+    ok = deflate_buf(Z_FINISH);
+  if (ok)
+    ok = write_chunk("IEND", 0, 0);
+  if (zinit) {
+    deflateEnd(&zs);
+    zinit = false;
+  }
+  if (fclose(fp) != 0)
+    ok = false;
+  fp = 0;
+  return ok;
+} // PngWriter::close
+
+bool
+PngWriter::deflate_buf(const int flush)
+{
+  for (;;) {
+    int ret = deflate(&zs, flush);
+    if (ret == Z_STREAM_ERROR)
+      return ok = false;
+    if (zs.avail_out == 0 || (flush == Z_FINISH && ret == Z_STREAM_END)) {
+      const size_t n = out.size() - zs.avail_out;
+      if (n && !write_chunk("IDAT", &out[0], n))
+        return false;
+      zs.next_out = &out[0];
+      zs.avail_out = static_cast<uInt>(out.size());
+    }
+    if (flush == Z_FINISH) {
+      if (ret == Z_STREAM_END)
+        return true;
+    }
+    else if (zs.avail_in == 0 && zs.avail_out != 0) {
+      return true;
+    }
+  }
+} // PngWriter::deflate_buf
+
+bool
+PngWriter::write_chunk(const char* type, const unsigned char* data,
+                       const size_t n)
+{
+  unsigned char hdr[8];
+  put_u32(hdr, static_cast<unsigned long>(n));
+  memcpy(hdr + 4, type, 4);
+
+  uLong crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, hdr + 4, 4);
+  if (n)
+    crc = crc32(crc, data, static_cast<uInt>(n));
+  unsigned char tail[4];
+  put_u32(tail, crc);
+
+  ok = ok
+    && fwrite(hdr, 1, 8, fp) == 8
+    && (!n || fwrite(data, 1, n, fp) == n)
+    && fwrite(tail, 1, 4, fp) == 4;
+  return ok;
+} // PngWriter::write_chunk
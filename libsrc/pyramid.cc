@@ -0,0 +1,114 @@
+// reduced-resolution DSP levels (see pyramid.h)
+
+#include <algorithm>
+
+#include "SafeFormat.h"
+#include "pyramid.h"
+#include "dsp_tiles.h"
+
+using namespace std;
+using namespace Loki;
+
+vector<PyramidLevel>
+layout_pyramid(const string& base, const int nx, const int ny,
+               const int levels)
+{
+  vector<PyramidLevel> lods;
+  int w = nx;
+  int h = ny;
+  for (int k = 1; k <= levels; ++k) {
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+    if (w < 2 || h < 2)
+      break;
+    PyramidLevel l;
+    l.factor = 1 << k;
+    l.nx = w;
+    l.ny = h;
+    string name;
+    SPrintf(name, "%s-lod%d")(base)(k);
+    l.dsp = name + ".dsp";
+    l.solid = name + ".s";
+    l.region = name + ".r";
+    lods.push_back(l);
+  }
+  return lods;
+} // layout_pyramid
+
+Pyramid::Pyramid(const int nx, const vector<PyramidLevel>& lods)
+  : levels(lods.size())
+{
+  int width = nx;
+  for (size_t k = 0; k < lods.size(); ++k) {
+    Level& l = levels[k];
+    l.info = &lods[k];
+    l.width = width;
+    // an even width, the odd last cell repeated
+    l.pending.resize(width + (width & 1));
+    l.sum.resize(l.pending.size());
+    l.have = false;
+    l.cells.resize(static_cast<size_t>(lods[k].nx) * lods[k].ny);
+    l.rows = 0;
+    width = lods[k].nx;
+  }
+} // Pyramid::Pyramid
+
+void
+Pyramid::add_row(const int* row)
+{
+  if (!levels.empty())
+    push(0, row);
+} // Pyramid::add_row
+
+void
+Pyramid::push(const size_t k, const int* row)
+{
+  Level& l = levels[k];
+  const int n = static_cast<int>(l.sum.size());
+  if (!l.have) {
+    copy(row, row + l.width, l.pending.begin());
+    l.pending[n - 1] = row[l.width - 1];
+    l.have = true;
+    return;
+  }
+  l.have = false;
+
+  // the pair's vertical sums, then the mean of each pair of them
+  // (the bounds in locals: stores through 's' might alias members)
+  const int w = l.width;
+  const int nout = n / 2;
+  int* s = &l.sum[0];
+  const int* a = &l.pending[0];
+  for (int i = 0; i < w; ++i)
+    s[i] = a[i] + row[i];
+  s[n - 1] = a[n - 1] + row[w - 1];
+  int* out = &l.cells[static_cast<size_t>(l.rows) * l.info->nx];
+  for (int i = 0; i < nout; ++i)
+    out[i] = (s[2 * i] + s[2 * i + 1] + 2) >> 2;
+  ++l.rows;
+
+  if (k + 1 < levels.size())
+    push(k + 1, out);
+} // Pyramid::push
+
+bool
+Pyramid::write()
+{
+  // an odd last row pairs with itself, level by level (a flush may
+  // complete a row of the next level)
+  for (size_t k = 0; k < levels.size(); ++k) {
+    Level& l = levels[k];
+    if (l.have) {
+      const vector<int> last(l.pending);
+      push(k, &last[0]);
+    }
+  }
+  for (size_t k = 0; k < levels.size(); ++k) {
+    const Level& l = levels[k];
+    if (!write_dsp_file(l.info->dsp, &l.cells[0], l.info->nx, l.info->ny)) {
+      Printf("ERROR:  Unable to write '%s'.\n")(l.info->dsp);
+      return false;
+    }
+  }
+  return true;
+} // Pyramid::write
@@ -0,0 +1,85 @@
+// non-template parts of the full-raster statistics (see raster_stats.h)
+
+#include <cmath>
+#include <thread>
+
+#include "raster_stats.h"
+
+void
+Moments::merge(const Moments& b)
+{
+  if (!b.n)
+    return;
+  if (!n) {
+    *this = b;
+    return;
+  }
+  // pairwise update (Chan, Golub & LeVeque): stable for any split
+  const long long nn = n + b.n;
+  const double delta = b.mean - mean;
+  mean += delta * b.n / nn;
+  m2 += b.m2 + delta * delta * (static_cast<double>(n) * b.n / nn);
+  n = nn;
+  min = b.min < min ? b.min : min;
+  max = b.max > max ? b.max : max;
+} // Moments::merge
+
+Moments
+merge_pairwise(const std::vector<Moments>& parts)
+{
+  if (parts.empty())
+    return Moments();
+
+  std::vector<Moments> level(parts);
+  while (level.size() > 1) {
+    std::vector<Moments> up((level.size() + 1) / 2);
+    for (size_t i = 0; i < up.size(); ++i) {
+      up[i] = level[2*i];
+      if (2*i + 1 < level.size())
+        up[i].merge(level[2*i + 1]);
+    }
+    level.swap(up);
+  }
+  return level[0];
+} // merge_pairwise
+
+int
+stats_thread_count(const int requested, const int nranges)
+{
+  int n = requested;
+  if (n <= 0)
+    n = static_cast<int>(std::thread::hardware_concurrency());
+  if (n <= 0)
+    n = 1;
+  if (n > nranges)
+    n = nranges > 0 ? nranges : 1;
+  return n;
+} // stats_thread_count
+
+void
+RasterStats::print(FILE* fp) const
+{
+  const Moments& m = moments;
+  fprintf(fp, "Statistics (exact, %d thread%s, %.3f s):\n",
+          nthreads, nthreads > 1 ? "s" : "", seconds);
+  if (!m.n) {
+    fprintf(fp, "  no valid cells (%lld no-data)\n", nodata_count);
+    return;
+  }
+  fprintf(fp, "  Min=%.3f, Max=%.3f, Mean=%.3f, StdDev=%.3f\n",
+          m.min, m.max, m.mean, std::sqrt(m.variance()));
+  fprintf(fp, "  Valid cells=%lld, NoData cells=%lld\n",
+          m.n, nodata_count);
+
+  const int nbins = static_cast<int>(hist.size());
+  if (!nbins)
+    return;
+  const double width = m.max > m.min ? (m.max - m.min) / nbins : 0;
+  fprintf(fp, "  Histogram (%d bins):\n", nbins);
+  for (int b = 0; b < nbins; ++b) {
+    const double lo = m.min + b * width;
+    fprintf(fp, "    [%10.3f, %10.3f%c %lld\n",
+            lo, b == nbins - 1 ? m.max : lo + width,
+            b == nbins - 1 ? ']' : ')', hist[b]);
+  }
+} // RasterStats::print
@@ -0,0 +1,439 @@
+// reprojection onto a metric grid (see reproject.h)
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
+
+#include "SafeFormat.h"
+#include "ogr_spatialref.h"
+#include "reproject.h"
+
+using namespace std;
+using namespace Loki;
+
+const float Reprojector::NODATA = -32767;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// points transformed along each edge of the data set for its footprint
+const int EDGE_POINTS = 32;
+
+// the transform grid's coarsest node spacing, cells
+const int MAX_STEP = 64;
+
+// how far (source cells) interpolated positions may be from exact ones
+const double MAX_ERROR = 0.125;
+
+// output rows reprojected from one source window
+const int BLOCK_ROWS = 64;
+
+// rows per band of work within a block
+const int BAND_ROWS = 8;
+
+// the most cells the grid may have
+const double MAX_CELLS = 4.0e9;
+
+// x, y in GIS order (longitude first) whatever the system's axes
+void
+gis_order(OGRSpatialReference& sr)
+{
+#if GDAL_VERSION_MAJOR >= 3
+  sr.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+#else
+  (void)sr;
+#endif
+}
+
+// run 'f(band)' for every band on 'nthreads' threads
+template <class F>
+void
+for_bands(const int nbands, const int nthreads, F f)
+{
+  atomic<int> next(0);
+  auto worker = [&]() {
+    for (int b = next++; b < nbands; b = next++)
+      f(b);
+  };
+  vector<thread> pool;
+  for (int t = 1; t < nthreads; ++t)
+    pool.push_back(thread(worker));
+  worker();
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+}
+
+} // namespace
+
+Reprojector::Reprojector()
+  : band(0), inverse(0), kernel(RESAMPLE_BILINEAR), has_nodata(false),
+    nodata(0), band_nx(0), band_ny(0), width(0), height(0), size(0),
+    x0(0), y0(0), nthreads(1), step(MAX_STEP), gx(0), gy(0), max_error(0),
+    wx0(0), wy0(0), ww(0), wh(0), first(0), nrows(0), next(0),
+    setup_seconds(0), read_seconds(0), resample_seconds(0), cells_read(0)
+{
+  for (int i = 0; i < 6; ++i)
+    gt[i] = 0;
+} // Reprojector::Reprojector
+
+Reprojector::~Reprojector()
+{
+  if (inverse)
+    OGRCoordinateTransformation::DestroyCT(inverse);
+} // Reprojector::~Reprojector
+
+bool
+Reprojector::setup(GDALDataset* set, const string& target, const double cell,
+                   const ResampleKernel k, const string& name, const int nt)
+{
+  const Clock::time_point t0 = Clock::now();
+  band = set->GetRasterBand(1);
+  band_nx = band->GetXSize();
+  band_ny = band->GetYSize();
+  int got(0);
+  nodata = static_cast<float>(band->GetNoDataValue(&got));
+  has_nodata = got != 0;
+  kernel = k;
+  nthreads = nt > 0 ? nt : static_cast<int>(thread::hardware_concurrency());
+  nthreads = max(1, nthreads);
+
+  if (set->GetGeoTransform(gt) != CE_None || gt[2] != 0 || gt[4] != 0) {
+    Printf("ERROR:  '%s' is not a north up grid.\n")(name);
+    return false;
+  }
+  OGRSpatialReference source(set->GetProjectionRef());
+  gis_order(source);
+
+  // the target: EPSG:N, or the UTM zone of the data set's center
+  int epsg(0);
+  if (target == "utm") {
+    OGRSpatialReference geog;
+    geog.SetWellKnownGeogCS("WGS84");
+    gis_order(geog);
+    OGRCoordinateTransformation* ct
+      = OGRCreateCoordinateTransformation(&source, &geog);
+    double x = gt[0] + gt[1] * band_nx / 2;
+    double y = gt[3] + gt[5] * band_ny / 2;
+    const bool ok = ct && ct->Transform(1, &x, &y);
+    if (ct)
+      OGRCoordinateTransformation::DestroyCT(ct);
+    if (!ok) {
+      Printf("ERROR:  Unable to find the longitude of '%s'.\n")(name);
+      return false;
+    }
+    const int zone = min(60, max(1, static_cast<int>(floor((x + 180) / 6)) + 1));
+    epsg = (y >= 0 ? 32600 : 32700) + zone;
+  }
+  else if (target.size() > 5
+           && (target.compare(0, 5, "EPSG:") == 0
+               || target.compare(0, 5, "epsg:") == 0)) {
+    epsg = atoi(target.c_str() + 5);
+  }
+  OGRSpatialReference dest;
+  if (epsg <= 0 || dest.importFromEPSG(epsg) != OGRERR_NONE) {
+    Printf("ERROR:  Unknown target coordinate system '%s'.\n")(target);
+    return false;
+  }
+  gis_order(dest);
+  target_name.clear();
+  SPrintf(target_name, "EPSG:%d")(epsg);
+
+  OGRCoordinateTransformation* forward
+    = OGRCreateCoordinateTransformation(&source, &dest);
+  inverse = OGRCreateCoordinateTransformation(&dest, &source);
+  if (!forward || !inverse) {
+    if (forward)
+      OGRCoordinateTransformation::DestroyCT(forward);
+    Printf("ERROR:  Unable to transform '%s' to %s.\n")(name)(target_name);
+    return false;
+  }
+
+  // the footprint: the edges' points, plus the center and its
+  // neighbors for the cell size
+  vector<double> xs, ys;
+  for (int i = 0; i <= EDGE_POINTS; ++i) {
+    const double f = static_cast<double>(i) / EDGE_POINTS;
+    const double px[4] = { f * band_nx, f * band_nx, 0, double(band_nx) };
+    const double py[4] = { 0, double(band_ny), f * band_ny, f * band_ny };
+    for (int e = 0; e < 4; ++e) {
+      xs.push_back(gt[0] + px[e] * gt[1]);
+      ys.push_back(gt[3] + py[e] * gt[5]);
+    }
+  }
+  const size_t center = xs.size();
+  for (int i = 0; i < 3; ++i) {
+    xs.push_back(gt[0] + (band_nx / 2 + (i == 1)) * gt[1]);
+    ys.push_back(gt[3] + (band_ny / 2 + (i == 2)) * gt[5]);
+  }
+  vector<int> ok(xs.size(), 0);
+  forward->Transform(static_cast<int>(xs.size()), &xs[0], &ys[0], 0, &ok[0]);
+  OGRCoordinateTransformation::DestroyCT(forward);
+
+  double minx(HUGE_VAL), maxx(-HUGE_VAL), miny(HUGE_VAL), maxy(-HUGE_VAL);
+  for (size_t i = 0; i < center; ++i) {
+    if (!ok[i])
+      continue;
+    minx = min(minx, xs[i]);
+    maxx = max(maxx, xs[i]);
+    miny = min(miny, ys[i]);
+    maxy = max(maxy, ys[i]);
+  }
+  size = cell;
+  if (size <= 0 && ok[center] && ok[center + 1] && ok[center + 2]) {
+    const double dx = hypot(xs[center + 1] - xs[center],
+                            ys[center + 1] - ys[center]);
+    const double dy = hypot(xs[center + 2] - xs[center],
+                            ys[center + 2] - ys[center]);
+    size = min(dx, dy);
+  }
+  if (!(minx < maxx && miny < maxy && size > 0)) {
+    Printf("ERROR:  Unable to place '%s' in %s.\n")(name)(target_name);
+    return false;
+  }
+
+  // corners on multiples of the cell size
+  x0 = floor(minx / size) * size;
+  y0 = ceil(maxy / size) * size;
+  const double w = ceil((maxx - x0) / size);
+  const double h = ceil((y0 - miny) / size);
+  if (w * h > MAX_CELLS) {
+    Printf("ERROR:  '%s' in %s with %g m cells would be %.0f x %.0f cells.\n")
+      (name)(target_name)(size)(w)(h);
+    return false;
+  }
+  width = max(1, static_cast<int>(w));
+  height = max(1, static_cast<int>(h));
+
+  for (step = MAX_STEP; ; step /= 2) {
+    if (!make_nodes(step)) {
+      Printf("ERROR:  Unable to transform %s back to '%s'.\n")
+        (target_name)(name);
+      return false;
+    }
+    max_error = node_error();
+    if (max_error <= MAX_ERROR || step <= 2)
+      break;
+  }
+  setup_seconds = chrono::duration<double>(Clock::now() - t0).count();
+  return true;
+} // Reprojector::setup
+
+bool
+Reprojector::make_nodes(const int s)
+{
+  gx = (width - 1) / s + 2;
+  gy = (height - 1) / s + 2;
+  node_u.resize(static_cast<size_t>(gx) * gy);
+  node_v.resize(node_u.size());
+  vector<double> xs(gx), ys(gx);
+  vector<int> ok(gx);
+  bool any(false);
+  for (int r = 0; r < gy; ++r) {
+    for (int k = 0; k < gx; ++k) {
+      xs[k] = x0 + (k * s + 0.5) * size;
+      ys[k] = y0 - (r * s + 0.5) * size;
+      ok[k] = 0;
+    }
+    inverse->Transform(gx, &xs[0], &ys[0], 0, &ok[0]);
+    for (int k = 0; k < gx; ++k) {
+      const size_t at = static_cast<size_t>(r) * gx + k;
+      // source cell centers at whole numbers
+      node_u[at] = ok[k] ? (xs[k] - gt[0]) / gt[1] - 0.5 : NAN;
+      node_v[at] = ok[k] ? (ys[k] - gt[3]) / gt[5] - 0.5 : NAN;
+      any = any || ok[k];
+    }
+  }
+  return any;
+} // Reprojector::make_nodes
+
+double
+Reprojector::node_error()
+{
+  if (step < 2)
+    return 0;
+  double err(0);
+  const int n = gx - 1;
+  vector<double> xs(n), ys(n);
+  vector<int> ok(n);
+  for (int r = 0; r + 1 < gy; ++r) {
+    const int i = r * step + step / 2;
+    for (int k = 0; k < n; ++k) {
+      xs[k] = x0 + (k * step + step / 2 + 0.5) * size;
+      ys[k] = y0 - (i + 0.5) * size;
+      ok[k] = 0;
+    }
+    inverse->Transform(n, &xs[0], &ys[0], 0, &ok[0]);
+    for (int k = 0; k < n; ++k) {
+      double u, v;
+      position(k * step + step / 2, i, u, v);
+      if (!ok[k] || std::isnan(u) || std::isnan(v))
+        continue;
+      err = max(err, hypot((xs[k] - gt[0]) / gt[1] - 0.5 - u,
+                           (ys[k] - gt[3]) / gt[5] - 0.5 - v));
+    }
+  }
+  return err;
+} // Reprojector::node_error
+
+void
+Reprojector::position(const int j, const int i, double& u, double& v) const
+{
+  const int k = j / step;
+  const int r = i / step;
+  const double s = static_cast<double>(j - k * step) / step;
+  const double t = static_cast<double>(i - r * step) / step;
+  const size_t a = static_cast<size_t>(r) * gx + k;
+  const size_t b = a + gx;
+  u = (1 - t) * ((1 - s) * node_u[a] + s * node_u[a + 1])
+    + t * ((1 - s) * node_u[b] + s * node_u[b + 1]);
+  v = (1 - t) * ((1 - s) * node_v[a] + s * node_v[a + 1])
+    + t * ((1 - s) * node_v[b] + s * node_v[b + 1]);
+} // Reprojector::position
+
+bool
+Reprojector::read_row(float* row)
+{
+  if (next >= height)
+    return false;
+  if (next >= first + nrows && !read_block())
+    return false;
+  const float* out = &block[static_cast<size_t>(next - first) * width];
+  copy(out, out + width, row);
+  ++next;
+  return true;
+} // Reprojector::read_row
+
+bool
+Reprojector::read_block()
+{
+  first = next;
+  nrows = min(BLOCK_ROWS, height - first);
+
+  // the block's positions lie between those of its node rows; the
+  // window adds the kernel's reach
+  const int r0 = first / step;
+  const int r1 = (first + nrows - 1) / step + 1;
+  double umin(HUGE_VAL), umax(-HUGE_VAL), vmin(HUGE_VAL), vmax(-HUGE_VAL);
+  for (size_t at = static_cast<size_t>(r0) * gx;
+       at < static_cast<size_t>(r1 + 1) * gx; ++at) {
+    if (std::isnan(node_u[at]) || std::isnan(node_v[at]))
+      continue;
+    umin = min(umin, node_u[at]);
+    umax = max(umax, node_u[at]);
+    vmin = min(vmin, node_v[at]);
+    vmax = max(vmax, node_v[at]);
+  }
+  ww = wh = 0;
+  if (umin <= umax) {
+    wx0 = max(0, static_cast<int>(floor(umin)) - 2);
+    wy0 = max(0, static_cast<int>(floor(vmin)) - 2);
+    ww = min(band_nx, static_cast<int>(ceil(umax)) + 3) - wx0;
+    wh = min(band_ny, static_cast<int>(ceil(vmax)) + 3) - wy0;
+  }
+
+  const Clock::time_point t0 = Clock::now();
+  if (ww > 0 && wh > 0) {
+    src.resize(static_cast<size_t>(ww) * wh);
+    if (band->RasterIO(GF_Read, wx0, wy0, ww, wh, &src[0], ww, wh,
+                       GDT_Float32, 0, 0) != CE_None)
+      return false;
+    cells_read += static_cast<long long>(ww) * wh;
+  }
+  else {
+    ww = wh = 0;
+  }
+  const Clock::time_point t1 = Clock::now();
+
+  block.resize(static_cast<size_t>(nrows) * width);
+  const int nbands = (nrows + BAND_ROWS - 1) / BAND_ROWS;
+  for_bands(nbands, min(nthreads, nbands), [&](const int b) {
+      vector<float> u(width), v(width);
+      const int y1 = min(nrows, (b + 1) * BAND_ROWS);
+      for (int y = b * BAND_ROWS; y < y1; ++y)
+        reproject_row(first + y, &block[static_cast<size_t>(y) * width],
+                      u, v);
+    });
+  read_seconds += chrono::duration<double>(t1 - t0).count();
+  resample_seconds += chrono::duration<double>(Clock::now() - t1).count();
+  return true;
+} // Reprojector::read_block
+
+void
+Reprojector::reproject_row(const int y, float* dst, vector<float>& uu,
+                           vector<float>& vv) const
+{
+  if (!ww) {
+    fill(dst, dst + width, NODATA);
+    return;
+  }
+
+  // the row's positions: its node row pair blended, then each span
+  // between node columns stepped across
+  const int r = y / step;
+  const double t = static_cast<double>(y - r * step) / step;
+  const double* ua = &node_u[static_cast<size_t>(r) * gx];
+  const double* va = &node_v[static_cast<size_t>(r) * gx];
+  const double* ub = ua + gx;
+  const double* vb = va + gx;
+  float* u = &uu[0];
+  float* v = &vv[0];
+  for (int k = 0; k * step < width; ++k) {
+    const double u0 = (1 - t) * ua[k] + t * ub[k];
+    const double v0 = (1 - t) * va[k] + t * vb[k];
+    const float du = static_cast<float>(((1 - t) * ua[k + 1] + t * ub[k + 1]
+                                         - u0) / step);
+    const float dv = static_cast<float>(((1 - t) * va[k + 1] + t * vb[k + 1]
+                                         - v0) / step);
+    const int j0 = k * step;
+    const int n = min(step, width - j0);
+    const float fu = static_cast<float>(u0);
+    const float fv = static_cast<float>(v0);
+    for (int j = 0; j < n; ++j) {
+      u[j0 + j] = fu + j * du;
+      v[j0 + j] = fv + j * dv;
+    }
+  }
+
+  // sample: outside the data set (or on failed nodes) is no data
+  const float xmax = band_nx - 0.5f;
+  const float ymax = band_ny - 0.5f;
+  for (int j = 0; j < width; ++j) {
+    if (!(u[j] >= -0.5f && u[j] <= xmax && v[j] >= -0.5f && v[j] <= ymax)) {
+      dst[j] = NODATA;
+      continue;
+    }
+    int ix[4], iy[4];
+    float wx[4], wy[4];
+    const int nx = kernel_taps(kernel, u[j], band_nx, ix, wx);
+    const int ny = kernel_taps(kernel, v[j], band_ny, iy, wy);
+    float sum(0);
+    bool bad(false);
+    for (int a = 0; a < ny; ++a) {
+      const float* row = src.data() + static_cast<size_t>(iy[a] - wy0) * ww;
+      for (int b = 0; b < nx; ++b) {
+        const float c = row[ix[b] - wx0];
+        bad = bad || (has_nodata && c == nodata && wx[b] != 0 && wy[a] != 0);
+        sum += wx[b] * wy[a] * c;
+      }
+    }
+    dst[j] = bad ? NODATA : sum;
+  }
+} // Reprojector::reproject_row
+
+void
+Reprojector::print(FILE* fp, const string& what) const
+{
+  static const char* const kernels[] = { "nearest", "bilinear", "bicubic" };
+  fprintf(fp, "%s: reprojected %dx%d to %s, %dx%d cells of %g m (%s);"
+          " transform grid every %d cells (%dx%d nodes, within %.3f cells)"
+          " in %.3f s\n"
+          "  %lld cells read in %.3f s, resampled on %d thread%s in %.3f s\n",
+          what.c_str(), band_nx, band_ny, target_name.c_str(), width, height,
+          size, kernels[kernel], step, gx, gy, max_error, setup_seconds,
+          cells_read, read_seconds, nthreads, nthreads > 1 ? "s" : "",
+          resample_seconds);
+} // Reprojector::print
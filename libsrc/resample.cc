@@ -0,0 +1,238 @@
+// resampling to square cells (see resample.h)
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <algorithm>
+
+#include "resample.h"
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// output rows resampled from one window of band rows
+const int BLOCK_ROWS = 256;
+
+// rows per band of work within a block
+const int BAND_ROWS = 16;
+
+// Keys' cubic convolution kernel, a = -0.5
+float
+cubic(const double t)
+{
+  const double a = -0.5;
+  const double x = fabs(t);
+  if (x <= 1)
+    return static_cast<float>(((a + 2) * x - (a + 3)) * x * x + 1);
+  if (x < 2)
+    return static_cast<float>(((a * x - 5 * a) * x + 8 * a) * x - 4 * a);
+  return 0;
+}
+
+// run 'f(band)' for every band on 'nthreads' threads
+template <class F>
+void
+for_bands(const int nbands, const int nthreads, F f)
+{
+  atomic<int> next(0);
+  auto worker = [&]() {
+    for (int b = next++; b < nbands; b = next++)
+      f(b);
+  };
+  vector<thread> pool;
+  for (int t = 1; t < nthreads; ++t)
+    pool.push_back(thread(worker));
+  worker();
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+}
+
+} // namespace
+
+int
+kernel_taps(const ResampleKernel k, const double u, const int n,
+            int* index, float* weight)
+{
+  int i0;
+  int ntaps;
+  double w[4];
+  if (k == RESAMPLE_NEAREST) {
+    i0 = static_cast<int>(floor(u + 0.5));
+    w[0] = 1;
+    ntaps = 1;
+  }
+  else if (k == RESAMPLE_BILINEAR) {
+    i0 = static_cast<int>(floor(u));
+    w[1] = u - i0;
+    w[0] = 1 - w[1];
+    ntaps = 2;
+  }
+  else {
+    i0 = static_cast<int>(floor(u)) - 1;
+    for (int t = 0; t < 4; ++t)
+      w[t] = cubic(u - (i0 + t));
+    ntaps = 4;
+  }
+  for (int t = 0; t < ntaps; ++t) {
+    index[t] = min(n - 1, max(0, i0 + t));
+    weight[t] = static_cast<float>(w[t]);
+  }
+  return ntaps;
+} // kernel_taps
+
+Resampler::Resampler(GDALRasterBand* b, const double cx, const double cy,
+                     const double c, const ResampleKernel k,
+                     const bool has_nodata, const double nd, const int nt)
+  : band(b), cellx(cx), celly(cy), cell(c), kernel(k),
+    nodata(static_cast<float>(nd)),
+    // without a no-data value no cell matches (nothing equals NaN)
+    match(has_nodata ? static_cast<float>(nd)
+                     : numeric_limits<float>::quiet_NaN()),
+    band_nx(b->GetXSize()), band_ny(b->GetYSize()),
+    // whole cells inside the band's extent (allowing for rounding)
+    width(max(1, static_cast<int>(floor(band_nx * cx / c + 1.0e-6)))),
+    height(max(1, static_cast<int>(floor(band_ny * cy / c + 1.0e-6)))),
+    nthreads(nt > 0 ? nt : static_cast<int>(thread::hardware_concurrency())),
+    src_y0(0), src_rows(0), first(0), nrows(0), next(0),
+    read_seconds(0), resample_seconds(0), band_rows(0)
+{
+  nthreads = max(1, nthreads);
+  make_taps(width, band_nx, cell / cellx, xtaps);
+  make_taps(height, band_ny, cell / celly, ytaps);
+} // Resampler::Resampler
+
+void
+Resampler::make_taps(const int nout, const int nsrc, const double ratio,
+                     Taps& t) const
+{
+  t.n = kernel == RESAMPLE_NEAREST ? 1 : kernel == RESAMPLE_BILINEAR ? 2 : 4;
+  t.count = nout;
+  t.index.resize(static_cast<size_t>(t.n) * nout);
+  t.weight.resize(t.index.size());
+  t.live.resize(t.index.size());
+  for (int j = 0; j < nout; ++j) {
+    // the output cell's center in source cell coordinates (cell i's
+    // center at i)
+    int index[4];
+    float weight[4];
+    kernel_taps(kernel, (j + 0.5) * ratio - 0.5, nsrc, index, weight);
+    for (int k = 0; k < t.n; ++k) {
+      const size_t at = static_cast<size_t>(k) * nout + j;
+      t.index[at] = index[k];
+      t.weight[at] = weight[k];
+      t.live[at] = weight[k] != 0 ? 1.0f : 0.0f;
+    }
+  }
+} // Resampler::make_taps
+
+bool
+Resampler::read_row(float* row)
+{
+  if (next >= height)
+    return false;
+  if (next >= first + nrows && !read_block())
+    return false;
+  const float* src_row = &block[static_cast<size_t>(next - first) * width];
+  copy(src_row, src_row + width, row);
+  ++next;
+  return true;
+} // Resampler::read_row
+
+bool
+Resampler::read_block()
+{
+  first = next;
+  nrows = min(BLOCK_ROWS, height - first);
+
+  // the band rows under the block's taps (they grow with the row)
+  const int last = first + nrows - 1;
+  int lo = band_ny;
+  int hi = 0;
+  for (int k = 0; k < ytaps.n; ++k) {
+    lo = min(lo, ytaps.index[static_cast<size_t>(k) * height + first]);
+    hi = max(hi, ytaps.index[static_cast<size_t>(k) * height + last]);
+  }
+  src_y0 = lo;
+  src_rows = hi - lo + 1;
+
+  const Clock::time_point t0 = Clock::now();
+  src.resize(static_cast<size_t>(src_rows) * band_nx);
+  if (band->RasterIO(GF_Read, 0, src_y0, band_nx, src_rows, &src[0],
+                     band_nx, src_rows, GDT_Float32, 0, 0) != CE_None)
+    return false;
+  band_rows += src_rows;
+  const Clock::time_point t1 = Clock::now();
+
+  block.resize(static_cast<size_t>(nrows) * width);
+  const int nbands = (nrows + BAND_ROWS - 1) / BAND_ROWS;
+  for_bands(nbands, min(nthreads, nbands), [&](const int b) {
+      vector<float> sum(band_nx), bad(band_nx), nbad(width);
+      const int y1 = min(nrows, (b + 1) * BAND_ROWS);
+      for (int y = b * BAND_ROWS; y < y1; ++y)
+        resample_row(first + y, &block[static_cast<size_t>(y) * width],
+                     sum, bad, nbad);
+    });
+  read_seconds += chrono::duration<double>(t1 - t0).count();
+  resample_seconds += chrono::duration<double>(Clock::now() - t1).count();
+  return true;
+} // Resampler::read_block
+
+void
+Resampler::resample_row(const int y, float* dst, vector<float>& sum,
+                        vector<float>& bad, vector<float>& nbad) const
+{
+  const int n = band_nx;
+  const float nd = match;
+  float* s = &sum[0];
+  float* b = &bad[0];
+  fill(s, s + n, 0.0f);
+  fill(b, b + n, 0.0f);
+
+  // down: the weighted sum of the row's band rows, and a count of
+  // no-data cells under live taps
+  for (int k = 0; k < ytaps.n; ++k) {
+    const size_t at = static_cast<size_t>(k) * height + y;
+    const float w = ytaps.weight[at];
+    const float l = ytaps.live[at];
+    const float* v = &src[static_cast<size_t>(ytaps.index[at] - src_y0) * n];
+    for (int x = 0; x < n; ++x) {
+      s[x] += w * v[x];
+      b[x] += v[x] == nd ? l : 0.0f;
+    }
+  }
+
+  // across: the same for each output cell's columns
+  const int m = width;
+  float* c = &nbad[0];
+  fill(c, c + m, 0.0f);
+  fill(dst, dst + m, 0.0f);
+  for (int k = 0; k < xtaps.n; ++k) {
+    const size_t at = static_cast<size_t>(k) * m;
+    const int* ix = &xtaps.index[at];
+    const float* w = &xtaps.weight[at];
+    const float* l = &xtaps.live[at];
+    for (int j = 0; j < m; ++j) {
+      dst[j] += w[j] * s[ix[j]];
+      c[j] += l[j] * b[ix[j]];
+    }
+  }
+  const float z = nodata;
+  for (int j = 0; j < m; ++j)
+    dst[j] = c[j] > 0 ? z : dst[j];
+} // Resampler::resample_row
+
+void
+Resampler::print(FILE* fp, const string& what) const
+{
+  static const char* const kernels[] = { "nearest", "bilinear", "bicubic" };
+  fprintf(fp, "%s: resampled %dx%d (%g m x %g m cells) to %dx%d (%g m, %s)"
+          " on %d thread%s: %lld rows read in %.3f s, resample %.3f s\n",
+          what.c_str(), band_nx, band_ny, cellx, celly, width, height, cell,
+          kernels[kernel], nthreads, nthreads > 1 ? "s" : "", band_rows,
+          read_seconds, resample_seconds);
+} // Resampler::print
@@ -0,0 +1,300 @@
+// in-process ray traced preview on librt (see rt_render.h)
+
+#include <cmath>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "common.h"
+#include "vmath.h"
+#include "raytrace.h"
+
+#include "rt_render.h"
+#include "g_database.h" // brlcad_lock()
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+double
+seconds_since(const Clock::time_point& t0)
+{
+  return chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// fraction of full brightness for surfaces facing away from the light
+const double AMBIENT = 0.2;
+
+int
+shade_hit(struct application* ap, struct partition* PartHeadp, struct seg*)
+{
+  // first partition in front of the eye
+  struct partition* pp = PartHeadp->pt_forw;
+  for (; pp != PartHeadp; pp = pp->pt_forw)
+    if (pp->pt_outhit->hit_dist >= 0)
+      break;
+  if (pp == PartHeadp)
+    return 0;
+
+  struct hit* hitp = pp->pt_inhit;
+  vect_t normal;
+  RT_HIT_NORMAL(normal, hitp, pp->pt_inseg->seg_stp, &(ap->a_ray),
+                pp->pt_inflip);
+
+  // head light: the light is at the eye
+  double c = -VDOT(normal, ap->a_ray.r_dir);
+  c = c < 0 ? 0 : c > 1 ? 1 : c;
+  const double v = 255 * (AMBIENT + (1 - AMBIENT) * c);
+
+  unsigned char* pix = static_cast<unsigned char*>(ap->a_uptr);
+  pix[0] = pix[1] = pix[2] = static_cast<unsigned char>(v);
+  return 1;
+}
+
+int
+shade_miss(struct application* ap)
+{
+  unsigned char* pix = static_cast<unsigned char*>(ap->a_uptr);
+  pix[0] = pix[1] = pix[2] = 0;
+  return 0;
+}
+
+// a view's camera and its tile/band bookkeeping during a batch
+struct ViewState {
+  vect_t    right;
+  vect_t    up;
+  vect_t    dir;
+  point_t   start;
+  double    viewsize;
+  double    cell;
+  int       ntx;        // tiles per edge (and bands)
+  int       first;      // index of its first tile in the batch
+
+  // guarded by 'lock': tiles left per band, next band to emit
+  mutex       lock;
+  vector<int> band_left;
+  int         next_band;
+  bool        sink_ok;
+
+  ViewState()
+    : viewsize(0), cell(0), ntx(0), first(0), next_band(0), sink_ok(true)
+  {}
+};
+
+} // namespace
+
+bool
+Framebuffer::write_pix(const string& fname) const
+{
+  FILE* fp = fopen(fname.c_str(), "wb");
+  if (!fp)
+    return false;
+  bool ok = fwrite(&rgb[0], 1, rgb.size(), fp) == rgb.size();
+  return fclose(fp) == 0 && ok;
+} // Framebuffer::write_pix
+
+void
+RenderStats::print(FILE* fp, const string& what) const
+{
+  fprintf(fp, "%s: %lld rays (%lld hits), %d tiles on %d thread%s: "
+          "prep %.3f s, shoot %.3f s (%.2f Mrays/s)\n",
+          what.c_str(), rays, hits, ntiles, nthreads,
+          nthreads > 1 ? "s" : "", prep_seconds, shoot_seconds,
+          shoot_seconds > 0 ? rays / shoot_seconds / 1.0e6 : 0.0);
+} // RenderStats::print
+
+RtScene::RtScene()
+  : rtip(0), prep_seconds(0)
+{
+} // RtScene::RtScene
+
+RtScene::~RtScene()
+{
+  lock_guard<mutex> lock(brlcad_lock());
+  for (size_t i = 0; i < resources.size(); ++i) {
+    if (rtip)
+      rt_clean_resource(rtip, resources[i]);
+    free(resources[i]);
+  }
+  if (rtip)
+    rt_free_rti(rtip);
+} // RtScene::~RtScene
+
+bool
+RtScene::load(const string& gfile, const vector<string>& objects,
+              const int nthreads)
+{
+  const Clock::time_point t0 = Clock::now();
+  lock_guard<mutex> lock(brlcad_lock());
+
+  if (rtip || objects.empty())
+    return false;
+
+  char title[1024] = {0};
+  rtip = rt_dirbuild(gfile.c_str(), title, sizeof(title));
+  if (!rtip)
+    return false;
+
+  int n = nthreads > 0 ? nthreads
+                       : static_cast<int>(thread::hardware_concurrency());
+  if (n < 1)
+    n = 1;
+  if (n > MAX_PSW)
+    n = MAX_PSW;
+
+  vector<const char*> objs;
+  for (size_t i = 0; i < objects.size(); ++i)
+    objs.push_back(objects[i].c_str());
+  if (rt_gettrees(rtip, static_cast<int>(objs.size()), &objs[0], n) < 0)
+    return false;
+
+  // one resource per worker thread, registered before prep
+  for (int i = 0; i < n; ++i) {
+    struct resource* r
+      = static_cast<struct resource*>(calloc(1, sizeof(struct resource)));
+    rt_init_resource(r, i, rtip);
+    resources.push_back(r);
+  }
+  rt_prep_parallel(rtip, n);
+
+  prep_seconds = seconds_since(t0);
+  return true;
+} // RtScene::load
+
+bool
+RtScene::render(const double az, const double el, const int size,
+                Framebuffer& fb, RenderStats& stats, const RowSink& sink)
+{
+  vector<RenderView> views(1, RenderView(az, el, size, &fb, sink));
+  return render(views, stats);
+} // RtScene::render
+
+bool
+RtScene::render(const vector<RenderView>& views, RenderStats& stats)
+{
+  if (!rtip || views.empty())
+    return false;
+  for (size_t i = 0; i < views.size(); ++i)
+    if (views[i].size < 1 || !views[i].fb)
+      return false;
+
+  const Clock::time_point t0 = Clock::now();
+
+  point_t center;
+  VADD2SCALE(center, rtip->mdl_min, rtip->mdl_max, 0.5);
+  vect_t diag;
+  VSUB2(diag, rtip->mdl_max, rtip->mdl_min);
+
+  // cameras, as rt sets them up for '-a az -e el'; the tiles of all
+  // views go into one queue
+  const int nviews = static_cast<int>(views.size());
+  vector<ViewState> vs(nviews);
+  int ntiles = 0;
+  for (int v = 0; v < nviews; ++v) {
+    const RenderView& rv = views[v];
+    ViewState& s = vs[v];
+    rv.fb->resize(rv.size, rv.size);
+
+    const double a = rv.az * M_PI / 180;
+    const double e = rv.el * M_PI / 180;
+    vect_t toeye;
+    VSET(toeye, cos(e) * cos(a), cos(e) * sin(a), sin(e));
+    VSET(s.right, -sin(a), cos(a), 0);
+    VSET(s.up, -sin(e) * cos(a), -sin(e) * sin(a), cos(e));
+    VREVERSE(s.dir, toeye);
+
+    s.viewsize = MAGNITUDE(diag);
+    s.cell = s.viewsize / rv.size;
+    // rays start outside the model's bounding sphere (radius viewsize/2)
+    VJOIN1(s.start, center, s.viewsize, toeye);
+
+    // bands of tiles, counted from the top of the image
+    s.ntx = (rv.size + RT_TILE_SIZE - 1) / RT_TILE_SIZE;
+    s.first = ntiles;
+    s.band_left.assign(s.ntx, s.ntx);
+    ntiles += s.ntx * s.ntx;
+  }
+
+  atomic<int> next(0);
+  const int nthreads = static_cast<int>(resources.size());
+  vector<long long> rays(nthreads, 0), hits(nthreads, 0);
+
+  auto worker = [&](const int t) {
+    struct application ap;
+    RT_APPLICATION_INIT(&ap);
+    ap.a_rt_i = rtip;
+    ap.a_resource = resources[t];
+    ap.a_hit = shade_hit;
+    ap.a_miss = shade_miss;
+    ap.a_onehit = 1;
+
+    int v = 0;
+    for (int tile = next++; tile < ntiles; tile = next++) {
+      // tiles are handed out in order, so the view only moves forward
+      while (v + 1 < nviews && tile >= vs[v + 1].first)
+        ++v;
+      const RenderView& rv = views[v];
+      ViewState& s = vs[v];
+      const int size = rv.size;
+      Framebuffer& fb = *rv.fb;
+      VMOVE(ap.a_ray.r_dir, s.dir);
+
+      const int band = (tile - s.first) / s.ntx;
+      const int x0 = ((tile - s.first) % s.ntx) * RT_TILE_SIZE;
+      const int x1 = min(x0 + RT_TILE_SIZE, size);
+      const int y1 = size - band * RT_TILE_SIZE;
+      const int y0 = max(y1 - RT_TILE_SIZE, 0);
+      for (int y = y0; y < y1; ++y) {
+        const double dy = (y + 0.5) * s.cell - s.viewsize / 2;
+        unsigned char* row = fb.row(y);
+        for (int x = x0; x < x1; ++x) {
+          const double dx = (x + 0.5) * s.cell - s.viewsize / 2;
+          VJOIN2(ap.a_ray.r_pt, s.start, dx, s.right, dy, s.up);
+          ap.a_x = x;
+          ap.a_y = y;
+          ap.a_uptr = row + 3 * x;
+          hits[t] += rt_shootray(&ap) ? 1 : 0;
+          ++rays[t];
+        }
+      }
+
+      if (!rv.sink)
+        continue;
+      // whoever finishes the next band in order emits it (and any
+      // bands below it that are already done)
+      lock_guard<mutex> lock(s.lock);
+      --s.band_left[band];
+      for (; s.next_band < s.ntx && s.band_left[s.next_band] == 0;
+           ++s.next_band) {
+        const int top = size - 1 - s.next_band * RT_TILE_SIZE;
+        const int bot = max(top - RT_TILE_SIZE + 1, 0);
+        for (int y = top; y >= bot && s.sink_ok; --y)
+          s.sink_ok = rv.sink(fb.row(y));
+      }
+    }
+  };
+
+  vector<thread> pool;
+  for (int t = 1; t < nthreads; ++t)
+    pool.push_back(thread(worker, t));
+  worker(0);
+  for (size_t i = 0; i < pool.size(); ++i)
+    pool[i].join();
+
+  stats.nthreads = nthreads;
+  stats.ntiles = ntiles;
+  stats.prep_seconds = prep_seconds;
+  stats.shoot_seconds = seconds_since(t0);
+  for (int t = 0; t < nthreads; ++t) {
+    stats.rays += rays[t];
+    stats.hits += hits[t];
+  }
+  bool ok = true;
+  for (int v = 0; v < nviews; ++v)
+    ok = ok && vs[v].sink_ok;
+  return ok;
+} // RtScene::render
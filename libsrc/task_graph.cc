@@ -0,0 +1,119 @@
+// dependency-graph executor for the output stages (see task_graph.h)
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+#include "task_graph.h"
+
+using namespace std;
+
+int
+TaskGraph::add(const string& name, const Action& action,
+               const vector<int>& deps)
+{
+  const int id = static_cast<int>(tasks.size());
+  Task t;
+  t.name = name;
+  t.action = action;
+  t.ndeps = static_cast<int>(deps.size());
+  t.state = PENDING;
+  t.cached = false;
+  t.seconds = 0;
+  tasks.push_back(t);
+  for (size_t i = 0; i < deps.size(); ++i)
+    tasks[deps[i]].dependents.push_back(id);
+  return id;
+} // TaskGraph::add
+
+bool
+TaskGraph::run(const int nthreads)
+{
+  typedef chrono::steady_clock Clock;
+  const Clock::time_point t0 = Clock::now();
+
+  mutex mtx;
+  condition_variable cv;
+  deque<int> ready;
+  int running(0);
+  bool failed(false);
+
+  for (size_t i = 0; i < tasks.size(); ++i)
+    if (!tasks[i].ndeps)
+      ready.push_back(static_cast<int>(i));
+
+  auto worker = [&]() {
+    unique_lock<mutex> lock(mtx);
+    for (;;) {
+      cv.wait(lock, [&]() {
+          return failed || !ready.empty() || running == 0;
+        });
+      if (failed || ready.empty())
+        break;
+
+      const int id = ready.front();
+      ready.pop_front();
+      Task& t = tasks[id];
+      t.state = RUNNING;
+      ++running;
+
+      lock.unlock();
+      const Clock::time_point s0 = Clock::now();
+      const bool ok = t.cached ? true : t.action();
+      const double secs = chrono::duration<double>(Clock::now() - s0).count();
+      lock.lock();
+
+      --running;
+      t.seconds = secs;
+      t.state = !ok ? FAILED : t.cached ? CACHED : DONE;
+      if (!ok) {
+        failed = true;
+      }
+      else {
+        for (size_t i = 0; i < t.dependents.size(); ++i)
+          if (--tasks[t.dependents[i]].ndeps == 0)
+            ready.push_back(t.dependents[i]);
+      }
+      cv.notify_all();
+    }
+    cv.notify_all();
+  };
+
+  int n = nthreads > 0 ? nthreads
+                       : static_cast<int>(thread::hardware_concurrency());
+  if (n > static_cast<int>(tasks.size()))
+    n = static_cast<int>(tasks.size());
+  if (n < 1)
+    n = 1;
+
+  vector<thread> pool;
+  for (int i = 1; i < n; ++i)
+    pool.push_back(thread(worker));
+  worker();
+  for (size_t i = 0; i < pool.size(); ++i)
+    pool[i].join();
+
+  for (size_t i = 0; i < tasks.size(); ++i)
+    if (tasks[i].state == PENDING)
+      tasks[i].state = SKIPPED;
+
+  total_seconds = chrono::duration<double>(Clock::now() - t0).count();
+  return !failed;
+} // TaskGraph::run
+
+void
+TaskGraph::report(FILE* fp) const
+{
+  static const char* names[] = {
+    "pending", "running", "ok", "FAILED", "skipped", "cached"
+  };
+  fprintf(fp, "Stage times:\n");
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    const Task& t = tasks[i];
+    fprintf(fp, "  %-16s %-8s %8.3f s\n",
+            t.name.c_str(), names[t.state], t.seconds);
+  }
+  fprintf(fp, "  %-16s %-8s %8.3f s\n", "(wall)", "", total_seconds);
+} // TaskGraph::report
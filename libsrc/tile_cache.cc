@@ -0,0 +1,271 @@
+// LRU tile cache with scan-direction prefetch (see tile_cache.h)
+
+#include <algorithm>
+
+#include "tile_cache.h"
+
+using namespace std;
+
+namespace {
+
+int
+clamp(const int v, const int lo, const int hi)
+{
+  return v < lo ? lo : v > hi ? hi : v;
+}
+
+int
+sign(const int v)
+{
+  return (v > 0) - (v < 0);
+}
+
+} // namespace
+
+TileCache::TileCache(const int nx, const int ny, const TileReader& r,
+                     const size_t b, const int tile)
+  : width(nx), height(ny), size(max(1, tile)),
+    ntx((nx + size - 1) / size), nty((ny + size - 1) / size),
+    reader(r), budget(b), bytes(0), stop(false),
+    last_x0(0), last_y0(0), have_last(false),
+    hits(0), misses(0), waits(0), evictions(0), prefetches(0),
+    prefetch_hits(0), peak_bytes(0)
+{
+  worker = thread(&TileCache::prefetcher, this);
+} // TileCache::TileCache
+
+TileCache::~TileCache()
+{
+  {
+    lock_guard<mutex> l(lock);
+    stop = true;
+  }
+  wake.notify_all();
+  worker.join();
+  for (list<Tile*>::iterator i = order.begin(); i != order.end(); ++i)
+    delete *i;
+} // TileCache::~TileCache
+
+bool
+TileCache::read(const int x0, const int y0, const int w, const int h,
+                float* dst)
+{
+  if (w < 1 || h < 1)
+    return true;
+
+  // the grid cells the window maps to (edges repeat outside the grid)
+  const int gx0 = clamp(x0, 0, width - 1);
+  const int gx1 = clamp(x0 + w - 1, 0, width - 1);
+  const int gy0 = clamp(y0, 0, height - 1);
+  const int gy1 = clamp(y0 + h - 1, 0, height - 1);
+  const int gw = gx1 - gx0 + 1;
+  const bool inside = gx0 == x0 && gy0 == y0 && gw == w
+                      && gy1 - gy0 + 1 == h;
+  vector<float> tmp;
+  if (!inside)
+    tmp.resize(static_cast<size_t>(gw) * (gy1 - gy0 + 1));
+  float* buf = inside ? dst : &tmp[0];
+
+  const int tx0 = gx0 / size;
+  const int tx1 = gx1 / size;
+  const int ty0 = gy0 / size;
+  const int ty1 = gy1 / size;
+  for (int ty = ty0; ty <= ty1; ++ty) {
+    for (int tx = tx0; tx <= tx1; ++tx) {
+      Tile* t = acquire(tx, ty);
+      if (!t)
+        return false;
+      const int tw = min(size, width - tx * size);
+      const int ax0 = max(gx0, tx * size);
+      const int ax1 = min(gx1, tx * size + tw - 1);
+      const int ay0 = max(gy0, ty * size);
+      const int ay1 = min(gy1, ty * size + size - 1);
+      for (int y = ay0; y <= ay1; ++y) {
+        const float* src = &t->cells[static_cast<size_t>(y - ty * size) * tw
+                                     + (ax0 - tx * size)];
+        copy(src, src + (ax1 - ax0 + 1),
+             buf + static_cast<size_t>(y - gy0) * gw + (ax0 - gx0));
+      }
+      release(t);
+    }
+  }
+
+  if (!inside) {
+    for (int j = 0; j < h; ++j) {
+      const float* src
+        = &tmp[static_cast<size_t>(clamp(y0 + j, 0, height - 1) - gy0) * gw];
+      float* out = dst + static_cast<size_t>(j) * w;
+      for (int i = 0; i < w; ++i)
+        out[i] = src[clamp(x0 + i, 0, width - 1) - gx0];
+    }
+  }
+
+  {
+    lock_guard<mutex> l(lock);
+    // scans go top down until the windows show otherwise
+    const int dx = have_last ? sign(x0 - last_x0) : 0;
+    const int dy = have_last ? sign(y0 - last_y0) : 1;
+    last_x0 = x0;
+    last_y0 = y0;
+    have_last = true;
+    queue_prefetch(tx0, ty0, tx1, ty1, dx, dy);
+  }
+  wake.notify_one();
+  return true;
+} // TileCache::read
+
+TileCache::Tile*
+TileCache::acquire(const int tx, const int ty)
+{
+  unique_lock<mutex> l(lock);
+  unordered_map<long long, Tile*>::iterator it = tiles.find(key(tx, ty));
+  if (it != tiles.end()) {
+    Tile* t = it->second;
+    ++t->users;
+    order.splice(order.begin(), order, t->lru);
+    ++hits;
+    if (t->prefetched) {
+      ++prefetch_hits;
+      t->prefetched = false;
+    }
+    if (t->state == LOADING) {
+      ++waits;
+      loaded.wait(l, [t]() { return t->state != LOADING; });
+    }
+    if (t->state == FAILED) {
+      --t->users;
+      return 0;
+    }
+    return t;
+  }
+
+  ++misses;
+  Tile* t = insert(tx, ty);
+  ++t->users;
+  l.unlock();
+  const bool ok = load(t);
+  l.lock();
+  t->state = ok ? READY : FAILED;
+  loaded.notify_all();
+  if (!ok) {
+    --t->users;
+    return 0;
+  }
+  return t;
+} // TileCache::acquire
+
+void
+TileCache::release(Tile* t)
+{
+  lock_guard<mutex> l(lock);
+  --t->users;
+  evict();
+} // TileCache::release
+
+bool
+TileCache::load(Tile* t)
+{
+  lock_guard<mutex> l(io_lock);
+  const int tw = min(size, width - t->tx * size);
+  const int th = min(size, height - t->ty * size);
+  return reader(t->tx * size, t->ty * size, tw, th, &t->cells[0]);
+} // TileCache::load
+
+TileCache::Tile*
+TileCache::insert(const int tx, const int ty)
+{
+  Tile* t = new Tile;
+  t->tx = tx;
+  t->ty = ty;
+  t->state = LOADING;
+  t->users = 0;
+  t->prefetched = false;
+  t->cells.resize(static_cast<size_t>(min(size, width - tx * size))
+                  * min(size, height - ty * size));
+  order.push_front(t);
+  t->lru = order.begin();
+  tiles[key(tx, ty)] = t;
+  bytes += t->cells.size() * sizeof(float);
+  peak_bytes = max(peak_bytes, bytes);
+  evict();
+  return t;
+} // TileCache::insert
+
+void
+TileCache::evict()
+{
+  list<Tile*>::iterator it = order.end();
+  while (bytes > budget && it != order.begin()) {
+    --it;
+    Tile* t = *it;
+    if (t->users || t->state == LOADING)
+      continue;
+    bytes -= t->cells.size() * sizeof(float);
+    tiles.erase(key(t->tx, t->ty));
+    it = order.erase(it);
+    delete t;
+    ++evictions;
+  }
+} // TileCache::evict
+
+void
+TileCache::queue_prefetch(const int tx0, const int ty0, const int tx1,
+                          const int ty1, const int dx, const int dy)
+{
+  vector<long long> next;
+  if (dy) {
+    const int ty = dy > 0 ? ty1 + 1 : ty0 - 1;
+    for (int tx = tx0; tx <= tx1 && ty >= 0 && ty < nty; ++tx)
+      next.push_back(key(tx, ty));
+  }
+  if (dx) {
+    const int tx = dx > 0 ? tx1 + 1 : tx0 - 1;
+    for (int ty = ty0; ty <= ty1 && tx >= 0 && tx < ntx; ++ty)
+      next.push_back(key(tx, ty));
+  }
+  for (size_t i = 0; i < next.size(); ++i) {
+    if (!tiles.count(next[i])
+        && find(pending.begin(), pending.end(), next[i]) == pending.end())
+      pending.push_back(next[i]);
+  }
+} // TileCache::queue_prefetch
+
+void
+TileCache::prefetcher()
+{
+  unique_lock<mutex> l(lock);
+  for (;;) {
+    wake.wait(l, [this]() { return stop || !pending.empty(); });
+    if (stop)
+      break;
+    const long long k = pending.front();
+    pending.pop_front();
+    if (tiles.count(k))
+      continue;
+
+    Tile* t = insert(static_cast<int>(k % ntx), static_cast<int>(k / ntx));
+    t->prefetched = true;
+    ++t->users;
+    ++prefetches;
+    l.unlock();
+    const bool ok = load(t);
+    l.lock();
+    t->state = ok ? READY : FAILED;
+    --t->users;
+    loaded.notify_all();
+    evict();
+  }
+} // TileCache::prefetcher
+
+void
+TileCache::print(FILE* fp, const string& what) const
+{
+  const double MB = 1024.0 * 1024.0;
+  lock_guard<mutex> l(lock);
+  fprintf(fp, "%s: tile cache of %dx%d-cell tiles (%dx%d), %.1f MB budget,"
+          " %.1f MB peak\n"
+          "  %lld hits (%lld waited for a load), %lld misses, %lld evictions;"
+          " %lld prefetched, %lld of them used\n",
+          what.c_str(), size, size, ntx, nty, budget / MB, peak_bytes / MB,
+          hits, waits, misses, evictions, prefetches, prefetch_hits);
+} // TileCache::print
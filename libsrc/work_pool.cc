@@ -0,0 +1,194 @@
+// work-stealing pool for batch mode (see work_pool.h)
+
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "work_pool.h"
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// how long a thread with nothing to take waits before looking again;
+// short, but long enough not to take a core from the running jobs
+const chrono::microseconds IDLE_WAIT(200);
+
+// the calling thread's pool and worker number
+thread_local WorkPool* this_pool = 0;
+thread_local int       this_worker = -1;
+
+// tasks run by a task (in Group::wait()) count as part of its time
+thread_local int       depth = 0;
+
+} // namespace
+
+void
+WorkPool::Group::spawn(const Task& t)
+{
+  if (!pool) {
+    t();
+    return;
+  }
+  Entry e;
+  e.task = t;
+  e.group = this;
+  ++pending;
+  ++pool->pending;
+  const int self = this_pool == pool ? this_worker : -1;
+  Queue& q = self >= 0 ? *pool->queues[self] : *pool->queues.back();
+  lock_guard<mutex> lock(q.lock);
+  q.q.push_back(e);
+} // WorkPool::Group::spawn
+
+void
+WorkPool::Group::wait()
+{
+  if (!pool)
+    return;
+  const int self = this_pool == pool ? this_worker : -1;
+  while (pending > 0) {
+    Entry e;
+    if (pool->take(self, true, e))
+      pool->execute(self, e);
+    else
+      this_thread::sleep_for(IDLE_WAIT);
+  }
+} // WorkPool::Group::wait
+
+WorkPool::WorkPool(const int nworkers)
+  : stats(max(1, nworkers)), pending(0), wall(0)
+{
+  for (size_t i = 0; i <= stats.size(); ++i)
+    queues.push_back(unique_ptr<Queue>(new Queue));
+} // WorkPool::WorkPool
+
+void
+WorkPool::submit(const Task& job)
+{
+  Entry e;
+  e.task = job;
+  e.group = 0;
+  ++pending;
+  lock_guard<mutex> lock(jobs.lock);
+  jobs.q.push_back(e);
+} // WorkPool::submit
+
+bool
+WorkPool::take(const int self, const bool subtasks_only, Entry& e)
+{
+  // own subtasks first, newest first (their rows are still in cache)
+  if (self >= 0) {
+    Queue& q = *queues[self];
+    lock_guard<mutex> lock(q.lock);
+    if (!q.q.empty()) {
+      e = q.q.back();
+      q.q.pop_back();
+      return true;
+    }
+  }
+
+  if (!subtasks_only) {
+    lock_guard<mutex> lock(jobs.lock);
+    if (!jobs.q.empty()) {
+      e = jobs.q.front();
+      jobs.q.pop_front();
+      return true;
+    }
+  }
+
+  // steal the oldest subtask of another worker or outside thread
+  const int n = static_cast<int>(queues.size());
+  for (int k = 1; k <= n; ++k) {
+    const int v = (max(self, 0) + k) % n;
+    if (v == self)
+      continue;
+    Queue& q = *queues[v];
+    lock_guard<mutex> lock(q.lock);
+    if (!q.q.empty()) {
+      e = q.q.front();
+      q.q.pop_front();
+      if (self >= 0)
+        ++stats[self].steals;
+      return true;
+    }
+  }
+  return false;
+} // WorkPool::take
+
+void
+WorkPool::execute(const int self, Entry& e)
+{
+  const Clock::time_point t0 = Clock::now();
+  ++depth;
+  e.task();
+  --depth;
+  if (self >= 0) {
+    WorkerStats& s = stats[self];
+    if (!depth)
+      s.busy += chrono::duration<double>(Clock::now() - t0).count();
+    if (e.group)
+      ++s.subtasks;
+    else
+      ++s.jobs;
+  }
+  if (e.group)
+    --e.group->pending;
+  --pending;
+} // WorkPool::execute
+
+void
+WorkPool::worker(const int self)
+{
+  this_pool = this;
+  this_worker = self;
+  while (pending > 0) {
+    Entry e;
+    if (take(self, false, e))
+      execute(self, e);
+    else
+      this_thread::sleep_for(IDLE_WAIT);
+  }
+  this_pool = 0;
+  this_worker = -1;
+} // WorkPool::worker
+
+void
+WorkPool::run()
+{
+  const Clock::time_point t0 = Clock::now();
+  vector<thread> pool;
+  for (int t = 1; t < workers(); ++t)
+    pool.push_back(thread(&WorkPool::worker, this, t));
+  worker(0);
+  for (size_t t = 0; t < pool.size(); ++t)
+    pool[t].join();
+  wall = chrono::duration<double>(Clock::now() - t0).count();
+} // WorkPool::run
+
+WorkPool*
+WorkPool::current()
+{
+  return this_pool;
+} // WorkPool::current
+
+void
+WorkPool::report(FILE* fp) const
+{
+  fprintf(fp, "\nWorker utilization:\n");
+  fprintf(fp, "  %6s %9s %7s %5s %9s %7s\n",
+          "worker", "busy s", "util", "jobs", "subtasks", "stolen");
+  double busy(0);
+  for (size_t i = 0; i < stats.size(); ++i) {
+    const WorkerStats& s = stats[i];
+    busy += s.busy;
+    fprintf(fp, "  %6d %9.2f %6.1f%% %5d %9lld %7lld\n",
+            static_cast<int>(i + 1), s.busy,
+            wall > 0 ? 100 * s.busy / wall : 0.0,
+            s.jobs, s.subtasks, s.steals);
+  }
+  fprintf(fp, "  %.1f%% overall over %.2f s wall\n",
+          wall > 0 ? 100 * busy / (wall * stats.size()) : 0.0, wall);
+} // WorkPool::report
@@ -22,74 +22,449 @@
 // GA_Update).
 
 #include <string>
+#include <memory>  // unique_ptr
+#include <utility> // pair
+#include <chrono>
+#include <thread>
+#include <algorithm>
 #include <cstdlib> // atoi
 #include <cstdio>
 
 #include "SafeFormat.h"     // local library functions
+#include "pixel_pipeline.h" // local library functions
+#include "raster_kernels.h" // local library functions
+#include "raster_stats.h"   // local library functions
+#include "output_stages.h"  // local library functions
+#include "build_manifest.h" // local library functions
+#include "batch.h"          // local library functions
+#include "work_pool.h"      // local library functions
+#include "mosaic.h"         // local library functions
+#include "tile_cache.h"     // local library functions
+#include "dsp_tiles.h"      // local library functions
+#include "pyramid.h"        // local library functions
+#include "decimate.h"       // local library functions
+#include "resample.h"       // local library functions
+#include "reproject.h"      // local library functions
+#include "catalog.h"        // local library functions
 #include "gdal_priv.h"
 #include "cpl_conv.h"       // for CPLMalloc()
+#include "gdal_frmts.h"     // for GDALRegister_SDTS()
 #include "ogr_spatialref.h"
 
 using namespace std;
 using namespace Loki;   // local library functions
 
+// one input data set, while it is open
+struct Input {
+  string               ifil;
+  GDALDataset*         dataset;
+  OGRSpatialReference* sp;
+  double               scalex;    // cell size, meters
+  double               scaley;
+  double               scalez;    // meters per output height unit
+  double               adfGeoTransform[6];
+
+  explicit Input(const string& f)
+    : ifil(f), dataset(0), sp(0), scalex(0), scaley(0), scalez(0)
+  {}
+
+  ~Input()
+  {
+    delete sp;
+    if (dataset)
+      GDALClose(dataset);
+  }
+};
+
+// the conversion and output options (see the usage text)
+struct Options {
+  int                           chopel;
+  bool                          chop;
+  bool                          nodata;
+  double                        zscale;
+  double                        zstep;    // meters per height unit (0: 1 m,
+                                          // < 0: from the range)
+  bool                          stats;
+  int                           nbins;
+  bool                          incremental;
+  bool                          keep_pix;
+  bool                          stream;
+  int                           png_level;
+  bool                          hillshade;
+  HillshadeParams               shade;
+  size_t                        cache;  // tile cache bytes (0: X.asc)
+  DspTiling                     tiling;
+  int                           pyramid;  // levels (0: none)
+  double                        bot;      // mesh error, meters (0: none)
+  vector<Sightline>             los;
+  int                           los_bench;  // random sight lines (0: none)
+  int                           decimate; // factor (0: full grid)
+  DecimateMode                  decimate_mode;
+  double                        cell;     // resample to (0: as is)
+  ResampleKernel                kernel;
+  string                        project;  // target system ('': as is)
+  vector<pair<double, double> > views;
+  bool                          batch;  // no per-input report or file list
+  int                           threads;  // for each stage (0: all cores)
+};
+
+// the conversion of the whole grid to text rows, or (when streaming)
+// rows of X.dsp (see write_outputs())
+typedef function<bool(FILE*, DspRows*)> GridWriter;
+
 // local func decls
 void error_exit(const string& msg);
-void get_dataset_info();
+bool get_dataset_info(Input& in, const bool any_srs = false);
+bool square_cells(const Input& in);
 string get_spaces(const int);
 void show_node_and_children(const OGRSpatialReference* sp,
                             const OGR_SRSNode* parent,
                             const char* pname,
                             const int level
                             );
+void write_row(FILE* fp, const int* row, const int n, const int i);
+void write_row_debug(FILE* fp, const int* row, const int n, const int i);
+void format_row(string& s, const int* row, const int n);
+long long probe_cells(const string& ifil);
+bool hash_dataset_files(GDALDataset* dataset, Hash& h);
+bool convert_input(const string& ifil, const string& basename,
+                   const Options& opt, JobResult& r);
+bool convert_mosaic(const vector<string>& inputs, const string& basename,
+                    const Options& opt);
+double z_step(const Options& opt, const double zmin, const double zmax,
+              const string& what);
+unsigned pixel_options(const Options& opt, const bool has_nodata,
+                       const double nodata, const double zmin,
+                       const double zstep, PixelParams& params);
+Hash hash_conversion(const unsigned pixflags, const PixelParams& params,
+                     const string& what, Hash h);
+bool read_window(GDALRasterBand* band, const int x0, const int y0,
+                 const int w, const int h, const unsigned pixflags,
+                 const PixelParams& params, int* cells);
+void setup_outputs(OutputFiles& outs, const Options& opt, const Input& in,
+                   const int nx, const int ny);
+bool write_outputs(OutputFiles& outs, const Options& opt,
+                   const GridWriter& convert, const Hash input, JobResult& r);
+
 
 // global vars
-OGRSpatialReference* sp(0);
-GDALDataset* dataset(0);
 bool info(false);
 bool debug(false);
-int scalex;
-int scaley;
-int scalez;
-double adfGeoTransform[6];
+double driver_seconds(0);  // registering the GDAL drivers
 int az(35);
 int el(25);
 int pixsize(512*3);
 
+// converts every scanline of a band: read, transform and print, all at
+// the band's native cell type T (see dispatch_data_type())
+struct ConvertBand {
+  GDALRasterBand* band;
+  PixelParams     params;
+  unsigned        pixflags;   // PIX_* stages to run
+  FILE*           fp;         // the text rows (0: none)
+  void (*row_writer)(FILE*, const int*, const int, const int);
+  DspRows*        dsp;        // gets every converted row, if set
+  WorkPool*       pool;       // batch mode: split the rows into subtasks
+  Pyramid*        pyramid;    // gets every converted row, if set
+  // the float_nx by float_ny rows of a decimated or resampled grid,
+  // read instead of 'band', if set
+  function<bool(float*)> float_rows;
+  int             float_nx;
+  int             float_ny;
+  bool            failed;     // a read error
+
+  explicit ConvertBand(GDALRasterBand* b)
+    : band(b), pixflags(0), fp(stdout), row_writer(write_row), dsp(0),
+      pool(0), pyramid(0), float_nx(0), float_ny(0), failed(false)
+  {}
+
+  template <class T>
+  void run()
+  {
+    if (float_rows) {
+      run_float_rows();
+      return;
+    }
+    const int nx = band->GetXSize();
+    const int ny = band->GetYSize();
+    typename RowKernelTable<T>::Func row_kernel
+      = select_row_kernel<T>(pixflags);
+
+    if (pool && row_writer == write_row) {
+      run_chunks<T>(row_kernel, nx, ny);
+      return;
+    }
+
+    vector<T> scanline(nx);
+    vector<int> row(nx);
+    for (int i = 0; i < ny; ++i) {
+      // fill the scanline buffer
+      if (read_rows(band, i, 1, &scanline[0]) != CE_None) {
+        Printf("ERROR:  Unable to read row %d.\n")(i);
+        failed = true;
+        return;
+      }
+      // transform and print the scanline
+      row_kernel(&scanline[0], &row[0], nx, params);
+      put_row(&row[0], nx, i);
+    }
+  }
+
+  // a converted row to the text grid and whatever else takes them
+  void put_row(const int* row, const int nx, const int i)
+  {
+    if (fp)
+      row_writer(fp, row, nx, i);
+    if (dsp)
+      dsp->add_row(row);
+    if (pyramid)
+      pyramid->add_row(row);
+  }
+
+  // The decimated or resampled rows come as floats whatever the band's
+  // type (see decimate.h, resample.h), so they take the float kernels.
+  void run_float_rows()
+  {
+    const int nx = float_nx;
+    const int ny = float_ny;
+    RowKernelTable<float>::Func row_kernel = select_row_kernel<float>(pixflags);
+    vector<float> cells(nx);
+    vector<int> row(nx);
+    for (int i = 0; i < ny; ++i) {
+      if (!float_rows(&cells[0])) {
+        Printf("ERROR:  Unable to read row %d.\n")(i);
+        failed = true;
+        return;
+      }
+      row_kernel(&cells[0], &row[0], nx, params);
+      put_row(&row[0], nx, i);
+    }
+  }
+
+  // In batch mode the rows are read here, in order, a window of chunks
+  // at a time; transforming and printing each chunk (most of the time
+  // spent) is a subtask that workers done with their own inputs steal.
+  // The chunks' text is written in order once the window is done (and
+  // their rows go to the DSP and the pyramid in order).
+  template <class T>
+  void run_chunks(typename RowKernelTable<T>::Func row_kernel,
+                  const int nx, const int ny)
+  {
+    const int CHUNK_ROWS = 32;
+    const int window = 2 * pool->workers();
+    const bool keep = dsp || pyramid;
+    FILE* const text_fp = fp;
+    vector<vector<T> > cells(window);
+    vector<vector<int> > rows(window);
+    vector<string> text(window);
+    for (int i0 = 0; i0 < ny; i0 += window * CHUNK_ROWS) {
+      WorkPool::Group group(pool);
+      int k = 0;
+      for (int i = i0; i < ny && k < window; i += CHUNK_ROWS, ++k) {
+        const int nrows = min(CHUNK_ROWS, ny - i);
+        cells[k].resize(static_cast<size_t>(nx) * nrows);
+        rows[k].resize(static_cast<size_t>(nx) * (keep ? nrows : 1));
+        if (read_rows(band, i, nrows, &cells[k][0]) != CE_None) {
+          Printf("ERROR:  Unable to read rows %d to %d.\n")(i)(i + nrows - 1);
+          failed = true;
+          break;
+        }
+        const PixelParams& p = params;
+        const T* in = &cells[k][0];
+        int* row = &rows[k][0];
+        const size_t step = keep ? nx : 0;
+        string& out = text[k];
+        group.spawn([=, &p, &out]() {
+            for (int r = 0; r < nrows; ++r) {
+              int* dst = row + r * step;
+              row_kernel(in + static_cast<size_t>(r) * nx, dst, nx, p);
+              if (text_fp)
+                format_row(out, dst, nx);
+            }
+          });
+      }
+      group.wait();
+      if (failed)
+        return;
+      for (int j = 0; j < k; ++j) {
+        if (fp)
+          fwrite(text[j].data(), 1, text[j].size(), fp);
+        text[j].clear();
+        for (size_t r = 0; keep && r < rows[j].size(); r += nx) {
+          if (dsp)
+            dsp->add_row(&rows[j][r]);
+          if (pyramid)
+            pyramid->add_row(&rows[j][r]);
+        }
+      }
+    }
+  }
+};
+
+
 int
 main(int argc, char** argv)
 {
   if (argc < 2) {
-    Printf("Usage: %s <SDTS CATD file> [...options...]\n"
+    Printf("Usage: %s <SDTS CATD file>... [...options...]\n"
            "\n"
            "Without options, prints grid data in XY format to stdout and\n"
            "  pixel data to stderr.\n"
            "\n"
+           "Batch mode: given several inputs, a directory (searched for\n"
+           "  '*CATD.DDF') or '@listfile' (one input per line), converts them\n"
+           "  all in one process; '--name' is then a pattern in which '%%d' is\n"
+           "  the input's directory name, '%%b' its file name without the\n"
+           "  extension and '%%n' its number (default: '%%d').\n"
+           "\n"
            "Options:\n"
            "\n"
            "  --chop[=X]  Chop cell heights to a base level of X below the minimum\n"
            "                height (default: 1).  Note that X must be >= 1.\n"
            "  --name=X    Use 'X' as the base for output file names.  Outputs:\n"
            "                X.asc\n"
-           "                X-reversed.asc\n"
-           "                X.dsp\n"
-           "                X.g (with X.r inside, az/el: %d/%d)\n"
-           "                X.pix (%dx%d)\n"
-           "                X-az35-el45.png\n"
+           "                X.dsp (via 'tac X.asc | asc2dsp')\n"
+           "                X.g (with X.r inside)\n"
+           "                X-azA-elE.png (%dx%d) per view (default az/el: %d/%d)\n"
+           "  --views=A:E[,A:E...]\n"
+           "              With --name: render the views at azimuth A, elevation E\n"
+           "                (degrees), all from one prepared geometry.\n"
+           "  --turntable=N\n"
+           "              With --name: render N views evenly spaced in azimuth\n"
+           "                at the default elevation.\n"
+           "  --keep-pix  With --name: also keep the raw images (X-azA-elE.pix).\n"
+           "  --tile=WxH[,O]\n"
+           "              With --name: cut the grid into DSP tiles of at most\n"
+           "                W x H cells sharing O >= 1 edge rows and columns\n"
+           "                (default: 1), X-rR-cC.dsp, written in parallel; X.g\n"
+           "                holds one placed solid per tile in X.c.\n"
+           "  --pyramid[=N]\n"
+           "              With --name: also write N coarser levels (default:\n"
+           "                3), X-lodK.dsp 2^K times coarser (2x2 box means),\n"
+           "                from the same pass; X.g holds X-lodK.r for each.\n"
+           "  --bot[=E]   With --name: also write X-bot.g, the grid as a closed\n"
+           "                triangle mesh (X-bot.r) within E meters of every\n"
+           "                cell (default: 1), few triangles where it is flat.\n"
+           "  --los=X1,Y1,X2,Y2[,H]\n"
+           "              With --name: can a point H meters (default: 2) over\n"
+           "                cell X1,Y1 (column, row) see one H meters over\n"
+           "                X2,Y2?  Repeatable; answers go to X-los.txt.\n"
+           "  --los-bench[=N]\n"
+           "              With --name: also time N random sight lines (default:\n"
+           "                100000) through the min/max quadtree and by marching\n"
+           "                cell by cell.\n"
+           "  --stream    With --name: write X.dsp straight from the conversion\n"
+           "                instead of writing X.asc.\n"
+           "  --preview=hillshade\n"
+           "              With --name: instead of ray traced views, shade X.asc\n"
+           "                directly into X-hillshade.png (fast QA thumbnail).\n"
+           "  --sun=A[:E] Hillshade sun azimuth and altitude (default: 315:45).\n"
+           "  --multidirectional\n"
+           "              Hillshade: blend four suns 45 degrees apart.\n"
+           "  --ao[=R]    Hillshade: ambient occlusion over R cells (default: 8).\n"
+           "  --shadows   Hillshade: halve the light where the terrain hides the\n"
+           "                sun (no '--cache').\n"
+           "  --cache[=MB]\n"
+           "              Hillshade: read the cells from the data set through an\n"
+           "                MB tile cache (default: 256) instead of from X.asc,\n"
+           "                so rasters larger than memory can be shaded.\n"
+           "                '--bot' and '--los' read it too, but hold the\n"
+           "                whole grid in memory.\n"
+           "  --decimate=N[,mean|min|max]\n"
+           "              Convert the grid N times coarser each way, cells N times\n"
+           "                as far apart: from a band overview if there is a\n"
+           "                fine enough one, else each NxN block's mean (default),\n"
+           "                minimum or maximum, skipping no-data cells.  Square\n"
+           "                cells only.\n"
+           "  --cell=M[,nearest|bilinear|bicubic]\n"
+           "              Resample to square M meter cells (fractions allowed)\n"
+           "                with the given kernel (default: bilinear).  Grids\n"
+           "                whose cells aren't square are resampled to their\n"
+           "                smaller cell size without this.\n"
+           "  --project=utm|EPSG:N\n"
+           "              Reproject to north up square meter cells in the WGS 84\n"
+           "                UTM zone of the grid's center or in EPSG system N,\n"
+           "                for geographic (arc-second) DEMs; '--cell' sets the\n"
+           "                cell size and kernel (default: the grid's own cell\n"
+           "                size at its center, bilinear).\n"
+           "  --nodata    Set cells holding the band's no-data value to 0.\n"
+           "  --zscale=X  Multiply cell heights by X (default: 1).\n"
+           "  --zstep[=S] Write heights in steps of S meters (e.g. 0.1) instead\n"
+           "                of whole meters, rounded, the DSP solids scaled to\n"
+           "                match; without S the finest 1, 2 or 5 x 10^k step\n"
+           "                that fits the grid's heights into the DSP's 0-65535.\n"
+           "  --png-level=N\n"
+           "              PNG compression level, 0 (fastest) to 9 (smallest)\n"
+           "                (default: 6).\n"
+           "  --mosaic    Merge all inputs (adjacent quads on one cell grid) into\n"
+           "                one grid, read a few rows at a time; cells two\n"
+           "                inputs share get their mean.\n"
+           "  --jobs=N    Batch mode: convert N inputs at a time (default: all\n"
+           "                cores), largest first; workers with no input left\n"
+           "                help convert the rows of the others.  Each input's\n"
+           "                stages run on the cores divided by N.\n"
+           "  --incremental\n"
+           "              With --name: keep a manifest (X.manifest) of input hashes\n"
+           "                and option values, and only redo the output stages\n"
+           "                whose inputs changed.\n"
            "\n"
-           "  --info      Provides information about the input file and exits.\n"
+           "  --info[=json]\n"
+           "              Provides information about the input file and exits;\n"
+           "                reads the headers only, with just the SDTS driver.\n"
+           "                With 'json': one line of JSON instead of text; with\n"
+           "                several inputs, one line each as with '--catalog'.\n"
+           "  --catalog   Probe every input (CATD files, directories searched\n"
+           "                recursively, '@listfile's) like '--info' on all\n"
+           "                cores (see '--jobs') and write one JSON line per\n"
+           "                data set, in input order, to stdout.\n"
+           "  --stats[=N] With --info or --catalog: also computes exact min, max,\n"
+           "                mean, std dev, no-data count and an N-bin histogram\n"
+           "                (default: 16) using all cores.\n"
+           "  --all-drivers\n"
+           "              With --info or --catalog: register every GDAL driver,\n"
+           "                for inputs other than SDTS transfers.\n"
            "  --debug     For developer use: prints debug data to stdout\n"
            )
       (argv[0])
-      (az)(el)
       (pixsize)(pixsize)
+      (az)(el)
       ;
     exit(1);
   }
 
   int chopel(1);
   bool chop(false);
-  string ifil;
+  bool nodata(false);
+  double zscale(1);
+  double zstep(0);
+  bool stats(false);
+  bool all_drivers(false);
+  bool info_json(false);
+  bool catalog(false);
+  int nbins(16);
+  bool incremental(false);
+  bool keep_pix(false);
+  bool stream(false);
+  int png_level(6);
+  vector<pair<double, double> > views;
+  int turntable(0);
+  bool hillshade_preview(false);
+  bool shade_opts(false);
+  HillshadeParams shade;
+  int cache_mb(0);
+  DspTiling tiling;
+  int pyramid(0);
+  double bot(0);
+  vector<Sightline> los;
+  int los_bench(0);
+  int decimate(0);
+  DecimateMode decimate_mode(DECIMATE_MEAN);
+  double cell(0);
+  ResampleKernel kernel(RESAMPLE_BILINEAR);
+  string project;
+  int njobs(0);
+  bool mosaic(false);
+  vector<string> args;
   string basename;
   for (int i = 1; i < argc; ++i) {
     string arg(argv[i]);
@@ -107,16 +482,30 @@ main(int argc, char** argv)
       }
     }
     if (arg[0] == '-') {
-      if (arg.find("-i") != string::npos) {
+      // match whole option names: several options share a first letter
+      if (arg == "--info" || arg == "-i") {
         info = true;
+        if (val == "json") {
+          info_json = true;
+        }
+        else if (!val.empty()) {
+          Printf("FATAL:  Unknown info format '%s' (use 'json').\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--catalog") {
+        catalog = true;
       }
-      else if (arg.find("-d") != string::npos) {
+      else if (arg == "--all-drivers") {
+        all_drivers = true;
+      }
+      else if (arg == "--debug" || arg == "-d") {
         debug = true;
       }
-      else if (arg.find("-b") != string::npos) {
+      else if (arg == "--name" || arg == "-n" || arg == "-b") {
         basename = val;
       }
-      else if (arg.find("-c") != string::npos) {
+      else if (arg == "--chop" || arg == "-c") {
         chop = true;
         if (!val.empty()) {
           chopel = atoi(val.c_str());
@@ -126,41 +515,542 @@ main(int argc, char** argv)
           }
         }
       }
-    }
-    else if (ifil.empty()) {
-      // get the CATD file
-      ifil = arg;
+      else if (arg == "--stats") {
+        stats = true;
+        if (!val.empty()) {
+          nbins = atoi(val.c_str());
+          if (nbins < 1) {
+            Printf("FATAL:  Histogram bin count '%s' is less than 1.\n")(val);
+            exit(1);
+          }
+        }
+      }
+      else if (arg == "--incremental") {
+        incremental = true;
+      }
+      else if (arg == "--views") {
+        // az:el[,az:el...]
+        string::size_type beg(0);
+        while (beg <= val.size()) {
+          string::size_type end(val.find(',', beg));
+          if (end == string::npos)
+            end = val.size();
+          string v(val.substr(beg, end - beg));
+          double a, e;
+          char c;
+          if (sscanf(v.c_str(), "%lf:%lf%c", &a, &e, &c) != 2
+              || e < -90 || e > 90) {
+            Printf("FATAL:  View '%s' is not 'az:el'.\n")(v);
+            exit(1);
+          }
+          views.push_back(make_pair(a, e));
+          beg = end + 1;
+        }
+      }
+      else if (arg == "--turntable") {
+        turntable = atoi(val.c_str());
+        if (turntable < 1) {
+          Printf("FATAL:  Turntable view count '%s' is less than 1.\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--preview") {
+        if (val == "hillshade") {
+          hillshade_preview = true;
+        }
+        else if (val != "rt") {
+          Printf("FATAL:  Unknown preview '%s' (use 'rt' or 'hillshade').\n")
+            (val);
+          exit(1);
+        }
+      }
+      else if (arg == "--sun") {
+        shade_opts = true;
+        double a, e(shade.sun_alt);
+        char c;
+        int nv = sscanf(val.c_str(), "%lf:%lf%c", &a, &e, &c);
+        if ((nv != 1 && nv != 2) || (nv == 1 && val.find(':') != string::npos)
+            || e <= 0 || e > 90) {
+          Printf("FATAL:  Sun '%s' is not 'az[:alt]' (0 < alt <= 90).\n")(val);
+          exit(1);
+        }
+        shade.sun_az = a;
+        shade.sun_alt = e;
+      }
+      else if (arg == "--multidirectional") {
+        shade_opts = true;
+        shade.multi = true;
+      }
+      else if (arg == "--shadows") {
+        shade_opts = true;
+        shade.shadows = true;
+      }
+      else if (arg == "--ao") {
+        shade_opts = true;
+        shade.ao = true;
+        if (!val.empty()) {
+          shade.ao_radius = atoi(val.c_str());
+          if (shade.ao_radius < 1) {
+            Printf("FATAL:  Occlusion radius '%s' is less than 1.\n")(val);
+            exit(1);
+          }
+        }
+      }
+      else if (arg == "--cache") {
+        cache_mb = val.empty() ? 256 : atoi(val.c_str());
+        if (cache_mb < 1) {
+          Printf("FATAL:  Cache size '%s' is less than 1 MB.\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--pyramid") {
+        pyramid = val.empty() ? 3 : atoi(val.c_str());
+        if (pyramid < 1 || pyramid > 8) {
+          Printf("FATAL:  Pyramid levels '%s' not in 1-8.\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--bot") {
+        bot = val.empty() ? 1 : atof(val.c_str());
+        if (bot <= 0) {
+          Printf("FATAL:  Mesh error '%s' is not a positive number.\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--los") {
+        // X1,Y1,X2,Y2[,H]
+        Sightline s;
+        s.h = 2;
+        char c;
+        const int n = sscanf(val.c_str(), "%lf,%lf,%lf,%lf,%lf%c",
+                             &s.x1, &s.y1, &s.x2, &s.y2, &s.h, &c);
+        if ((n != 4 && n != 5) || s.h < 0) {
+          Printf("FATAL:  Sight line '%s' is not 'X1,Y1,X2,Y2[,H]'.\n")
+            (val);
+          exit(1);
+        }
+        los.push_back(s);
+      }
+      else if (arg == "--los-bench") {
+        los_bench = val.empty() ? 100000 : atoi(val.c_str());
+        if (los_bench < 1) {
+          Printf("FATAL:  Sight line count '%s' is less than 1.\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--decimate") {
+        // N[,mean|min|max]
+        const string::size_type comma = val.find(',');
+        const string mode(comma == string::npos ? "mean"
+                                                : val.substr(comma + 1));
+        decimate = atoi(val.substr(0, comma).c_str());
+        if (decimate < 2) {
+          Printf("FATAL:  Decimation '%s' is not a factor of 2 or more.\n")
+            (val);
+          exit(1);
+        }
+        if (mode == "mean")
+          decimate_mode = DECIMATE_MEAN;
+        else if (mode == "min")
+          decimate_mode = DECIMATE_MIN;
+        else if (mode == "max")
+          decimate_mode = DECIMATE_MAX;
+        else {
+          Printf("FATAL:  Decimation mode '%s' is not mean, min or max.\n")
+            (mode);
+          exit(1);
+        }
+      }
+      else if (arg == "--cell") {
+        // M[,nearest|bilinear|bicubic]
+        const string::size_type comma = val.find(',');
+        const string k(comma == string::npos ? "bilinear"
+                                             : val.substr(comma + 1));
+        cell = atof(val.substr(0, comma).c_str());
+        if (cell <= 0) {
+          Printf("FATAL:  Cell size '%s' is not a positive number.\n")(val);
+          exit(1);
+        }
+        if (k == "nearest")
+          kernel = RESAMPLE_NEAREST;
+        else if (k == "bilinear")
+          kernel = RESAMPLE_BILINEAR;
+        else if (k == "bicubic")
+          kernel = RESAMPLE_BICUBIC;
+        else {
+          Printf("FATAL:  Resampling kernel '%s' is not nearest, bilinear or"
+                 " bicubic.\n")(k);
+          exit(1);
+        }
+      }
+      else if (arg == "--project") {
+        // utm|EPSG:N
+        project = val;
+        if (project != "utm" && !(project.size() > 5
+                                  && (project.compare(0, 5, "EPSG:") == 0
+                                      || project.compare(0, 5, "epsg:") == 0)
+                                  && atoi(project.c_str() + 5) > 0)) {
+          Printf("FATAL:  Target system '%s' is not utm or EPSG:N.\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--tile") {
+        // WxH[,overlap]
+        char c;
+        int nv = sscanf(val.c_str(), "%dx%d,%d%c",
+                        &tiling.w, &tiling.h, &tiling.overlap, &c);
+        if ((nv != 2 && nv != 3) || (nv == 2 && val.find(',') != string::npos)
+            || tiling.w < 2 || tiling.h < 2 || tiling.overlap < 1
+            || tiling.overlap >= min(tiling.w, tiling.h)) {
+          Printf("FATAL:  Tile '%s' is not 'WxH[,overlap]' (W, H >= 2,"
+                 " 1 <= overlap < W, H).\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--jobs" || arg == "-j") {
+        njobs = atoi(val.c_str());
+        if (njobs < 1) {
+          Printf("FATAL:  Job count '%s' is less than 1.\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--mosaic") {
+        mosaic = true;
+      }
+      else if (arg == "--stream") {
+        stream = true;
+      }
+      else if (arg == "--keep-pix") {
+        keep_pix = true;
+      }
+      else if (arg == "--png-level") {
+        png_level = atoi(val.c_str());
+        if (val.empty() || png_level < 0 || png_level > 9) {
+          Printf("FATAL:  PNG level '%s' is not in 0-9.\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--nodata") {
+        nodata = true;
+      }
+      else if (arg == "--zscale") {
+        zscale = atof(val.c_str());
+        if (zscale <= 0) {
+          Printf("FATAL:  Z scale '%s' is not a positive number.\n")(val);
+          exit(1);
+        }
+      }
+      else if (arg == "--zstep") {
+        // bare: pick the step (-1); given: a number in (0, 1000]
+        zstep = -1;
+        char c;
+        if (!val.empty()
+            && (sscanf(val.c_str(), "%lf%c", &zstep, &c) != 1
+                || !(zstep > 0) || zstep > 1000)) {
+          Printf("FATAL:  Z step '%s' is not a number in (0, 1000].\n")(val);
+          exit(1);
+        }
+      }
+      else {
+        Printf("ERROR:  Unknown option '%s'...exiting.\n")(arg);
+        exit(1);
+      }
     }
     else {
-      Printf("ERROR:  Unknown arg '%s'...exiting.\n")(arg);
-      exit(1);
+      // a CATD file, a directory or an '@listfile'
+      args.push_back(arg);
     }
   }
 
-  bool dofils(basename.empty() ? false : true);
+  if ((shade_opts || cache_mb) && !hillshade_preview) {
+    Printf("ERROR:  Options '--sun', '--multidirectional', '--ao',"
+           " '--shadows' and '--cache' require '--preview=hillshade'"
+           "...exiting.\n");
+    exit(1);
+  }
+  if (shade.shadows && cache_mb) {
+    Printf("ERROR:  Option '--shadows' casts rays over the whole grid; it"
+           " takes no '--cache'...exiting.\n");
+    exit(1);
+  }
+  if (hillshade_preview && (turntable || !views.empty() || keep_pix)) {
+    Printf("ERROR:  Options '--views', '--turntable' and '--keep-pix' need"
+           " the ray traced preview...exiting.\n");
+    exit(1);
+  }
+  const bool reads_asc(hillshade_preview || bot || !los.empty() || los_bench);
+  if (stream && ((reads_asc && !cache_mb) || debug)) {
+    Printf("ERROR:  Option '--stream' writes no X.asc for"
+           " '--preview=hillshade', '--bot' or '--los' (without '--cache')"
+           " or '--debug'...exiting.\n");
+    exit(1);
+  }
+  if (cell && (decimate || info || mosaic || tiling.w || cache_mb)) {
+    Printf("ERROR:  Option '--cell' takes no '--decimate', '--info',"
+           " '--mosaic', '--tile' or '--cache'...exiting.\n");
+    exit(1);
+  }
+  if (!project.empty() && (decimate || info || mosaic || tiling.w || cache_mb)) {
+    Printf("ERROR:  Option '--project' takes no '--decimate', '--info',"
+           " '--mosaic', '--tile' or '--cache'...exiting.\n");
+    exit(1);
+  }
+  if (decimate && (info || mosaic || tiling.w || cache_mb)) {
+    Printf("ERROR:  Option '--decimate' takes no '--info', '--mosaic',"
+           " '--tile' or '--cache'...exiting.\n");
+    exit(1);
+  }
+  if (tiling.w && (stream || mosaic)) {
+    Printf("ERROR:  Option '--tile' takes no '--stream' or '--mosaic'"
+           "...exiting.\n");
+    exit(1);
+  }
+  if (turntable && !views.empty()) {
+    Printf("ERROR:  Options '--views' and '--turntable' conflict...exiting.\n");
+    exit(1);
+  }
+  for (int i = 0; i < turntable; ++i)
+    views.push_back(make_pair(az + i * 360.0 / turntable, double(el)));
+  if (views.empty())
+    views.push_back(make_pair(double(az), double(el)));
+
+  if ((stats || all_drivers) && !(info || catalog)) {
+    Printf("ERROR:  Options '--stats' and '--all-drivers' require '--info'"
+           " or '--catalog'...exiting.\n");
+    exit(1);
+  }
+  if (catalog && (info || !basename.empty() || mosaic || debug)) {
+    Printf("ERROR:  Option '--catalog' only probes; it takes no '--info',"
+           " '--name', '--mosaic' or '--debug'...exiting.\n");
+    exit(1);
+  }
 
-  if (ifil.empty()) {
+  if (args.empty()) {
     Printf("ERROR:  No input file was entered...exiting.\n");
     exit(1);
   }
 
+  vector<string> inputs;
+  bool expanded(false);
+  if (!collect_inputs(args, inputs, expanded))
+    exit(1);
+  if (mosaic && (info || njobs || cache_mb)) {
+    Printf("ERROR:  Option '--mosaic' makes one grid; it takes no '--info',"
+           " '--jobs' or '--cache'...exiting.\n");
+    exit(1);
+  }
+  const bool batch(!mosaic && (inputs.size() > 1 || expanded || njobs));
+
+  if (batch && (info || debug)) {
+    Printf("ERROR:  Options '--info' and '--debug' take one input...exiting.\n");
+    exit(1);
+  }
+  if (batch && basename.empty())
+    basename = "%d";
+  if (tiling.w && basename.empty()) {
+    Printf("ERROR:  Option '--tile' requires '--name'...exiting.\n");
+    exit(1);
+  }
+  if (pyramid && basename.empty()) {
+    Printf("ERROR:  Option '--pyramid' requires '--name'...exiting.\n");
+    exit(1);
+  }
+  if (bot && basename.empty()) {
+    Printf("ERROR:  Option '--bot' requires '--name'...exiting.\n");
+    exit(1);
+  }
+  if ((!los.empty() || los_bench) && basename.empty()) {
+    Printf("ERROR:  Options '--los' and '--los-bench' require '--name'"
+           "...exiting.\n");
+    exit(1);
+  }
+
   // debug
   if (0) {
     Printf("DEBUG: early exit.\n");
     exit(1);
   }
 
-  GDALAllRegister();
-  dataset = static_cast<GDALDataset*>(GDALOpen(ifil.c_str(), GA_ReadOnly));
+  Options opt;
+  opt.chopel = chopel;
+  opt.chop = chop;
+  opt.nodata = nodata;
+  opt.zscale = zscale;
+  opt.zstep = zstep;
+  opt.stats = stats;
+  opt.nbins = nbins;
+  opt.incremental = incremental;
+  opt.keep_pix = keep_pix;
+  opt.stream = stream;
+  opt.png_level = png_level;
+  opt.hillshade = hillshade_preview;
+  opt.shade = shade;
+  opt.cache = static_cast<size_t>(cache_mb) << 20;
+  opt.tiling = tiling;
+  opt.pyramid = pyramid;
+  opt.bot = bot;
+  opt.los = los;
+  opt.los_bench = los_bench;
+  opt.decimate = decimate;
+  opt.decimate_mode = decimate_mode;
+  opt.cell = cell;
+  opt.kernel = kernel;
+  opt.project = project;
+  opt.views = views;
+  opt.batch = batch;
+  opt.threads = 0;
+
+  // '--info' reads headers only: registering every driver (and
+  // loading the plugins) would cost more than opening one transfer,
+  // and nothing needs the directory listed to find the files (the CATD
+  // module names them)
+  typedef chrono::steady_clock Clock;
+  const Clock::time_point treg = Clock::now();
+  if ((info || catalog) && !all_drivers) {
+    GDALRegister_SDTS();
+    CPLSetConfigOption("GDAL_DISABLE_READDIR_ON_OPEN", "EMPTY_DIR");
+  }
+  else
+    GDALAllRegister();
+  driver_seconds = chrono::duration<double>(Clock::now() - treg).count();
+
+  // '--info=json' on several inputs: the same records, one a line
+  if (catalog || (info_json && batch)) {
+    const int nworkers = njobs ? njobs
+      : static_cast<int>(thread::hardware_concurrency());
+    const Clock::time_point t0 = Clock::now();
+    const int nfailed = write_catalog(inputs, stats ? nbins : 0, nworkers,
+                                      stdout);
+    // stdout holds the records only
+    fprintf(stderr, "Catalogued %d data set%s (%d failed) in %.2f s.\n",
+            static_cast<int>(inputs.size()), inputs.size() > 1 ? "s" : "",
+            nfailed, chrono::duration<double>(Clock::now() - t0).count());
+    exit(nfailed ? 1 : 0);
+  }
+  if (info_json) {
+    DatasetInfo d;
+    const bool ok = probe_dataset(inputs[0], stats ? nbins : 0, 0, d);
+    printf("%s\n", to_json(d).c_str());
+    exit(ok ? 0 : 1);
+  }
+
+  if (mosaic) {
+    bool ok = convert_mosaic(inputs, output_name(basename, inputs[0], 0),
+                             opt);
+    exit(ok ? 0 : 1);
+  }
+
+  if (!batch) {
+    JobResult r;
+    bool ok = convert_input(inputs[0], output_name(basename, inputs[0], 0),
+                            opt, r);
+    exit(ok ? 0 : 1);
+  }
+
+  // Batch mode: every input gets its own data set handle, task graph
+  // and outputs; GDAL drivers are registered once for all of them.
+  const int n = static_cast<int>(inputs.size());
+  vector<JobResult> results(n);
+  vector<string> names(n);
+  for (int i = 0; i < n; ++i) {
+    names[i] = output_name(basename, inputs[i], i);
+    for (int j = 0; j < i; ++j) {
+      if (names[j] == names[i]) {
+        Printf("ERROR:  Inputs '%s' and '%s' both map to '%s' (see '--name')"
+               "...exiting.\n")(inputs[j])(inputs[i])(names[i]);
+        exit(1);
+      }
+    }
+  }
+
+  const int ncores = max(1, static_cast<int>(thread::hardware_concurrency()));
+  const int nworkers = njobs ? min(njobs, n) : max(1, min(n, ncores));
+  // every job's stages share out the cores the other workers leave
+  opt.threads = max(1, ncores / nworkers);
+  Printf("Converting %d inputs on %d worker%s, %d thread%s each.\n")
+    (n)(nworkers)(nworkers > 1 ? "s" : "")
+    (opt.threads)(opt.threads > 1 ? "s" : "");
+  const Clock::time_point t0 = Clock::now();
+
+  // Largest first, by cell count from the headers (opening an SDTS
+  // transfer reads no cells), so no big input starts last and keeps
+  // one worker busy long after the others have run out; the tail that
+  // is left is shared out as row subtasks (see ConvertBand).
+  vector<long long> cost(n);
+  run_pool(n, nworkers, [&](const int i) {
+      cost[i] = probe_cells(inputs[i]);
+    });
+  vector<int> order(n);
+  for (int i = 0; i < n; ++i)
+    order[i] = i;
+  stable_sort(order.begin(), order.end(), [&](const int a, const int b) {
+      return cost[a] > cost[b];
+    });
+
+  WorkPool pool(nworkers);
+  for (int k = 0; k < n; ++k) {
+    const int i = order[k];
+    pool.submit([&, i]() {
+        const Clock::time_point t1 = Clock::now();
+        JobResult& r = results[i];
+        convert_input(inputs[i], names[i], opt, r);
+        r.seconds = chrono::duration<double>(Clock::now() - t1).count();
+        Printf("%s: %s (%.2f s)\n")
+          (inputs[i])(r.ok ? "ok" : "FAILED")(r.seconds);
+      });
+  }
+  pool.run();
+  const double wall = chrono::duration<double>(Clock::now() - t0).count();
+
+  print_summary(stdout, results, nworkers, wall);
+  pool.report(stdout);
+  int nfailed(0);
+  for (int i = 0; i < n; ++i)
+    nfailed += results[i].ok ? 0 : 1;
+  exit(nfailed ? 1 : 0);
+} // main
+
+bool
+convert_input(const string& ifil, const string& basename, const Options& opt,
+              JobResult& r)
+{
+  r.input = ifil;
+  r.name = basename;
+  bool dofils(basename.empty() ? false : true);
+
+  Input in(ifil);
+  typedef chrono::steady_clock Clock;
+  const Clock::time_point topen = Clock::now();
+  in.dataset
+    = static_cast<GDALDataset*>(GDALOpen(ifil.c_str(), GA_ReadOnly));
+  const double open_seconds
+    = chrono::duration<double>(Clock::now() - topen).count();
   // Note that if GDALOpen() returns NULL it means the open failed,
   // and that an error messages will already have been emitted via
   // CPLError().
-  if (!dataset) {
-    Printf("ERROR:  Input file '%s' not found...exiting.\n")(ifil);
-    exit(1);
+  if (!in.dataset) {
+    Printf("ERROR:  Input file '%s' not found.\n")(ifil);
+    if (info && GDALGetDriverCount() == 1)
+      Printf("        Not an SDTS transfer?  See '--all-drivers'.\n");
+    r.error = "not found";
+    return false;
   }
+  GDALDataset* dataset = in.dataset;
+  if (info) {
+    const int nd = GDALGetDriverCount();
+    printf("Opened in %.1f ms (%d driver%s registered in %.1f ms).\n",
+           open_seconds * 1000, nd, nd > 1 ? "s" : "", driver_seconds * 1000);
+  }
+
+  char** flist = dataset->GetFileList();
+  for (int i = 0; flist && flist[i]; ++i)
+    r.in_bytes += file_size(flist[i]);
+  CSLDestroy(flist);
 
-  get_dataset_info();
+  if (!get_dataset_info(in, !opt.project.empty())) {
+    r.error = "unsupported grid";
+    return false;
+  }
 
 
   // Fetching a Raster Band
@@ -200,20 +1090,60 @@ main(int argc, char** argv)
   int nx = band->GetXSize();
   int ny = band->GetYSize();
 
-  string Stdout, Stderr;
-
-  FILE* fp1(0);
-  FILE* fp2(0);
-  vector<string> fils;
-  if (!basename.empty()) {
-    Stdout = basename + ".asc";
-    Stderr = basename + ".info";
-    fils.push_back(Stdout);
-    fils.push_back(Stderr);
-
-    fp1 = fopen(Stdout.c_str(), "w");
-    fp2 = fopen(Stderr.c_str(), "w");
+  // '--decimate', '--project' or '--cell' (or cells that aren't
+  // square): the grid the rest of the conversion sees
+  unique_ptr<Decimator> decimator;
+  unique_ptr<Reprojector> reprojector;
+  unique_ptr<Resampler> resampler;
+  if (opt.decimate) {
+    // the blocks are N x N cells: unequal cells would stay unequal, and
+    // the DSP (one cell size for both axes) would come out distorted
+    if (!square_cells(in)) {
+      Printf("ERROR:  Cells of '%s' are %g m x %g m; '--decimate' takes"
+             " square cells only.\n")(ifil)(in.scalex)(in.scaley);
+      r.error = "cells need resampling";
+      return false;
+    }
+    decimator.reset(new Decimator(band, opt.decimate, opt.decimate_mode,
+                                  success != 0, no_data_value));
+    nx = decimator->nx();
+    ny = decimator->ny();
+    in.scalex *= opt.decimate;
+    in.scaley *= opt.decimate;
   }
+  else if (!opt.project.empty()) {
+    reprojector.reset(new Reprojector);
+    if (!reprojector->setup(dataset, opt.project, opt.cell, opt.kernel,
+                            ifil, opt.threads)) {
+      r.error = "unable to reproject";
+      return false;
+    }
+    nx = reprojector->nx();
+    ny = reprojector->ny();
+    in.scalex = in.scaley = reprojector->cell();
+  }
+  else if (!info && (opt.cell || !square_cells(in))) {
+    double cell = opt.cell;
+    if (!cell) {
+      cell = min(in.scalex, in.scaley);
+      Printf("WARNING:  Cells of '%s' are %g m x %g m; resampling to %g m"
+             " (see '--cell').\n")(ifil)(in.scalex)(in.scaley)(cell);
+    }
+    if (opt.tiling.w || opt.cache) {
+      Printf("ERROR:  Options '--tile' and '--cache' read the cells of '%s'"
+             " as they are; they take no resampling.\n")(ifil);
+      r.error = "cells need resampling";
+      return false;
+    }
+    resampler.reset(new Resampler(band, in.scalex, in.scaley, cell,
+                                  opt.kernel, success != 0, no_data_value,
+                                  opt.threads));
+    nx = resampler->nx();
+    ny = resampler->ny();
+    in.scalex = in.scaley = cell;
+  }
+  r.nx = nx;
+  r.ny = ny;
 
   if (info) {
     printf("Block=%dx%d Type=%s, ColorInterp=%s\n",
@@ -223,16 +1153,6 @@ main(int argc, char** argv)
              band->GetColorInterpretation())
            );
   }
-  else {
-    if (dofils) {
-      fprintf(fp2, "pixels: %d wide X %d high; scale: %d m X %d m X %d m\n",
-              nx, ny, scalex, scaley, scalez);
-    }
-    else {
-      fprintf(stderr, "pixels: %d wide X %d high; scale: %d m X %d m X %d m\n",
-              nx, ny, scalex, scaley, scalez);
-    }
-  }
 
   if (info) {
     if (nx != nBlockXSize) {
@@ -246,11 +1166,14 @@ main(int argc, char** argv)
   adfMinMax[0] = band->GetMinimum(&bGotMin);
   adfMinMax[1] = band->GetMaximum(&bGotMax);
 
-  if (!(bGotMin && bGotMax))
-    GDALComputeRasterMinMax((GDALRasterBandH)band, TRUE, adfMinMax);
-
+  // no pixel scan for the header's info: the exact range is part of
+  // '--stats'
   if (info) {
-    printf("Min=%.3f, Max=%.3f\n", adfMinMax[0], adfMinMax[1]);
+    if (bGotMin && bGotMax)
+      printf("Min=%.3f, Max=%.3f\n", adfMinMax[0], adfMinMax[1]);
+    else
+      printf("Min, Max: not in the header%s\n",
+             opt.stats ? "" : " (see '--stats')");
 
     if (band->GetOverviewCount() > 0)
       printf("Band has %d overviews.\n", band->GetOverviewCount());
@@ -259,8 +1182,22 @@ main(int argc, char** argv)
       printf("Band has a color table with %d entries.\n",
              band->GetColorTable()->GetColorEntryCount());
 
+    if (opt.stats) {
+      BandStats bs(ifil, band, opt.nbins, opt.threads);
+      if (!dispatch_data_type(band->GetRasterDataType(), bs))
+        error_exit("unsupported cell data type for '--stats'");
+      if (bs.failed) {
+        Printf("ERROR:  Unable to read the cells of '%s' for '--stats'.\n")
+          (ifil);
+        r.error = "read error";
+        return false;
+      }
+      bs.result.print(stdout);
+    }
+
     Printf("\nEarly exit for '--info' option.\n");
-    exit(0);
+    r.ok = true;
+    return true;
   }
 
   // Reading Raster Data
@@ -269,190 +1206,191 @@ main(int argc, char** argv)
   // There are a few ways to read raster data, but the most common is
   // via the GDALRasterBand::RasterIO() method. This method will
   // automatically take care of data type conversion, up/down sampling
-  // and windowing. The following code will read the first scanline of
-  // data into a similarly sized buffer, converting it to floating
-  // point as part of the operation.
-
-  float* scanline;
-  int    nXSize = band->GetXSize();
-
-  scanline = (float*)CPLMalloc(sizeof(float)*nXSize);
-  band->RasterIO(GF_Read,     // Either GF_Read to read a region of
-                              // data, or GF_Write to write a region
-                              // of data.
-                 0,           // The pixel offset to the top left
-                              // corner of the region of the band to
-                              // be accessed. This would be zero to
-                              // start from the left side.
-                 0,           // The line offset to the top left
-                              // corner of the region of the band to
-                              // be accessed. This would be zero to
-                              // start from the top.
-                 nXSize,      // The width of the region of the band
-                              // to be accessed in pixels.
-                 1,           // The height of the region of the band
-                              // to be accessed in lines.
-                 scanline,    // The buffer into which the data should
-                              // be read, or from which it should be
-                              // written. This buffer must contain at
-                              // least nBufXSize * nBufYSize words of
-                              // type eBufType. It is organized in
-                              // left to right, top to bottom pixel
-                              // order. Spacing is controlled by the
-                              // nPixelSpace, and nLineSpace
-                              // parameters.
-                 nXSize,      // The width of the buffer image into
-                              // which the desired region is to be
-                              // read, or from which it is to be
-                              // written.
-                 1,           // The height of the buffer image into
-                              // which the desired region is to be
-                              // read, or from which it is to be
-                              // written.
-                 GDT_Float32, // The type of the pixel values in the
-                              // pData data buffer. The pixel values
-                              // will automatically be translated
-                              // to/from the GDALRasterBand data type
-                              // as needed.
-                 0,           // The byte offset from the start of one
-                              // pixel value in pData to the start of
-                              // the next pixel value within a
-                              // scanline. If defaulted (0) the size
-                              // of the datatype eBufType is used.
-                 0            // The byte offset from the start of one
-                              // scanline in pData to the start of the
-                              // next. If defaulted (0) the size of
-                              // the datatype eBufType * nBufXSize is
-                              // used.
-                 );
-
-  // work all scanlines
-  for (int i = 0; i < ny; ++i) {
-    // fill the scanline buffer
-    band->RasterIO(GF_Read,
-                   0,
-                   i, // the scanline number
-                   nXSize,
-                   1,
-                   scanline,
-                   nXSize,
-                   1,
-                   GDT_Float32,
-                   0,
-                   0
-                   );
-    // read the scanline
-    for (int j = 0; j < nx; ++j) {
-      int p = static_cast<int>(scanline[j]);
-
-      if (chop) {
-        // adjust elevation
-        p -= static_cast<int>(floor(adfMinMax[0])) + chopel;
-
-      }
-      // debug
-      if (debug) {
-        if (p < 0)
-          continue;
-        Printf("pixel[%d,%d] = %d\n")(j)(i)(p);
-      }
-      else {
-        // print a "pixel"
-        if (p < 0)
-          p = 0;
-        if (dofils)
-          fprintf(fp1, " %d", p);
-        else
-          printf(" %d", p);
-      }
-    }
-    if (dofils) {
-      fprintf(fp1, "\n");
+  // and windowing.  We ask for the band's own data type (see
+  // read_rows() in raster_kernels.h) so no conversion is done: each
+  // data type gets its own instantiation of the conversion kernels.
+
+  GDALDataType dtype = band->GetRasterDataType();
+
+  // chop needs the exact minimum, '--zstep' the range; read them
+  // natively if they aren't stored
+  if ((opt.chop || opt.zstep) && !(bGotMin && bGotMax)) {
+    BandMinMax mm(band);
+    if (!dispatch_data_type(dtype, mm)) {
+      Printf("ERROR:  Cell data type '%s' is not supported.\n")
+        (GDALGetDataTypeName(dtype));
+      r.error = "unsupported cell type";
+      return false;
     }
-    else {
-      printf("\n");
+    if (mm.err != CE_None) {
+      Printf("ERROR:  Unable to read the cells of '%s'.\n")(ifil);
+      r.error = "read error";
+      return false;
     }
+    adfMinMax[0] = mm.minmax[0];
+    adfMinMax[1] = mm.minmax[1];
   }
 
-  CPLFree(scanline);
-  GDALClose(dataset);
-  if (fp1)
-    fclose(fp1);
-  if (fp2)
-    fclose(fp2);
-
-  // now do the mged trick
-  if (dofils) {
-    string rfil(basename + "-reversed.asc");
-    string dfil(basename + ".dsp");
-    fils.push_back(rfil);
-    fils.push_back(dfil);
-
-    string cmd;
-    SPrintf(cmd, "tac %s > %s")(Stdout)(rfil);
-    system(cmd.c_str());
-
-    cmd.clear();
-    SPrintf(cmd, "asc2dsp %s %s")(rfil)(dfil);
-    system(cmd.c_str());
-
-    string mfil(basename + ".mged");
-    fils.push_back(mfil);
-
-    FILE* fp = fopen(mfil.c_str(), "w");
-    string solid(basename + ".s");
-    string region(basename + ".r");
-    FPrintf(fp,
-            "units m\n"
-            "in %s dsp f %s %d %d 0 ad %d 1\n"
-            "r %s u %s\n"
-            )
-      (solid)(dfil)(nx)(ny)(scalex)
-      (region)(solid)
-      ;
-    fclose(fp);
-
-    // run the mged script
-    string gfil(basename + ".g");
-    fils.push_back(gfil);
-    cmd.clear();
-    unlink(gfil.c_str());
-    SPrintf(cmd, "mged -c %s < '%s'")(gfil)(mfil);
-    system(cmd.c_str());
-
-    // create the images
-    string pixfil;
-    SPrintf(pixfil, "%s-az%d-el%d.pix")(basename)(az)(el);
-    fils.push_back(pixfil);
-    string pngfil;
-    SPrintf(pngfil, "%s-az%d-el%d.png")(basename)(az)(el);
-    fils.push_back(pngfil);
-
-    unlink(pixfil.c_str());
-    unlink(pngfil.c_str());
-
-    cmd.clear();
-    SPrintf(cmd, "rt -R -o %s -s%d -a%d -e%d %s %s 1>/dev/null 2>/dev/null")
-      (pixfil)(pixsize)(az)(el)(gfil)(region)
-      ;
-    system(cmd.c_str());
+  in.scalez = z_step(opt, adfMinMax[0], adfMinMax[1], ifil);
+  if (!dofils) {
+    fprintf(stderr, "pixels: %d wide X %d high; scale: %g m X %g m X %g m\n",
+            nx, ny, in.scalex, in.scaley, in.scalez);
+  }
 
-    cmd.clear();
-    SPrintf(cmd, "pix-png -s%d %s > %s")
-      (pixsize)(pixfil)(pngfil)
-      ;
-    system(cmd.c_str());
+  ConvertBand conv(band);
+  conv.pixflags = pixel_options(opt, success != 0, no_data_value,
+                                adfMinMax[0], in.scalez, conv.params);
+  if (reprojector) {
+    // cells off the data set are always masked, as in a mosaic
+    conv.pixflags
+      = pixel_options(opt, true, Reprojector::NODATA, adfMinMax[0],
+                      in.scalez, conv.params) | PIX_MASK;
+    conv.params.nodata = Reprojector::NODATA;
+  }
+  conv.row_writer = debug ? write_row_debug : write_row;
+  conv.fp = stdout;
+  conv.pool = WorkPool::current();
+  conv.float_nx = nx;
+  conv.float_ny = ny;
+  if (decimator)
+    conv.float_rows = [&](float* row) { return decimator->read_row(row); };
+  if (reprojector)
+    conv.float_rows = [&](float* row) { return reprojector->read_row(row); };
+  if (resampler)
+    conv.float_rows = [&](float* row) { return resampler->read_row(row); };
+
+  if (!dofils) {
+    // work all scanlines
+    if (!dispatch_data_type(dtype, conv)) {
+      Printf("FATAL:  Cell data type '%s' is not supported.\n")
+        (GDALGetDataTypeName(dtype));
+      r.error = "unsupported cell type";
+      return false;
+    }
+    if (decimator)
+      decimator->print(stderr, ifil);
+    if (reprojector)
+      reprojector->print(stderr, ifil);
+    if (resampler)
+      resampler->print(stderr, ifil);
+    if (conv.failed) {
+      r.error = "read error";
+      return false;
+    }
+    r.ok = true;
+    return true;
+  }
 
+  // The conversion key covers the input files and every option the
+  // conversion uses; the later stages chain onto it.
+  Hash input = HASH_SEED;
+  if (opt.incremental) {
+    if (!hash_dataset_files(dataset, input)) {
+      Printf("ERROR:  Unable to hash the input data set '%s'.\n")(ifil);
+      r.error = "unreadable input";
+      return false;
+    }
+    input = hash_conversion(conv.pixflags, conv.params,
+                            GDALGetDataTypeName(dtype), input);
+    if (decimator) {
+      input = hash_int(opt.decimate, input);
+      input = hash_int(opt.decimate_mode, input);
+      input = hash_int(decimator->overview(), input);
+    }
+    if (reprojector) {
+      input = hash_string(reprojector->target(), input);
+      input = hash_bytes(&in.scalex, sizeof(in.scalex), input);
+      input = hash_int(opt.kernel, input);
+    }
+    if (resampler) {
+      input = hash_bytes(&in.scalex, sizeof(in.scalex), input);
+      input = hash_int(opt.kernel, input);
+    }
   }
-  if (dofils && !fils.empty()) {
-    unsigned nf = fils.size();
-    string s(nf > 1 ? "s" : "");
-    Printf("Normal end.  See file%s:\n")(s);
-    for (unsigned i = 0; i < nf; ++i) {
-      Printf("  %s\n")(fils[i]);
+
+  OutputFiles outs(basename, pixsize);
+  setup_outputs(outs, opt, in, nx, ny);
+  Pyramid pyramid(nx, outs.lods);
+  if (!outs.lods.empty())
+    conv.pyramid = &pyramid;
+
+  // With '--cache' the hillshade stage reads the cells through a tile
+  // cache on a handle of its own (the conversion reads this one at the
+  // same time), with the conversion's pixel operations applied so it
+  // shades the values X.asc holds.
+  Input cached(ifil);
+  unique_ptr<TileCache> cache;
+  if (opt.cache) {
+    cached.dataset
+      = static_cast<GDALDataset*>(GDALOpen(ifil.c_str(), GA_ReadOnly));
+    if (!cached.dataset) {
+      Printf("ERROR:  Unable to open '%s' again for the tile cache.\n")(ifil);
+      r.error = "not found";
+      return false;
     }
+    GDALRasterBand* cband = cached.dataset->GetRasterBand(1);
+    const unsigned pixflags = conv.pixflags;
+    const PixelParams params = conv.params;
+    cache.reset(new TileCache(nx, ny,
+      [=](const int x0, const int y0, const int w, const int h, float* dst) {
+        vector<int> cells(static_cast<size_t>(w) * h);
+        if (!read_window(cband, x0, y0, w, h, pixflags, params, &cells[0]))
+          return false;
+        copy(cells.begin(), cells.end(), dst);
+        return true;
+      }, opt.cache));
+    TileCache* tiles = cache.get();
+    outs.grid = [tiles, nx](const int y0, const int nrows, float* dst) {
+      return tiles->read(0, y0, nx, nrows, dst);
+    };
   }
 
+  // '--tile': the tile writers read their cells from handles of their
+  // own, one per thread, opened on first use; write_tiles() runs as
+  // many writers as the stages get threads
+  const int nwriters = outs.threads > 0 ? outs.threads
+    : max(1, static_cast<int>(thread::hardware_concurrency()));
+  vector<unique_ptr<Input> > handles(nwriters);
+  if (!outs.tiles.empty()) {
+    outs.tile_cells = [&](const int w, const DspTile& t, vector<int>& cells) {
+      unique_ptr<Input>& h = handles[w];
+      if (!h) {
+        h.reset(new Input(ifil));
+        h->dataset
+          = static_cast<GDALDataset*>(GDALOpen(ifil.c_str(), GA_ReadOnly));
+      }
+      return h->dataset
+        && read_window(h->dataset->GetRasterBand(1), t.x0, t.y0, t.nx, t.ny,
+                       conv.pixflags, conv.params, &cells[0]);
+    };
+  }
+
+  bool ok = write_outputs(outs, opt, [&](FILE* fp, DspRows* dsp) {
+      conv.fp = fp;
+      conv.dsp = dsp;
+      // work all scanlines
+      if (!dispatch_data_type(dtype, conv)) {
+        Printf("FATAL:  Cell data type '%s' is not supported.\n")
+          (GDALGetDataTypeName(dtype));
+        return false;
+      }
+      return !conv.failed && (!conv.pyramid || conv.pyramid->write());
+    }, input, r);
+  if (decimator)
+    decimator->print(stdout, basename);
+  if (reprojector)
+    reprojector->print(stdout, basename);
+  if (resampler)
+    resampler->print(stdout, basename);
+  if (cache)
+    cache->print(stdout, basename);
+  if (!ok) {
+    if (conv.failed)
+      r.error = "read error";
+    return false;
+  }
+
+
   // The scanline buffer should be freed with CPLFree() when it is
   // no longer used.
   //
@@ -510,10 +1448,379 @@ main(int argc, char** argv)
   // format like GTiff will likely result in being unable to open it
   // afterwards.
 
-} // main
+
+  return true;
+} // convert_input
+
+bool
+convert_mosaic(const vector<string>& inputs, const string& basename,
+               const Options& opt)
+{
+  JobResult r;
+  r.input = "the mosaic";
+  r.name = basename;
+
+  // every source stays open while the merged rows stream through
+  vector<unique_ptr<Input> > ins;
+  vector<GDALDataset*> sets;
+  double zmin(0);
+  double zmax(0);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    ins.push_back(unique_ptr<Input>(new Input(inputs[i])));
+    Input& in = *ins.back();
+    in.dataset
+      = static_cast<GDALDataset*>(GDALOpen(inputs[i].c_str(), GA_ReadOnly));
+    if (!in.dataset) {
+      Printf("ERROR:  Input file '%s' not found.\n")(inputs[i]);
+      return false;
+    }
+    if (!get_dataset_info(in))
+      return false;
+    if (!square_cells(in)) {
+      Printf("ERROR:  Cells of '%s' are %g m x %g m; '--mosaic' takes square"
+             " cells only.\n")(inputs[i])(in.scalex)(in.scaley);
+      return false;
+    }
+    sets.push_back(in.dataset);
+
+    if (opt.chop || opt.zstep) {
+      // the base level is below the lowest cell of all sources, the
+      // step fits the highest
+      GDALRasterBand* band = in.dataset->GetRasterBand(1);
+      int got_lo(0), got_hi(0);
+      double lo = band->GetMinimum(&got_lo);
+      double hi = band->GetMaximum(&got_hi);
+      if (!(got_lo && got_hi)) {
+        BandMinMax mm(band);
+        if (!dispatch_data_type(band->GetRasterDataType(), mm)) {
+          Printf("ERROR:  Cell data type '%s' is not supported.\n")
+            (GDALGetDataTypeName(band->GetRasterDataType()));
+          return false;
+        }
+        if (mm.err != CE_None) {
+          Printf("ERROR:  Unable to read the cells of '%s'.\n")(inputs[i]);
+          return false;
+        }
+        lo = mm.minmax[0];
+        hi = mm.minmax[1];
+      }
+      zmin = i ? min(zmin, lo) : lo;
+      zmax = i ? max(zmax, hi) : hi;
+    }
+  }
+
+  Mosaic mosaic;
+  if (!mosaic.layout(sets, inputs))
+    return false;
+  const int nx = mosaic.nx();
+  const int ny = mosaic.ny();
+
+  // The sources' own no-data cells never reach the mosaic (see
+  // mosaic.h); cells no source covers always come out as 0.
+  ins[0]->scalez = z_step(opt, zmin, zmax, "the mosaic");
+  PixelParams params;
+  const unsigned pixflags
+    = pixel_options(opt, true, Mosaic::NODATA, zmin, ins[0]->scalez, params)
+    | PIX_MASK;
+  params.nodata = Mosaic::NODATA;
+  RowKernelTable<float>::Func row_kernel = select_row_kernel<float>(pixflags);
+  void (*row_writer)(FILE*, const int*, const int, const int)
+    = debug ? write_row_debug : write_row;
+
+  // merge, transform and print the rows, top down
+  Pyramid* pyramid(0);
+  GridWriter convert = [&](FILE* fp, DspRows* dsp) {
+    vector<float> cells(nx);
+    vector<int> row(nx);
+    for (int i = 0; i < ny; ++i) {
+      if (!mosaic.read_row(&cells[0]))
+        return false;
+      row_kernel(&cells[0], &row[0], nx, params);
+      if (fp)
+        row_writer(fp, &row[0], nx, i);
+      if (dsp)
+        dsp->add_row(&row[0]);
+      if (pyramid)
+        pyramid->add_row(&row[0]);
+    }
+    return !pyramid || pyramid->write();
+  };
+
+  const Input& first = *ins[0];
+  if (basename.empty()) {
+    fprintf(stderr, "pixels: %d wide X %d high; scale: %g m X %g m X %g m\n",
+            nx, ny, first.scalex, first.scaley, first.scalez);
+    const bool ok = convert(stdout, 0);
+    mosaic.print(stderr);
+    return ok;
+  }
+
+  Hash input = HASH_SEED;
+  if (opt.incremental) {
+    for (size_t i = 0; i < sets.size(); ++i) {
+      if (!hash_dataset_files(sets[i], input)) {
+        Printf("ERROR:  Unable to hash the input data set '%s'.\n")
+          (inputs[i]);
+        return false;
+      }
+    }
+    input = hash_conversion(pixflags, params, "mosaic", input);
+  }
+
+  OutputFiles outs(basename, pixsize);
+  setup_outputs(outs, opt, first, nx, ny);
+  Pyramid levels(nx, outs.lods);
+  if (!outs.lods.empty())
+    pyramid = &levels;
+  const bool ok = write_outputs(outs, opt, convert, input, r);
+  mosaic.print(stdout);
+  return ok;
+} // convert_mosaic
+
+double
+z_step(const Options& opt, const double zmin, const double zmax,
+       const string& what)
+{
+  if (!opt.zstep)
+    return 1;
+
+  // the heights from the base level (0, or the chop level) up
+  const double base = opt.chop ? floor(zmin * opt.zscale) + opt.chopel : 0;
+  const double top = zmax * opt.zscale - base;
+  const double limit = 65535;
+  double step = opt.zstep;
+  if (step < 0) {
+    // the finest of 0.001, 0.002, 0.005, 0.01, ... m that fits
+    static const double mantissa[3] = { 1, 2, 5 };
+    step = 0;
+    for (double decade = 0.001; !step && decade < 1000; decade *= 10)
+      for (int k = 0; k < 3 && !step; ++k)
+        if (decade * mantissa[k] * limit >= top)
+          step = decade * mantissa[k];
+    if (!step)
+      step = 1;
+  }
+  else if (top / step > limit) {
+    Printf("WARNING:  Heights of '%s' above %g m are clamped with a %g m step"
+           " (see '--zstep', '--chop').\n")(what)(base + limit * step)(step);
+  }
+  return step;
+} // z_step
+
+unsigned
+pixel_options(const Options& opt, const bool has_nodata, const double nodata,
+              const double zmin, const double zstep, PixelParams& params)
+{
+  // Choose the fused pixel operations for the selected options once,
+  // here, so the per-pixel loop has no option tests in it.
+  unsigned pixflags(0);
+  if (opt.nodata && has_nodata) {
+    params.nodata = nodata;
+    pixflags |= PIX_MASK;
+  }
+  if (opt.zscale != 1) {
+    params.zscale = static_cast<float>(opt.zscale);
+    pixflags |= PIX_SCALE;
+  }
+  if (zstep != 1) {
+    params.zunits = static_cast<float>(1 / zstep);
+    pixflags |= PIX_STEP;
+  }
+  if (opt.chop) {
+    // the base level in output units
+    params.base = static_cast<int>(
+      floor((floor(zmin * opt.zscale) + opt.chopel) / zstep + 0.5));
+    pixflags |= PIX_CHOP;
+  }
+  // debug output shows the unclamped values (negative ones are skipped)
+  if (!debug)
+    pixflags |= PIX_CLAMP;
+  return pixflags;
+} // pixel_options
+
+Hash
+hash_conversion(const unsigned pixflags, const PixelParams& params,
+                const string& what, Hash h)
+{
+  h = hash_int(pixflags, h);
+  h = hash_int(params.base, h);
+  h = hash_int(static_cast<long long>(params.zscale * 1000000), h);
+  h = hash_bytes(&params.nodata, sizeof(params.nodata), h);
+  if (pixflags & PIX_STEP)
+    h = hash_bytes(&params.zunits, sizeof(params.zunits), h);
+  return hash_string(what, h);
+} // hash_conversion
+
+// reads a window of a band at its native cell type, like ConvertBand,
+// so Int32 and Float64 cells aren't rounded through float first
+struct ReadWindow {
+  GDALRasterBand*    band;
+  int                x0;
+  int                y0;
+  int                w;
+  int                h;
+  unsigned           pixflags;
+  const PixelParams& params;
+  int*               cells;
+  bool               ok;
+
+  ReadWindow(GDALRasterBand* b, const int x, const int y, const int nx,
+             const int ny, const unsigned flags, const PixelParams& p,
+             int* out)
+    : band(b), x0(x), y0(y), w(nx), h(ny), pixflags(flags), params(p),
+      cells(out), ok(false)
+  {}
+
+  template <class T>
+  void run()
+  {
+    vector<T> buf(static_cast<size_t>(w) * h);
+    ok = band->RasterIO(GF_Read, x0, y0, w, h, &buf[0], w, h,
+                        GdalTypeOf<T>::value, 0, 0) == CE_None;
+    if (!ok)
+      return;
+    typename RowKernelTable<T>::Func row_kernel
+      = select_row_kernel<T>(pixflags);
+    for (int i = 0; i < h; ++i) {
+      const size_t off = static_cast<size_t>(i) * w;
+      row_kernel(&buf[off], cells + off, w, params);
+    }
+  }
+};
+
+bool
+read_window(GDALRasterBand* band, const int x0, const int y0, const int w,
+            const int h, const unsigned pixflags, const PixelParams& params,
+            int* cells)
+{
+  // the same cell type and kernel as the conversion, so the values are
+  // the ones it writes
+  ReadWindow rw(band, x0, y0, w, h, pixflags, params, cells);
+  return dispatch_data_type(band->GetRasterDataType(), rw) && rw.ok;
+} // read_window
 
 void
-get_dataset_info()
+setup_outputs(OutputFiles& outs, const Options& opt, const Input& in,
+              const int nx, const int ny)
+{
+  for (size_t i = 0; i < opt.views.size(); ++i)
+    outs.add_view(opt.views[i].first, opt.views[i].second);
+  outs.png_level = opt.png_level;
+  outs.keep_pix = opt.keep_pix;
+  outs.stream = opt.stream;
+  if (opt.hillshade)
+    outs.preview = OutputFiles::PREVIEW_HILLSHADE;
+  outs.shade = opt.shade;
+  // the shaded heights are in steps
+  outs.shade.zfactor *= in.scalez;
+  outs.nx = nx;
+  outs.ny = ny;
+  outs.scalex = in.scalex;
+  outs.scaley = in.scaley;
+  outs.scalez = in.scalez;
+  if (opt.tiling.w)
+    outs.tiles = layout_tiles(outs.basename, nx, ny, opt.tiling);
+  if (opt.pyramid)
+    outs.lods = layout_pyramid(outs.basename, nx, ny, opt.pyramid);
+  outs.bot_error = opt.bot;
+  outs.sightlines = opt.los;
+  outs.los_bench = opt.los_bench;
+  outs.threads = opt.threads;
+} // setup_outputs
+
+bool
+write_outputs(OutputFiles& outs, const Options& opt,
+              const GridWriter& convert, const Hash input, JobResult& r)
+{
+  // With output files, the conversion and the BRL-CAD stages (the
+  // mged trick) run as a dependency graph so independent stages
+  // overlap (see output_stages.h).
+  TaskGraph graph;
+  int asc = graph.add(opt.stream ? "asc+dsp" : "asc", [&]() {
+      FILE* fp(stdout);
+      FILE* fp1(0);
+      DspRows dsp(outs.dsp, outs.nx, outs.ny);
+      if (opt.stream) {
+        // no text at all: the rows go straight into X.dsp
+        if (!dsp.open()) {
+          Printf("ERROR:  Unable to open '%s' for writing.\n")(outs.dsp);
+          return false;
+        }
+        fp = 0;
+      }
+      else if (!debug) {
+        fp1 = fopen(outs.asc.c_str(), "w");
+        if (!fp1) {
+          Printf("ERROR:  Unable to open '%s' for writing.\n")(outs.asc);
+          return false;
+        }
+        fp = fp1;
+      }
+      bool ok = convert(fp, opt.stream ? &dsp : 0);
+      if (fp1 && fclose(fp1) != 0)
+        ok = false;
+      if (opt.stream && !dsp.close()) {
+        Printf("ERROR:  Unable to write '%s'.\n")(outs.dsp);
+        ok = false;
+      }
+      return ok;
+    });
+  OutputTasks tasks = add_output_stages(graph, outs, asc);
+
+  BuildManifest manifest(outs.basename + ".manifest");
+  if (opt.incremental) {
+    manifest.load();
+    mark_up_to_date(graph, tasks, outs, manifest, input);
+  }
+  else {
+    // outputs are about to change behind the manifest's back
+    unlink(manifest.path().c_str());
+  }
+
+  bool ok = graph.run(opt.threads);
+  if (!opt.batch)
+    graph.report(stdout);
+
+  if (opt.incremental) {
+    update_manifest(graph, tasks, outs, manifest, input);
+    if (!manifest.save())
+      Printf("WARNING: Unable to write '%s'.\n")(manifest.path());
+  }
+
+  vector<string> fils(outs.list());
+  if (opt.incremental)
+    fils.push_back(manifest.path());
+  for (size_t i = 0; i < fils.size(); ++i)
+    r.out_bytes += file_size(fils[i]);
+
+  if (!ok) {
+    // name the first failed stage
+    for (size_t i = 0; i < graph.size(); ++i) {
+      if (graph.state(static_cast<int>(i)) == TaskGraph::FAILED) {
+        r.error = graph.name(static_cast<int>(i)) + " stage";
+        break;
+      }
+    }
+    Printf("ERROR:  Output stage failed for '%s'.\n")(r.input);
+    return false;
+  }
+
+  r.ok = true;
+  if (opt.batch)
+    return true;
+
+  unsigned nf = fils.size();
+  string s(nf > 1 ? "s" : "");
+  Printf("Normal end.  See file%s:\n")(s);
+  for (unsigned i = 0; i < nf; ++i) {
+    Printf("  %s\n")(fils[i]);
+  }
+  return true;
+} // write_outputs
+
+
+bool
+get_dataset_info(Input& in, const bool any_srs)
 {
   // Getting Dataset Information
   // ---------------------------
@@ -534,6 +1841,8 @@ get_dataset_info()
   // If we wanted to print some general information about the dataset
   // we might do the following:
 
+  GDALDataset* dataset = in.dataset;
+  double* adfGeoTransform = in.adfGeoTransform;
   if (dataset->GetGeoTransform(adfGeoTransform) == CE_None) {
     if (info) {
       printf("Origin = (%.6f,%.6f)\n",
@@ -544,33 +1853,38 @@ get_dataset_info()
     }
   }
 
-  scalex = static_cast<int>(floor(adfGeoTransform[1]));
-  scaley = static_cast<int>(floor(adfGeoTransform[5]));
+  in.scalex = adfGeoTransform[1];
+  in.scaley = adfGeoTransform[5];
   // use negative of scaley since we reverse the output
-  scaley *= -1;
+  in.scaley *= -1;
 
-  if (!info && (scalex != scaley)) {
-    Printf("FATAL: cell scale x (%d) != cell scale y (%d)\n")(scalex)(scaley);
-    exit(1);
+  // cells that aren't square are resampled (see convert_input())
+  if (!info && !(in.scalex > 0 && in.scaley > 0)) {
+    Printf("FATAL: cell scale x (%g) or y (%g) is not positive in '%s'\n")
+      (in.scalex)(in.scaley)(in.ifil);
+    return false;
   }
-  scalez = 1;
+  in.scalez = 1;
 
-  // check scalez
-  if (dataset->GetProjectionRef()) {
+  // check scalez ('--project' reprojects to meters whatever the units)
+  OGRSpatialReference*& sp = in.sp;
+  if (dataset->GetProjectionRef() && !any_srs) {
     const char* s = dataset->GetProjectionRef();
     if (!sp)
       sp = new OGRSpatialReference(s);
     const OGR_SRSNode* node = sp->GetAttrNode("UNIT");
     string unit(sp->GetAttrValue("UNIT", 0));
     if (unit != "Meter") {
-      Printf("FATAL:  Cell unit is '%s' instead of 'Meter'.\n")(unit);
-      exit(1);
+      Printf("FATAL:  Cell unit is '%s' instead of 'Meter' in '%s'"
+             " (see '--project').\n")(unit)(in.ifil);
+      return false;
     }
     else {
       int val = atoi(sp->GetAttrValue("UNIT", 1));
       if (val != 1) {
-        Printf("FATAL:  Cell z scale is '%d' instead of '1'.\n")(val);
-        exit(1);
+        Printf("FATAL:  Cell z scale is '%d' instead of '1' in '%s'.\n")
+          (val)(in.ifil);
+        return false;
       }
     }
   }
@@ -665,8 +1979,16 @@ get_dataset_info()
 
   }
 
+  return true;
 } // get_dataset_info
 
+bool
+square_cells(const Input& in)
+{
+  // to within the rounding of the transfer's cell sizes
+  return fabs(in.scalex - in.scaley) <= 1.0e-6 * in.scalex;
+} // square_cells
+
 string
 get_spaces(const int n)
 {
@@ -708,3 +2030,76 @@ error_exit(const string& msg)
   Printf("FATAL: %s\n")(msg);
   exit(1);
 } // error_exit
+
+void
+write_row(FILE* fp, const int* row, const int n, const int /* i */)
+{
+  // print a row of "pixels"
+  for (int j = 0; j < n; ++j)
+    fprintf(fp, " %d", row[j]);
+  fprintf(fp, "\n");
+} // write_row
+
+void
+write_row_debug(FILE* fp, const int* row, const int n, const int i)
+{
+  for (int j = 0; j < n; ++j) {
+    if (row[j] < 0)
+      continue;
+    FPrintf(fp, "pixel[%d,%d] = %d\n")(j)(i)(row[j]);
+  }
+} // write_row_debug
+
+void
+format_row(string& s, const int* row, const int n)
+{
+  // the same text as write_row(), without a stdio call per cell
+  char buf[16];
+  char* const end = buf + sizeof(buf);
+  for (int j = 0; j < n; ++j) {
+    const int v = row[j];
+    unsigned u = v < 0 ? 0u - static_cast<unsigned>(v)
+                       : static_cast<unsigned>(v);
+    char* p = end;
+    do {
+      *--p = static_cast<char>('0' + u % 10);
+      u /= 10;
+    } while (u);
+    if (v < 0)
+      *--p = '-';
+    *--p = ' ';
+    s.append(p, end - p);
+  }
+  s += '\n';
+} // format_row
+
+long long
+probe_cells(const string& ifil)
+{
+  GDALDataset* dataset
+    = static_cast<GDALDataset*>(GDALOpen(ifil.c_str(), GA_ReadOnly));
+  if (!dataset)
+    return 0;
+  const long long cells
+    = static_cast<long long>(dataset->GetRasterXSize())
+    * dataset->GetRasterYSize();
+  GDALClose(dataset);
+  return cells;
+} // probe_cells
+
+bool
+hash_dataset_files(GDALDataset* dataset, Hash& h)
+{
+  // all files of the data set (for SDTS: every module named in CATD)
+  char** flist2 = dataset->GetFileList();
+  CPLStringList flist(flist2, false);
+  int nf = flist.size();
+  bool ok(nf > 0);
+  for (int i = 0; ok && i < nf; ++i) {
+    const CPLString& s = flist[i];
+    h = hash_string(s, h);
+    ok = hash_file(s, h);
+  }
+  CSLDestroy(flist2);
+  return ok;
+} // hash_dataset_files
@@ -0,0 +1,180 @@
+// BotMesh (bot_mesh.h): the top within the error of every cell, and
+// the mesh closed, every edge shared by exactly two faces turning
+// opposite ways along it
+
+#include <map>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "bot_mesh.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+// a grid of hills and a cliff, with a stretch of ground at 0 (where
+// the sides have no height), in tenths of a meter
+vector<float>
+terrain(const int nx, const int ny)
+{
+  vector<float> z(static_cast<size_t>(nx) * ny);
+  for (int y = 0; y < ny; ++y) {
+    for (int x = 0; x < nx; ++x) {
+      float h = static_cast<float>(5000 + 2000 * sin(x * 0.05) * cos(y * 0.07)
+                                   + 300 * sin(x * 0.9 + y * 0.4));
+      if (x > 2 * nx / 3)
+        h += 1500;
+      if (x < nx / 5 && y < ny / 4)
+        h = 0;
+      z[static_cast<size_t>(y) * nx + x] = h;
+    }
+  }
+  return z;
+}
+
+// the first 'ntop' faces (the top) within 'max_error' meters of every
+// cell under them, and covering the grid once
+void
+check_error(const vector<float>& z, const int nx, const int ny,
+            const double cellx, const double celly, const double zunit,
+            const double max_error, const vector<double>& v,
+            const vector<int>& f, const long long ntop)
+{
+  int bad(0);
+  double area(0);
+  double worst(0);
+  for (long long t = 0; t < ntop; ++t) {
+    const double* p[3];
+    for (int k = 0; k < 3; ++k)
+      p[k] = &v[3 * static_cast<size_t>(f[3 * t + k])];
+    // in cells, row 0 north
+    double gx[3], gy[3];
+    for (int k = 0; k < 3; ++k) {
+      gx[k] = p[k][0] / cellx;
+      gy[k] = ny - 1 - p[k][1] / celly;
+    }
+    const double det = (gx[1] - gx[0]) * (gy[2] - gy[0])
+                       - (gx[2] - gx[0]) * (gy[1] - gy[0]);
+    area += 0.5 * fabs(det);
+    bad += det == 0;
+    if (det == 0)
+      continue;
+    const int x0 = static_cast<int>(min(gx[0], min(gx[1], gx[2])));
+    const int x1 = static_cast<int>(max(gx[0], max(gx[1], gx[2])));
+    const int y0 = static_cast<int>(min(gy[0], min(gy[1], gy[2])));
+    const int y1 = static_cast<int>(max(gy[0], max(gy[1], gy[2])));
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        // barycentric coordinates; cells on an edge belong to both faces
+        const double b1 = ((x - gx[0]) * (gy[2] - gy[0])
+                           - (gx[2] - gx[0]) * (y - gy[0])) / det;
+        const double b2 = ((gx[1] - gx[0]) * (y - gy[0])
+                           - (x - gx[0]) * (gy[1] - gy[0])) / det;
+        const double b0 = 1 - b1 - b2;
+        if (b0 < -1e-9 || b1 < -1e-9 || b2 < -1e-9)
+          continue;
+        const double h = b0 * p[0][2] + b1 * p[1][2] + b2 * p[2][2];
+        const double d = fabs(h - z[static_cast<size_t>(y) * nx + x] * zunit);
+        worst = max(worst, d);
+        bad += d > max_error + 1e-4;
+      }
+    }
+  }
+  if (worst > max_error + 1e-4)
+    fprintf(stderr, "top %.4f m off at most\n", worst);
+  CHECK(bad == 0);
+  CHECK(fabs(area - static_cast<double>(nx - 1) * (ny - 1)) < 1e-6);
+}
+
+// every edge in exactly two faces, once each way
+void
+check_closed(const vector<int>& f)
+{
+  map<pair<int, int>, int> edges;
+  for (size_t t = 0; t < f.size(); t += 3)
+    for (int k = 0; k < 3; ++k)
+      ++edges[make_pair(f[t + k], f[t + (k + 1) % 3])];
+  int bad(0);
+  for (map<pair<int, int>, int>::const_iterator e = edges.begin();
+       e != edges.end(); ++e) {
+    const map<pair<int, int>, int>::const_iterator back
+      = edges.find(make_pair(e->first.second, e->first.first));
+    bad += e->second != 1 || back == edges.end() || back->second != 1;
+  }
+  CHECK(bad == 0);
+}
+
+// the enclosed volume (positive if the faces turn outward), meters^3
+double
+volume(const vector<double>& v, const vector<int>& f)
+{
+  double sum(0);
+  for (size_t t = 0; t < f.size(); t += 3) {
+    const double* a = &v[3 * static_cast<size_t>(f[t])];
+    const double* b = &v[3 * static_cast<size_t>(f[t + 1])];
+    const double* c = &v[3 * static_cast<size_t>(f[t + 2])];
+    sum += a[0] * (b[1] * c[2] - b[2] * c[1])
+           + a[1] * (b[2] * c[0] - b[0] * c[2])
+           + a[2] * (b[0] * c[1] - b[1] * c[0]);
+  }
+  return sum / 6;
+}
+
+} // namespace
+
+int
+main()
+{
+  // a grid past one 256-cell square each way, so smaller squares meet
+  // along its far edges
+  {
+    const int nx = 300;
+    const int ny = 270;
+    const double cellx = 10;
+    const double celly = 12;
+    const double zunit = 0.1;
+    const vector<float> z(terrain(nx, ny));
+    BotMesh mesh(z, nx, ny, cellx, celly, zunit, 3);
+    const double errors[3] = { 0.5, 5, 40 };
+    long long last(-1);
+    for (int e = 0; e < 3; ++e) {
+      vector<double> v;
+      vector<int> f;
+      mesh.extract(errors[e], v, f);
+      const long long ntop = mesh.count(errors[e]);
+      CHECK(ntop > 0 && 3 * ntop < static_cast<long long>(f.size()));
+      CHECK(last < 0 || ntop < last);
+      last = ntop;
+      check_error(z, nx, ny, cellx, celly, zunit, errors[e], v, f, ntop);
+      check_closed(f);
+      CHECK(volume(v, f) > 0);
+    }
+  }
+
+  // a plane over one square is two triangles, and the solid under them
+  // holds the ground's volume
+  {
+    const int n = 257;
+    vector<float> z(n * n);
+    for (int y = 0; y < n; ++y)
+      for (int x = 0; x < n; ++x)
+        z[y * n + x] = static_cast<float>(100 + 2 * x + y);
+    BotMesh mesh(z, n, n, 1, 1, 1, 2);
+    CHECK(mesh.count(0.01) == 2);
+    vector<double> v;
+    vector<int> f;
+    mesh.extract(0.01, v, f);
+    check_error(z, n, n, 1, 1, 1, 0.01, v, f, 2);
+    check_closed(f);
+    // 256 x 256 under a plane 100 m high at the north west corner,
+    // rising 2 m a cell east and 1 m a cell south
+    const double want = 256.0 * 256 * (100 + 2 * 128 + 128);
+    CHECK(fabs(volume(v, f) - want) < 1e-6 * want);
+  }
+
+  return check_result("bot_mesh");
+}
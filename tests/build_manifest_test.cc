@@ -0,0 +1,86 @@
+// the incremental mode's hashes and manifest (build_manifest.h)
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h> // unlink, rmdir
+
+#include "build_manifest.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+bool
+write_file(const string& fname, const string& text)
+{
+  FILE* fp = fopen(fname.c_str(), "w");
+  if (!fp)
+    return false;
+  fputs(text.c_str(), fp);
+  return fclose(fp) == 0;
+}
+
+} // namespace
+
+int
+main()
+{
+  // 64-bit FNV-1a test vectors
+  CHECK(hash_bytes("", 0) == HASH_SEED);
+  CHECK(hash_bytes("a", 1) == 0xaf63dc4c8601ec8cULL);
+  CHECK(hash_bytes("foobar", 6) == 0x85944171f73967e8ULL);
+  // chaining through the seed is hashing the concatenation
+  CHECK(hash_bytes("bar", 3, hash_bytes("foo", 3)) == hash_bytes("foobar", 6));
+  // strings hash their length too
+  CHECK(hash_string("c", hash_string("ab"))
+        != hash_string("bc", hash_string("a")));
+  CHECK(hash_int(1) != hash_int(2));
+
+  char dir[] = "/tmp/manifest_testXXXXXX";
+  CHECK(mkdtemp(dir) != 0);
+  const string base(dir);
+  const string artifact(base + "/x.dsp");
+  const string other(base + "/x with spaces.png");
+  const string path(base + "/x.manifest");
+
+  Hash h = HASH_SEED;
+  CHECK(write_file(artifact, "cells"));
+  CHECK(hash_file(artifact, h));
+  CHECK(h == hash_bytes("cells", 5));
+  Hash none = HASH_SEED;
+  CHECK(!hash_file(base + "/missing", none));
+
+  // a missing manifest is an empty one
+  BuildManifest m(path);
+  m.load();
+  CHECK(!m.up_to_date(artifact, h));
+
+  m.record(artifact, h);
+  m.record(other, 42);
+  CHECK(write_file(other, "png"));
+  CHECK(m.save());
+
+  BuildManifest n(path);
+  n.load();
+  CHECK(n.up_to_date(artifact, h));
+  CHECK(n.up_to_date(other, 42));
+  // another key, an unknown artifact, or one that is gone: redo it
+  CHECK(!n.up_to_date(artifact, h + 1));
+  CHECK(!n.up_to_date(base + "/x.g", h));
+  unlink(other.c_str());
+  CHECK(!n.up_to_date(other, 42));
+
+  n.forget(artifact);
+  CHECK(!n.up_to_date(artifact, h));
+  CHECK(n.save());
+  BuildManifest k(path);
+  k.load();
+  CHECK(!k.up_to_date(artifact, h));
+
+  unlink(artifact.c_str());
+  unlink(path.c_str());
+  rmdir(dir);
+  return check_result("build_manifest");
+}
@@ -0,0 +1,111 @@
+// to_json() (catalog.h): escaping, nulls, and where a record ends
+
+#include <cmath>
+#include <string>
+#include <limits>
+
+#include "catalog.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+bool
+has(const string& s, const string& part)
+{
+  return s.find(part) != string::npos;
+}
+
+} // namespace
+
+int
+main()
+{
+  // a failed input: only the name, the reason and the open time
+  {
+    DatasetInfo d;
+    d.file = "dir\\a \"b\"\n\x01\x1f\t\r.dem";
+    d.error = "not a \"DEM\"";
+    d.open_ms = numeric_limits<double>::quiet_NaN();
+    CHECK(to_json(d)
+          == "{\"file\": \"dir\\\\a \\\"b\\\"\\n\\u0001\\u001f\\t\\r.dem\","
+             " \"ok\": false, \"error\": \"not a \\\"DEM\\\"\","
+             " \"open_ms\": null}");
+  }
+
+  // bytes at and above 0x7f (UTF-8 names) pass through as they are
+  {
+    DatasetInfo d;
+    d.file = "h\xc3\xb6he\x7f.tif";
+    d.open_ms = 1.5;
+    CHECK(to_json(d)
+          == "{\"file\": \"h\xc3\xb6he\x7f.tif\", \"ok\": false,"
+             " \"open_ms\": 1.5}");
+  }
+
+  // a data set with no bands stops after the units
+  {
+    DatasetInfo d;
+    d.file = "x.vrt";
+    d.ok = true;
+    d.driver = "VRT";
+    d.files.push_back("x.vrt");
+    d.files.push_back("x\".bin");
+    d.nx = 3;
+    d.ny = 2;
+    d.xy_unit = "metre";
+    const string s = to_json(d);
+    CHECK(has(s, "\"ok\": true, \"open_ms\": 0, \"driver\": \"VRT\""));
+    CHECK(has(s, "\"files\": [\"x.vrt\", \"x\\\".bin\"], \"bytes\": 0"));
+    CHECK(has(s, "\"size\": [3, 2], \"bands\": 0"));
+    CHECK(has(s, "\"geotransform\": null, \"srs\": null"));
+    CHECK(has(s, "\"xy_meters\": null"));
+    CHECK(s.size() > 2 && s.substr(s.size() - 2) == "}}");
+    CHECK(!has(s, "\"block\""));
+  }
+
+  // a full record
+  {
+    DatasetInfo d;
+    d.file = "q.dem";
+    d.ok = true;
+    d.driver = "USGSDEM";
+    d.nx = 1201;
+    d.ny = 1201;
+    d.nbands = 1;
+    d.has_transform = true;
+    const double gt[6] = { -106.5, 0.25, 0, 35.5, 0, -0.25 };
+    for (int i = 0; i < 6; ++i)
+      d.transform[i] = gt[i];
+    d.wkt = "GEOGCS[\"NAD27\"]";
+    d.geogcs = "NAD27";
+    d.epsg = "4267";
+    d.xy_meters = 1;
+    d.data_type = "Int16";
+    d.has_nodata = true;
+    d.nodata = -32767;
+    d.has_stats = true;
+    d.stats.moments.n = 2;
+    d.stats.moments.min = 1;
+    d.stats.moments.max = 3;
+    d.stats.moments.mean = 2;
+    d.stats.moments.m2 = 2;
+    d.stats.hist.push_back(1);
+    d.stats.hist.push_back(1);
+    const string s = to_json(d);
+    CHECK(has(s, "\"geotransform\": [-106.5, 0.25, 0, 35.5, 0, -0.25]"));
+    CHECK(has(s, "\"epsg\": 4267, \"wkt\": \"GEOGCS[\\\"NAD27\\\"]\"}"));
+    CHECK(has(s, "\"nodata\": -32767, \"min\": null, \"max\": null"));
+    CHECK(has(s, "\"stats\": {\"count\": 2, \"nodata_count\": 0,"
+                 " \"min\": 1, \"max\": 3, \"mean\": 2, \"stddev\": 1,"
+                 " \"hist\": [1, 1]"));
+    CHECK(s.size() > 2 && s.substr(s.size() - 2) == "}}");
+
+    // an authority code that isn't a number stays a string
+    d.epsg = "ESRI:102003";
+    CHECK(has(to_json(d), "\"epsg\": \"ESRI:102003\""));
+  }
+
+  return check_result("catalog");
+}
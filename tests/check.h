@@ -0,0 +1,37 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+// Minimal assertions for the unit tests (see CMakeLists.txt): CHECK()
+// reports a failed condition with its place and counts it, and each
+// test program's main() ends with 'return check_result("name");', so
+// ctest sees a nonzero exit status if anything failed.
+
+#include <cstdio>
+
+namespace {
+
+int check_failures = 0;
+
+int
+check_result(const char* what)
+{
+  if (check_failures)
+    fprintf(stderr, "%s: %d check%s failed\n", what, check_failures,
+            check_failures > 1 ? "s" : "");
+  else
+    printf("%s: ok\n", what);
+  return check_failures ? 1 : 0;
+}
+
+} // namespace
+
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,  \
+              #cond);                                                   \
+      ++check_failures;                                                 \
+    }                                                                   \
+  } while (0)
+
+#endif // CHECK_H
@@ -0,0 +1,207 @@
+// tiled DSP output (dsp_tiles.h): the tile layout, and the files
+// written by write_dsp_file, DspRows and write_dsp_tiles
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h> // unlink, rmdir
+
+#include "dsp_tiles.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+vector<unsigned char>
+read_file(const string& fname)
+{
+  vector<unsigned char> data;
+  FILE* fp = fopen(fname.c_str(), "rb");
+  if (!fp)
+    return data;
+  unsigned char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    data.insert(data.end(), buf, buf + n);
+  fclose(fp);
+  return data;
+}
+
+// the cells of an nx by ny grid, some outside 0-65535
+vector<int>
+make_grid(const int nx, const int ny)
+{
+  vector<int> cells(static_cast<size_t>(nx) * ny);
+  for (size_t i = 0; i < cells.size(); ++i)
+    cells[i] = static_cast<int>(i * 977 % 70000) - 2000;
+  return cells;
+}
+
+// every cell covered, tiles inside the grid, no bigger than asked and
+// at least 2 posts each way, neighbors sharing 'overlap' posts (or
+// more at the east and south edges), and the names in place
+void
+check_layout(const int nx, const int ny, const int w, const int h,
+             const int overlap)
+{
+  DspTiling t;
+  t.w = w;
+  t.h = h;
+  t.overlap = overlap;
+  const vector<DspTile> tiles = layout_tiles("out/x", nx, ny, t);
+  CHECK(!tiles.empty());
+  if (tiles.empty())
+    return;
+  const int ncols = tiles.back().col + 1;
+  const int nrows = tiles.back().row + 1;
+  CHECK(tiles.size() == static_cast<size_t>(ncols) * nrows);
+
+  vector<int> covered(static_cast<size_t>(nx) * ny, 0);
+  for (size_t i = 0; i < tiles.size(); ++i) {
+    const DspTile& d = tiles[i];
+    CHECK(d.row == static_cast<int>(i) / ncols);
+    CHECK(d.col == static_cast<int>(i) % ncols);
+    CHECK(d.x0 >= 0 && d.y0 >= 0 && d.nx >= 1 && d.ny >= 1);
+    CHECK(d.nx <= w && d.ny <= h);
+    CHECK(d.nx >= 2 && d.ny >= 2);
+    CHECK(d.x0 + d.nx <= nx && d.y0 + d.ny <= ny);
+    char name[64];
+    snprintf(name, sizeof(name), "out/x-r%d-c%d", d.row, d.col);
+    CHECK(d.dsp == string(name) + ".dsp");
+    CHECK(d.solid == string(name) + ".s");
+    if (d.col > 0 && d.x0 + d.nx < nx)
+      CHECK(tiles[i - 1].x0 + tiles[i - 1].nx - d.x0 == overlap);
+    if (d.col > 0)
+      CHECK(tiles[i - 1].x0 + tiles[i - 1].nx - d.x0 >= overlap);
+    if (d.row > 0 && d.y0 + d.ny < ny)
+      CHECK(tiles[i - ncols].y0 + tiles[i - ncols].ny - d.y0 == overlap);
+    if (d.row > 0)
+      CHECK(tiles[i - ncols].y0 + tiles[i - ncols].ny - d.y0 >= overlap);
+    for (int y = d.y0; y < d.y0 + d.ny; ++y)
+      for (int x = d.x0; x < d.x0 + d.nx; ++x)
+        ++covered[static_cast<size_t>(y) * nx + x];
+  }
+  int missed(0);
+  for (size_t i = 0; i < covered.size(); ++i)
+    missed += covered[i] == 0;
+  CHECK(missed == 0);
+  // the last tiles reach the east and south edges
+  CHECK(tiles.back().x0 + tiles.back().nx == nx);
+  CHECK(tiles.back().y0 + tiles.back().ny == ny);
+}
+
+} // namespace
+
+int
+main()
+{
+  check_layout(100, 80, 30, 25, 1);
+  check_layout(100, 80, 30, 25, 5);
+  check_layout(10, 10, 100, 100, 1);   // one tile
+  check_layout(31, 31, 16, 16, 1);     // tiles meeting the edge exactly
+  check_layout(201, 201, 100, 100, 1);
+  check_layout(2, 50, 2, 7, 1);
+  {
+    DspTiling t;
+    CHECK(layout_tiles("x", 100, 80, t).empty());  // no tiling
+    // tiles must share their edge posts, or cells go missing
+    t.w = t.h = 100;
+    t.overlap = 0;
+    CHECK(layout_tiles("x", 201, 201, t).empty());
+    t.overlap = 100;
+    CHECK(layout_tiles("x", 201, 201, t).empty());
+    // 201 posts in tiles of 100 sharing one: starts 0, 99 and 198
+    t.overlap = 1;
+    const vector<DspTile> tiles = layout_tiles("x", 201, 50, t);
+    CHECK(tiles.size() == 3);
+    if (tiles.size() == 3) {
+      CHECK(tiles[1].x0 == 99 && tiles[2].x0 == 198 && tiles[2].nx == 3);
+      CHECK(tiles[0].ny == 50);
+    }
+  }
+
+  char dir[] = "/tmp/dsp_tiles_testXXXXXX";
+  CHECK(mkdtemp(dir) != 0);
+  const string base(dir);
+
+  // big-endian, clamped, south row first
+  {
+    const int cells[6] = { 1, 258, -5, 65535, 70000, 0x1234 };
+    const string fname(base + "/small.dsp");
+    CHECK(write_dsp_file(fname, cells, 3, 2));
+    const unsigned char want[12] = {
+      0xff, 0xff, 0xff, 0xff, 0x12, 0x34,
+      0x00, 0x01, 0x01, 0x02, 0x00, 0x00
+    };
+    CHECK(read_file(fname) == vector<unsigned char>(want, want + 12));
+    unlink(fname.c_str());
+  }
+
+  // DspRows, fed north row first, writes the same file
+  {
+    const int nx = 37;
+    const int ny = 23;
+    const vector<int> grid(make_grid(nx, ny));
+    const string whole(base + "/whole.dsp");
+    const string rows(base + "/rows.dsp");
+    CHECK(write_dsp_file(whole, &grid[0], nx, ny));
+    DspRows dsp(rows, nx, ny);
+    CHECK(dsp.open());
+    for (int y = 0; y < ny; ++y)
+      dsp.add_row(&grid[static_cast<size_t>(y) * nx]);
+    CHECK(dsp.close());
+    CHECK(!read_file(whole).empty());
+    CHECK(read_file(rows) == read_file(whole));
+
+    // too few rows, or too many, is an error
+    DspRows shorter(rows, nx, ny);
+    CHECK(shorter.open());
+    shorter.add_row(&grid[0]);
+    CHECK(!shorter.close());
+    DspRows longer(rows, nx, 1);
+    CHECK(longer.open());
+    longer.add_row(&grid[0]);
+    longer.add_row(&grid[0]);
+    CHECK(!longer.close());
+    unlink(whole.c_str());
+    unlink(rows.c_str());
+  }
+
+  // each tile's file holds its part of the grid
+  {
+    const int nx = 50;
+    const int ny = 41;
+    const vector<int> grid(make_grid(nx, ny));
+    DspTiling t;
+    t.w = 16;
+    t.h = 12;
+    const vector<DspTile> tiles = layout_tiles(base + "/t", nx, ny, t);
+    CHECK(write_dsp_tiles(tiles, [&](const int, const DspTile& d,
+                                     vector<int>& cells) {
+                            cells.resize(static_cast<size_t>(d.nx) * d.ny);
+                            for (int y = 0; y < d.ny; ++y)
+                              for (int x = 0; x < d.nx; ++x)
+                                cells[static_cast<size_t>(y) * d.nx + x]
+                                  = grid[static_cast<size_t>(d.y0 + y) * nx
+                                         + d.x0 + x];
+                            return true;
+                          }, 3));
+    for (size_t i = 0; i < tiles.size(); ++i) {
+      const DspTile& d = tiles[i];
+      vector<int> part;
+      for (int y = d.y0; y < d.y0 + d.ny; ++y)
+        for (int x = d.x0; x < d.x0 + d.nx; ++x)
+          part.push_back(grid[static_cast<size_t>(y) * nx + x]);
+      const string want(base + "/want.dsp");
+      CHECK(write_dsp_file(want, &part[0], d.nx, d.ny));
+      CHECK(read_file(d.dsp) == read_file(want));
+      unlink(want.c_str());
+      unlink(d.dsp.c_str());
+    }
+  }
+
+  rmdir(dir);
+  return check_result("dsp_tiles");
+}
@@ -0,0 +1,104 @@
+// HeightTree::intersect() (height_tree.h) against marching every cell
+// the segment crosses
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "height_tree.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+// rolling ground with some noise, 'nx' by 'ny'
+vector<float>
+make_grid(const int nx, const int ny, mt19937& gen)
+{
+  uniform_real_distribution<float> noise(-2, 2);
+  vector<float> z(static_cast<size_t>(nx) * ny);
+  for (int y = 0; y < ny; ++y)
+    for (int x = 0; x < nx; ++x)
+      z[static_cast<size_t>(y) * nx + x]
+        = static_cast<float>(50 + 20 * sin(x * 0.21) * cos(y * 0.17)
+                             + 8 * sin((x + y) * 0.9)) + noise(gen);
+  return z;
+}
+
+// random segments over (and past) the grid, tree against march;
+// returns the number of hits
+int
+compare(const int nx, const int ny, const int nsegs, mt19937& gen)
+{
+  const vector<float> z(make_grid(nx, ny, gen));
+  const HeightTree tree(z, nx, ny, 2);
+  uniform_real_distribution<double> rx(-2, nx + 1), ry(-2, ny + 1),
+    rz(20, 90), frac(0, 1);
+  int hits(0), differ(0);
+  for (int i = 0; i < nsegs; ++i) {
+    double p[3] = { rx(gen), ry(gen), rz(gen) };
+    double d[3] = { rx(gen) - p[0], ry(gen) - p[1], rz(gen) - p[2] };
+    // some straight down, some along a row or a column
+    if (i % 17 == 0)
+      d[0] = d[1] = 0;
+    else if (i % 13 == 0)
+      d[1] = 0;
+    else if (i % 11 == 0)
+      d[0] = 0;
+    const double tmin = i % 5 == 0 ? frac(gen) * 0.5 : 0;
+    double tt(-1), tm(-1);
+    const bool ht = tree.intersect(p, d, tt, tmin);
+    const bool hm = tree.march(p, d, tm, tmin);
+    if (ht != hm || (ht && fabs(tt - tm) > 1e-6))
+      ++differ;
+    if (ht && (tt < tmin || tt > 1))
+      ++differ;
+    hits += ht;
+  }
+  CHECK(differ == 0);
+  return hits;
+}
+
+} // namespace
+
+int
+main()
+{
+  mt19937 gen(48);
+  // some hits and some misses at every size, including ones that are
+  // not powers of two and the smallest grid with a cell
+  int hits = compare(2, 2, 2000, gen);
+  CHECK(hits > 0 && hits < 2000);
+  hits = compare(3, 5, 2000, gen);
+  CHECK(hits > 0 && hits < 2000);
+  hits = compare(37, 29, 5000, gen);
+  CHECK(hits > 0 && hits < 5000);
+  hits = compare(128, 128, 5000, gen);
+  CHECK(hits > 0 && hits < 5000);
+  hits = compare(200, 77, 5000, gen);
+  CHECK(hits > 0 && hits < 5000);
+
+  // flat ground 10 high: straight down from 20 to 0 meets it halfway,
+  // and a segment wholly above or off the grid meets nothing
+  {
+    const vector<float> z(16 * 16, 10.0f);
+    const HeightTree tree(z, 16, 16, 1);
+    const double p[3] = { 4.3, 7.6, 20 };
+    const double down[3] = { 0, 0, -20 };
+    double t(-1);
+    CHECK(tree.intersect(p, down, t));
+    CHECK(fabs(t - 0.5) < 1e-9);
+    CHECK(tree.intersect(p, down, t, 0.4));
+    CHECK(fabs(t - 0.5) < 1e-9);
+    const double level[3] = { 10, 3, 0 };
+    CHECK(!tree.intersect(p, level, t));
+    const double off[3] = { 40, 7.6, 0 };
+    CHECK(!tree.intersect(p, off, t));
+    const double q[3] = { -5, -5, 20 };
+    const double away[3] = { -3, 0, -20 };
+    CHECK(!tree.intersect(q, away, t));
+  }
+
+  return check_result("height_tree");
+}
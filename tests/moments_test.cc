@@ -0,0 +1,124 @@
+// Moments::merge() and merge_pairwise() (raster_stats.h) against a
+// single two-pass reduction over all the values, and the no-data and
+// NaN cells RowStats (raster_kernels.h) skips
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "raster_stats.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+// count, mean, M2 and extremes of v[b, e) in one two-pass reduction
+Moments
+direct(const vector<double>& v, const size_t b, const size_t e)
+{
+  Moments m;
+  if (b == e)
+    return m;
+  double sum(0);
+  for (size_t i = b; i < e; ++i) {
+    sum += v[i];
+    m.min = min(m.min, v[i]);
+    m.max = max(m.max, v[i]);
+  }
+  m.n = static_cast<long long>(e - b);
+  m.mean = sum / m.n;
+  for (size_t i = b; i < e; ++i)
+    m.m2 += (v[i] - m.mean) * (v[i] - m.mean);
+  return m;
+}
+
+bool
+close_to(const double a, const double b)
+{
+  return fabs(a - b) <= 1e-9 * max(1.0, max(fabs(a), fabs(b)));
+}
+
+void
+check_same(const Moments& a, const Moments& b)
+{
+  CHECK(a.n == b.n);
+  CHECK(close_to(a.mean, b.mean));
+  CHECK(close_to(a.m2, b.m2));
+  CHECK(close_to(a.variance(), b.variance()));
+  CHECK(a.min == b.min);
+  CHECK(a.max == b.max);
+}
+
+} // namespace
+
+int
+main()
+{
+  // heights far from zero with a small spread, where a one-pass sum of
+  // squares would lose the variance
+  mt19937 gen(28);
+  normal_distribution<double> height(8000, 3);
+  vector<double> v(100000);
+  for (size_t i = 0; i < v.size(); ++i)
+    v[i] = height(gen);
+  const Moments all = direct(v, 0, v.size());
+
+  // random ranges, some empty, merged in order and as a tree
+  uniform_int_distribution<int> len(0, 3000);
+  vector<Moments> parts;
+  Moments running;
+  for (size_t b = 0; b < v.size(); ) {
+    const size_t e = min(v.size(), b + len(gen));
+    parts.push_back(direct(v, b, e));
+    running.merge(parts.back());
+    b = e;
+  }
+  check_same(running, all);
+  check_same(merge_pairwise(parts), all);
+
+  // single-value parts, the finest split there is
+  vector<Moments> ones;
+  for (size_t i = 0; i < 1000; ++i)
+    ones.push_back(direct(v, i, i + 1));
+  check_same(merge_pairwise(ones), direct(v, 0, 1000));
+
+  // empty sides leave the other untouched
+  Moments empty;
+  Moments m = all;
+  m.merge(empty);
+  check_same(m, all);
+  empty.merge(all);
+  check_same(empty, all);
+  CHECK(merge_pairwise(vector<Moments>()).n == 0);
+  CHECK(Moments().variance() == 0);
+
+  // NaN cells are no data, even when the no-data value is NaN itself
+  {
+    const float nan = numeric_limits<float>::quiet_NaN();
+    const float row[6] = { nan, 3, -32767, 7, nan, 5 };
+    RowStats<float> all;
+    all.add(row, 6);
+    CHECK(all.count == 4);
+    CHECK(all.min == -32767 && all.max == 7);
+    RowStats<float> masked(true, -32767);
+    masked.add(row, 6);
+    CHECK(masked.count == 3);
+    CHECK(masked.min == 3 && masked.max == 7);
+    CHECK(masked.sum == 15);
+    RowStats<float> nan_nodata(true, nan);
+    nan_nodata.add(row, 6);
+    CHECK(nan_nodata.count == 4);
+    CHECK(nan_nodata.min == -32767 && nan_nodata.max == 7);
+    CHECK(is_nan_cell(nan) && is_nan_cell(static_cast<double>(nan)));
+    CHECK(!is_nan_cell(0.0f) && !is_nan_cell(-32767));
+
+    RowStats<short> shorts(true, -32767);
+    const short s[4] = { -32767, 12, -4, -32767 };
+    shorts.add(s, 4);
+    CHECK(shorts.count == 2 && shorts.min == -4 && shorts.max == 12);
+  }
+
+  return check_result("moments");
+}
@@ -0,0 +1,150 @@
+// the fused row kernels (pixel_pipeline.h) against hand-computed
+// heights, at every cell type that can hold the input
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+#include "pixel_pipeline.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+struct Case {
+  double   v;
+  unsigned flags;
+  float    zscale;
+  float    zunits;
+  int      base;
+  int      lo;
+  int      hi;
+  double   nodata;
+  int      want;
+};
+
+const int NONE = -32767;  // the no-data value of the cases that mask
+const int LO = 0;
+const int HI = 65535;
+
+const Case cases[] = {
+  // plain conversion truncates toward zero, as static_cast<int> did
+  { 1234.7, 0, 1, 1, 0, LO, HI, NONE, 1234 },
+  { -1234.7, 0, 1, 1, 0, LO, HI, NONE, -1234 },
+  { 0, 0, 1, 1, 0, LO, HI, NONE, 0 },
+
+  // '--zstep': the nearest step on both sides of sea level
+  { -86.04, PIX_STEP, 1, 10, 0, LO, HI, NONE, -860 },
+  { -86.06, PIX_STEP, 1, 10, 0, LO, HI, NONE, -861 },
+  { 86.04, PIX_STEP, 1, 10, 0, LO, HI, NONE, 860 },
+  { 86.06, PIX_STEP, 1, 10, 0, LO, HI, NONE, 861 },
+  { -0.04, PIX_STEP, 1, 10, 0, LO, HI, NONE, 0 },
+  { -0.05, PIX_STEP, 1, 10, 0, LO, HI, NONE, -1 },
+  { 0.25, PIX_STEP, 1, 2, 0, LO, HI, NONE, 1 },     // halves away from 0
+  { -0.25, PIX_STEP, 1, 2, 0, LO, HI, NONE, -1 },
+  { -86, PIX_STEP, 1, 10, 0, LO, HI, NONE, -860 },
+  { 7, PIX_STEP, 1, 3, 0, LO, HI, NONE, 21 },
+
+  // vertical exaggeration, alone and before the step
+  { 100, PIX_SCALE, 1.5f, 1, 0, LO, HI, NONE, 150 },
+  { -100, PIX_SCALE, 1.5f, 1, 0, LO, HI, NONE, -150 },
+  { 10.3, PIX_SCALE | PIX_STEP, 2, 10, 0, LO, HI, NONE, 206 },
+
+  // chop: heights from the base
+  { 1500, PIX_CHOP, 1, 1, 1000, LO, HI, NONE, 500 },
+  { 500, PIX_CHOP, 1, 1, 1000, LO, HI, NONE, -500 },
+
+  // clamp: both ends of the range and just past them
+  { -5, PIX_CLAMP, 1, 1, 0, LO, HI, NONE, 0 },
+  { 0, PIX_CLAMP, 1, 1, 0, LO, HI, NONE, 0 },
+  { 65535, PIX_CLAMP, 1, 1, 0, LO, HI, NONE, 65535 },
+  { 65536, PIX_CLAMP, 1, 1, 0, LO, HI, NONE, 65535 },
+  { 41000, PIX_CLAMP, 1, 1, 0, -50, 40000, NONE, 40000 },
+  { -60, PIX_CLAMP, 1, 1, 0, -50, 40000, NONE, -50 },
+  { -50, PIX_CLAMP, 1, 1, 0, -50, 40000, NONE, -50 },
+
+  // chop then clamp
+  { 999, PIX_CHOP | PIX_CLAMP, 1, 1, 1000, LO, HI, NONE, 0 },
+  { 1000, PIX_CHOP | PIX_CLAMP, 1, 1, 1000, LO, HI, NONE, 0 },
+  { 1001, PIX_CHOP | PIX_CLAMP, 1, 1, 1000, LO, HI, NONE, 1 },
+  { 66535, PIX_CHOP | PIX_CLAMP, 1, 1, 1000, LO, HI, NONE, 65535 },
+  { 66536, PIX_CHOP | PIX_CLAMP, 1, 1, 1000, LO, HI, NONE, 65535 },
+
+  // no-data cells drop far below the ground, and to 0 once clamped
+  { NONE, PIX_MASK, 1, 1, 0, LO, HI, NONE, -1000000 },
+  { NONE + 1, PIX_MASK, 1, 1, 0, LO, HI, NONE, NONE + 1 },
+  { NONE, PIX_MASK | PIX_CLAMP, 1, 1, 0, LO, HI, NONE, 0 },
+  { NONE, PIX_MASK | PIX_CHOP | PIX_CLAMP, 1, 1, -500, LO, HI, NONE, 0 },
+  { NONE, PIX_MASK | PIX_STEP | PIX_CLAMP, 1, 10, 0, LO, HI, NONE, 0 },
+  { NONE, PIX_MASK | PIX_SCALE | PIX_STEP, 2, 10, 0, LO, HI, NONE,
+    -20000000 },
+
+  // float cells saturate instead of overflowing an int
+  { 3e9, 0, 1, 1, 0, LO, HI, NONE, 1000000000 },
+  { -3e9, 0, 1, 1, 0, LO, HI, NONE, -1000000000 },
+  { 3e9, PIX_CHOP, 1, 1, 1000, LO, HI, NONE, 999999000 },
+};
+
+// run case 'c' on a row of T cells (if T can hold its values)
+template <class T>
+void
+check_case(const Case& c, const int i, const char* type)
+{
+  const bool is_float = numeric_limits<T>::is_specialized
+                        && !numeric_limits<T>::is_integer;
+  if (!is_float) {
+    if (c.v != floor(c.v) || fabs(c.v) > 1e6
+        || c.v < static_cast<double>(numeric_limits<T>::lowest())
+        || c.v > static_cast<double>(numeric_limits<T>::max()))
+      return;
+    if ((c.flags & PIX_MASK)
+        && (c.nodata < static_cast<double>(numeric_limits<T>::lowest())
+            || c.nodata > static_cast<double>(numeric_limits<T>::max())))
+      return;
+  }
+  PixelParams p;
+  p.nodata = c.nodata;
+  p.zscale = c.zscale;
+  p.zunits = c.zunits;
+  p.base = c.base;
+  p.lo = c.lo;
+  p.hi = c.hi;
+  // a few cells, so the loop runs more than once
+  const T in[3] = { static_cast<T>(c.v), static_cast<T>(c.v),
+                    static_cast<T>(c.v) };
+  int out[3] = { 12345, 12345, 12345 };
+  select_row_kernel<T>(c.flags)(in, out, 3, p);
+  for (int j = 0; j < 3; ++j) {
+    if (out[j] != c.want) {
+      fprintf(stderr, "case %d (%s): %d, not %d\n", i, type, out[j], c.want);
+      CHECK(out[j] == c.want);
+      return;
+    }
+  }
+}
+
+} // namespace
+
+int
+main()
+{
+  const int ncases = sizeof(cases) / sizeof(cases[0]);
+  for (int i = 0; i < ncases; ++i) {
+    check_case<unsigned char>(cases[i], i, "unsigned char");
+    check_case<short>(cases[i], i, "short");
+    check_case<unsigned short>(cases[i], i, "unsigned short");
+    check_case<int>(cases[i], i, "int");
+    check_case<unsigned>(cases[i], i, "unsigned");
+    check_case<float>(cases[i], i, "float");
+    check_case<double>(cases[i], i, "double");
+  }
+
+  // the table holds a different kernel for every combination of bits,
+  // and only the low bits select one
+  CHECK(select_row_kernel<short>(PIX_MASK) != select_row_kernel<short>(0));
+  CHECK(select_row_kernel<short>(PIX_NCOMBOS | PIX_CHOP)
+        == select_row_kernel<short>(PIX_CHOP));
+
+  return check_result("pixel_pipeline");
+}
@@ -0,0 +1,150 @@
+// PngWriter (png_writer.h): the file is read back chunk by chunk, the
+// image data inflated with zlib and unfiltered, and compared with the
+// rows that went in
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h> // unlink
+
+#include <zlib.h>
+
+#include "png_writer.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+unsigned long
+get_u32(const unsigned char* p)
+{
+  return (static_cast<unsigned long>(p[0]) << 24) | (p[1] << 16)
+    | (p[2] << 8) | p[3];
+}
+
+// the image of a w by h PNG with 'channels' samples a pixel, or empty
+// if the file isn't one PngWriter could have written
+vector<unsigned char>
+read_png(const string& fname, const int w, const int h, const int channels)
+{
+  vector<unsigned char> image;
+  FILE* fp = fopen(fname.c_str(), "rb");
+  if (!fp)
+    return image;
+  vector<unsigned char> file;
+  unsigned char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    file.insert(file.end(), buf, buf + n);
+  fclose(fp);
+
+  static const unsigned char sig[8] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+  };
+  CHECK(file.size() > 8 && equal(sig, sig + 8, file.begin()));
+
+  // every chunk's CRC; IHDR first, the IDATs together, IEND last
+  vector<unsigned char> zdata;
+  vector<string> types;
+  for (size_t at = 8; at + 12 <= file.size(); ) {
+    const unsigned long len = get_u32(&file[at]);
+    if (at + 12 + len > file.size())
+      return image;
+    const string type(file.begin() + at + 4, file.begin() + at + 8);
+    const unsigned char* data = &file[at + 8];
+    const unsigned long crc
+      = crc32(crc32(0, &file[at + 4], 4), data, static_cast<uInt>(len));
+    CHECK(crc == get_u32(data + len));
+    if (type == "IHDR") {
+      CHECK(len == 13);
+      CHECK(get_u32(data) == static_cast<unsigned long>(w));
+      CHECK(get_u32(data + 4) == static_cast<unsigned long>(h));
+      CHECK(data[8] == 8);
+      CHECK(data[9] == (channels == 3 ? 2 : 0));
+    }
+    if (type == "IDAT")
+      zdata.insert(zdata.end(), data, data + len);
+    if (types.empty() || types.back() != type)
+      types.push_back(type);
+    at += 12 + len;
+  }
+  CHECK(types.size() == 3 && types[0] == "IHDR" && types[1] == "IDAT"
+        && types[2] == "IEND");
+
+  // a filter byte before every row
+  const size_t stride = static_cast<size_t>(w) * channels;
+  vector<unsigned char> raw((stride + 1) * h + 1);
+  uLongf rawlen = static_cast<uLongf>(raw.size());
+  if (zdata.empty()
+      || uncompress(&raw[0], &rawlen, &zdata[0],
+                    static_cast<uLong>(zdata.size())) != Z_OK
+      || rawlen != (stride + 1) * h)
+    return image;
+
+  // undo filter 1 (Sub): each byte holds the difference from the one
+  // a pixel to its left
+  image.resize(stride * h);
+  for (int y = 0; y < h; ++y) {
+    const unsigned char* in = &raw[y * (stride + 1)];
+    CHECK(in[0] == 1);
+    unsigned char* out = &image[y * stride];
+    for (size_t i = 0; i < stride; ++i)
+      out[i] = static_cast<unsigned char>(
+        in[1 + i] + (i >= static_cast<size_t>(channels) ? out[i - channels]
+                                                         : 0));
+  }
+  return image;
+}
+
+void
+round_trip(const int w, const int h, const int channels, const int level)
+{
+  const string fname("/tmp/png_writer_test.png");
+  vector<unsigned char> image(static_cast<size_t>(w) * h * channels);
+  unsigned seed = 33;
+  for (size_t i = 0; i < image.size(); ++i) {
+    // smooth ramps with some noise, like a shaded relief
+    seed = seed * 1103515245 + 12345;
+    image[i] = static_cast<unsigned char>(i / channels % w + (seed >> 28));
+  }
+
+  PngWriter png;
+  CHECK(png.open(fname, w, h, level, channels));
+  for (int y = 0; y < h; ++y)
+    CHECK(png.write_row(&image[static_cast<size_t>(y) * w * channels]));
+  CHECK(png.close());
+  CHECK(read_png(fname, w, h, channels) == image);
+  unlink(fname.c_str());
+}
+
+} // namespace
+
+int
+main()
+{
+  round_trip(1, 1, 1, Z_DEFAULT_COMPRESSION);
+  round_trip(37, 23, 1, 6);
+  round_trip(64, 48, 3, 0);
+  round_trip(64, 48, 3, 9);
+  // big enough for several IDAT chunks
+  round_trip(512, 512, 3, 0);
+
+  // rows missing at close, and bad arguments
+  {
+    PngWriter png;
+    CHECK(png.open("/tmp/png_writer_test.png", 4, 4, 6, 1));
+    const unsigned char row[4] = { 1, 2, 3, 4 };
+    CHECK(png.write_row(row));
+    CHECK(!png.close());
+    unlink("/tmp/png_writer_test.png");
+  }
+  {
+    PngWriter png;
+    CHECK(!png.open("/tmp/png_writer_test.png", 0, 4, 6, 3));
+    CHECK(!png.open("/tmp/png_writer_test.png", 4, 4, 6, 2));
+  }
+
+  return check_result("png_writer");
+}
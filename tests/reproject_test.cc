@@ -0,0 +1,162 @@
+// Reprojector (reproject.h): a geographic grid whose cells hold their
+// own column (or row) number, reprojected to UTM, against the exact
+// inverse transform of every output cell's center
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+
+#include "gdal_priv.h"
+#include "gdal_frmts.h"
+#include "cpl_conv.h"
+#include "ogr_spatialref.h"
+#include "reproject.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+// the source: NX x NY cells of 4 arc-minutes, ten degrees each way
+// about 105 W (UTM zone 13's central meridian) near 67 N, coarse and
+// far north enough that the transform grid must be refined to reach
+// its error bound
+const int NX = 150;
+const int NY = 150;
+const double WEST = -110;
+const double NORTH = 72;
+const double ARC_SECONDS = 240.0 / 3600;
+
+// x, y in GIS order (longitude first) whatever the system's axes
+void
+gis_order(OGRSpatialReference& sr)
+{
+#if GDAL_VERSION_MAJOR >= 3
+  sr.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+#else
+  (void)sr;
+#endif
+}
+
+// the source data set, its cells their column number (or row, if
+// 'rows'), 0 on failure
+GDALDataset*
+make_set(const bool rows)
+{
+  GDALDriver* mem = GetGDALDriverManager()->GetDriverByName("MEM");
+  GDALDataset* set = mem ? mem->Create("", NX, NY, 1, GDT_Float32, 0) : 0;
+  if (!set)
+    return 0;
+  double gt[6] = { WEST, ARC_SECONDS, 0, NORTH, 0, -ARC_SECONDS };
+  set->SetGeoTransform(gt);
+  OGRSpatialReference geog;
+  geog.SetWellKnownGeogCS("WGS84");
+  char* wkt(0);
+  geog.exportToWkt(&wkt);
+  set->SetProjection(wkt);
+  CPLFree(wkt);
+
+  vector<float> cells(NX * NY);
+  for (int y = 0; y < NY; ++y)
+    for (int x = 0; x < NX; ++x)
+      cells[y * NX + x] = static_cast<float>(rows ? y : x);
+  if (set->GetRasterBand(1)->RasterIO(GF_Write, 0, 0, NX, NY, &cells[0],
+                                      NX, NY, GDT_Float32, 0, 0) != CE_None) {
+    GDALClose(set);
+    return 0;
+  }
+  return set;
+}
+
+// reproject the set of column (or row) numbers to UTM with the
+// bilinear kernel, which gives back the source position it samples:
+// within the transform grid's error of the exact one inside the
+// source, no data outside it
+void
+check_positions(const bool rows)
+{
+  GDALDataset* set = make_set(rows);
+  CHECK(set != 0);
+  if (!set)
+    return;
+  Reprojector r;
+  const bool ok = r.setup(set, "utm", 0, RESAMPLE_BILINEAR,
+                          rows ? "rows" : "columns", 2);
+  CHECK(ok);
+  CHECK(r.target() == "EPSG:32613");
+  if (!ok) {
+    GDALClose(set);
+    return;
+  }
+  CHECK(r.error() <= 0.125);
+
+  OGRSpatialReference dest, geog;
+  dest.importFromEPSG(atoi(r.target().c_str() + 5));
+  geog.SetWellKnownGeogCS("WGS84");
+  gis_order(dest);
+  gis_order(geog);
+  OGRCoordinateTransformation* inverse
+    = OGRCreateCoordinateTransformation(&dest, &geog);
+  CHECK(inverse != 0);
+
+  vector<float> row(r.nx());
+  vector<double> xs(r.nx()), ys(r.nx());
+  vector<int> good(r.nx());
+  int inside(0), outside(0), bad_inside(0), bad_outside(0);
+  double worst(0);
+  for (int i = 0; i < r.ny() && inverse; ++i) {
+    CHECK(r.read_row(&row[0]));
+    for (int j = 0; j < r.nx(); ++j) {
+      xs[j] = r.left() + (j + 0.5) * r.cell();
+      ys[j] = r.top() - (i + 0.5) * r.cell();
+      good[j] = 0;
+    }
+    inverse->Transform(r.nx(), &xs[0], &ys[0], 0, &good[0]);
+    for (int j = 0; j < r.nx(); ++j) {
+      if (!good[j])
+        continue;
+      // the exact source position, cell centers at whole numbers
+      const double u = (xs[j] - WEST) / ARC_SECONDS - 0.5;
+      const double v = (NORTH - ys[j]) / ARC_SECONDS - 0.5;
+      const double want = rows ? v : u;
+      // clear of the edges by more than the error, so the bilinear
+      // taps are two distinct cells
+      if (u >= 1 && u <= NX - 2 && v >= 1 && v <= NY - 2) {
+        ++inside;
+        const double err = fabs(row[j] - want);
+        worst = max(worst, err);
+        bad_inside += row[j] == Reprojector::NODATA || err > 0.125 + 1e-3;
+      }
+      else if (u < -0.75 || u > NX - 0.25 || v < -0.75 || v > NY - 0.25) {
+        ++outside;
+        bad_outside += row[j] != Reprojector::NODATA;
+      }
+    }
+  }
+  if (worst > 0.125 + 1e-3)
+    fprintf(stderr, "%s: %.4f source cells off\n", rows ? "rows" : "columns",
+            worst);
+  CHECK(inside > NX * NY / 2);
+  CHECK(outside > 0);
+  CHECK(bad_inside == 0);
+  CHECK(bad_outside == 0);
+
+  float extra;
+  CHECK(!r.read_row(&extra));
+  if (inverse)
+    OGRCoordinateTransformation::DestroyCT(inverse);
+  GDALClose(set);
+}
+
+} // namespace
+
+int
+main()
+{
+  GDALRegister_MEM();
+  check_positions(false);
+  check_positions(true);
+  return check_result("reproject");
+}
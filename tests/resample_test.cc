@@ -0,0 +1,225 @@
+// kernel_taps() and Resampler (resample.h): tap weights, edge
+// clamping, constant and linear grids, and the no-data mask, on
+// in-memory data sets
+
+#include <cmath>
+#include <vector>
+
+#include "gdal_priv.h"
+#include "gdal_frmts.h"
+#include "resample.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+const ResampleKernel kernels[3] = {
+  RESAMPLE_NEAREST, RESAMPLE_BILINEAR, RESAMPLE_BICUBIC
+};
+
+// an in-memory single band data set of nx by ny cells, 0 on failure
+GDALDataset*
+make_set(const int nx, const int ny, vector<float>& cells)
+{
+  GDALDriver* mem = GetGDALDriverManager()->GetDriverByName("MEM");
+  GDALDataset* set = mem ? mem->Create("", nx, ny, 1, GDT_Float32, 0) : 0;
+  if (set && set->GetRasterBand(1)->RasterIO(GF_Write, 0, 0, nx, ny,
+                                              &cells[0], nx, ny,
+                                              GDT_Float32, 0, 0) != CE_None) {
+    GDALClose(set);
+    set = 0;
+  }
+  return set;
+}
+
+// all the rows of 'r'
+vector<float>
+read_all(Resampler& r)
+{
+  vector<float> out(static_cast<size_t>(r.nx()) * r.ny());
+  for (int i = 0; i < r.ny(); ++i)
+    CHECK(r.read_row(&out[static_cast<size_t>(i) * r.nx()]));
+  float extra;
+  CHECK(!r.read_row(&extra));
+  return out;
+}
+
+void
+check_taps()
+{
+  int index[4];
+  float weight[4];
+  // weights sum to 1 everywhere, past the edges too, and the taps stay
+  // inside the axis
+  for (int k = 0; k < 3; ++k) {
+    int bad(0);
+    for (double u = -2.0; u <= 12.0; u += 0.0625) {
+      const int n = kernel_taps(kernels[k], u, 11, index, weight);
+      CHECK(n == (k == 0 ? 1 : k == 1 ? 2 : 4));
+      double sum(0);
+      for (int t = 0; t < n; ++t) {
+        sum += weight[t];
+        bad += index[t] < 0 || index[t] > 10;
+      }
+      bad += fabs(sum - 1) > 1e-6;
+    }
+    CHECK(bad == 0);
+  }
+
+  CHECK(kernel_taps(RESAMPLE_NEAREST, 2.5, 11, index, weight) == 1);
+  CHECK(index[0] == 3 && weight[0] == 1);
+  CHECK(kernel_taps(RESAMPLE_NEAREST, 2.49, 11, index, weight) == 1);
+  CHECK(index[0] == 2);
+
+  CHECK(kernel_taps(RESAMPLE_BILINEAR, 2.25, 11, index, weight) == 2);
+  CHECK(index[0] == 2 && index[1] == 3);
+  CHECK(weight[0] == 0.75f && weight[1] == 0.25f);
+  // before the first cell center both taps are the edge cell
+  CHECK(kernel_taps(RESAMPLE_BILINEAR, -0.75, 11, index, weight) == 2);
+  CHECK(index[0] == 0 && index[1] == 0);
+  CHECK(weight[0] == 0.75f && weight[1] == 0.25f);
+
+  // on a cell center the cubic is that cell alone
+  CHECK(kernel_taps(RESAMPLE_BICUBIC, 3.0, 11, index, weight) == 4);
+  CHECK(index[0] == 2 && index[1] == 3 && index[2] == 4 && index[3] == 5);
+  CHECK(weight[0] == 0 && weight[1] == 1 && weight[2] == 0 && weight[3] == 0);
+  // halfway, Keys' a = -0.5 weights: -1/16, 9/16, 9/16, -1/16
+  kernel_taps(RESAMPLE_BICUBIC, 3.5, 11, index, weight);
+  CHECK(fabs(weight[0] + 0.0625) < 1e-6 && fabs(weight[1] - 0.5625) < 1e-6);
+  CHECK(fabs(weight[2] - 0.5625) < 1e-6 && fabs(weight[3] + 0.0625) < 1e-6);
+  // at the last cell the taps past it repeat it
+  kernel_taps(RESAMPLE_BICUBIC, 9.5, 11, index, weight);
+  CHECK(index[0] == 8 && index[1] == 9 && index[2] == 10 && index[3] == 10);
+}
+
+// 30 m x 10 m cells of one height come out that height at 10 m
+void
+check_constant()
+{
+  const int nx = 50;
+  const int ny = 40;
+  vector<float> cells(nx * ny, 42.5f);
+  GDALDataset* set = make_set(nx, ny, cells);
+  CHECK(set != 0);
+  if (!set)
+    return;
+  for (int k = 0; k < 3; ++k) {
+    Resampler r(set->GetRasterBand(1), 30, 10, 10, kernels[k], false, 0, 3);
+    CHECK(r.nx() == 150 && r.ny() == 40);
+    const vector<float> out(read_all(r));
+    int bad(0);
+    for (size_t i = 0; i < out.size(); ++i)
+      bad += fabs(out[i] - 42.5f) > 1e-4;
+    CHECK(bad == 0);
+  }
+  GDALClose(set);
+}
+
+// a plane over 20 m x 10 m cells: the bilinear and cubic kernels give
+// it back exactly away from the edges, the nearest cell within half a
+// cell's rise.  Over 300 output rows, so in more than one block.
+void
+check_ramp()
+{
+  const int nx = 40;
+  const int ny = 300;
+  const double cellx = 20;
+  const double celly = 10;
+  const double cell = 10;
+  // heights over the cell centers' meters
+  const double a = 0.5;
+  const double b = -0.25;
+  vector<float> cells(nx * ny);
+  for (int y = 0; y < ny; ++y)
+    for (int x = 0; x < nx; ++x)
+      cells[y * nx + x] = static_cast<float>(1000 + a * (x + 0.5) * cellx
+                                             + b * (y + 0.5) * celly);
+  GDALDataset* set = make_set(nx, ny, cells);
+  CHECK(set != 0);
+  if (!set)
+    return;
+  for (int k = 0; k < 3; ++k) {
+    Resampler r(set->GetRasterBand(1), cellx, celly, cell, kernels[k], false,
+                0, 2);
+    CHECK(r.nx() == 80 && r.ny() == 300);
+    const vector<float> out(read_all(r));
+    const double tol = k == 0 ? 0.5 * (fabs(a) * cellx + fabs(b) * celly)
+                                + 1e-3
+                              : 2e-3;
+    int bad(0), checked(0);
+    for (int i = 0; i < r.ny(); ++i) {
+      for (int j = 0; j < r.nx(); ++j) {
+        // the output cell's center, in source cells (centers at whole
+        // numbers), clear of the edges by the cubic's reach
+        const double u = (j + 0.5) * cell / cellx - 0.5;
+        const double v = (i + 0.5) * cell / celly - 0.5;
+        if (u < 1 || u > nx - 3 || v < 1 || v > ny - 3)
+          continue;
+        const double want = 1000 + a * (j + 0.5) * cell + b * (i + 0.5) * cell;
+        bad += fabs(out[static_cast<size_t>(i) * r.nx() + j] - want) > tol;
+        ++checked;
+      }
+    }
+    CHECK(checked > 1000);
+    CHECK(bad == 0);
+  }
+  GDALClose(set);
+}
+
+// one no-data cell: the output cells with it under a bilinear tap of
+// non-zero weight are no-data, all others keep the height
+void
+check_nodata()
+{
+  const int nx = 40;
+  const int ny = 40;
+  const float nodata = -9999;
+  vector<float> cells(nx * ny, 5);
+  cells[20 * nx + 20] = nodata;
+  GDALDataset* set = make_set(nx, ny, cells);
+  CHECK(set != 0);
+  if (!set)
+    return;
+
+  // 20 m x 10 m cells to 10 m: output column j is at u = j / 2 - 1/4
+  // (cells 39 to 42 are within a cell of u = 20), row i at v = i
+  Resampler r(set->GetRasterBand(1), 20, 10, 10, RESAMPLE_BILINEAR, true,
+              nodata, 2);
+  vector<float> out(read_all(r));
+  int bad(0), nnodata(0);
+  for (int i = 0; i < r.ny(); ++i) {
+    for (int j = 0; j < r.nx(); ++j) {
+      const float v = out[static_cast<size_t>(i) * r.nx() + j];
+      const bool under = i == 20 && j >= 39 && j <= 42;
+      nnodata += v == nodata;
+      bad += under ? v != nodata : fabs(v - 5) > 1e-5;
+    }
+  }
+  CHECK(nnodata == 4);
+  CHECK(bad == 0);
+
+  // without a no-data value the cell is just low ground
+  Resampler plain(set->GetRasterBand(1), 20, 10, 10, RESAMPLE_BILINEAR,
+                  false, 0, 2);
+  out = read_all(plain);
+  nnodata = 0;
+  for (size_t i = 0; i < out.size(); ++i)
+    nnodata += out[i] == nodata;
+  CHECK(nnodata == 0);
+  CHECK(out[20 * plain.nx() + 40] < 5);
+  GDALClose(set);
+}
+
+} // namespace
+
+int
+main()
+{
+  GDALRegister_MEM();
+  check_taps();
+  check_constant();
+  check_ramp();
+  check_nodata();
+  return check_result("resample");
+}
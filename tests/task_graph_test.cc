@@ -0,0 +1,120 @@
+// TaskGraph (task_graph.h): dependency order, failure propagation and
+// cached tasks
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+#include "task_graph.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+// the dependency list 'a' (and 'b')
+vector<int>
+deps(const int a, const int b = -1)
+{
+  vector<int> d(1, a);
+  if (b >= 0)
+    d.push_back(b);
+  return d;
+}
+
+} // namespace
+
+int
+main()
+{
+  // a failure skips its dependents, and on one thread nothing else
+  // starts after it
+  {
+    TaskGraph g;
+    bool ran_c(false), ran_e(false);
+    const int a = g.add("a", []() { return true; });
+    const int b = g.add("b", []() { return false; }, deps(a));
+    const int c = g.add("c", [&]() { ran_c = true; return true; }, deps(b));
+    const int d = g.add("d", []() { return true; });
+    const int e = g.add("e", [&]() { ran_e = true; return true; }, deps(d));
+    CHECK(!g.run(1));
+    CHECK(g.state(a) == TaskGraph::DONE);
+    CHECK(g.state(b) == TaskGraph::FAILED);
+    CHECK(g.state(c) == TaskGraph::SKIPPED);
+    CHECK(g.state(d) == TaskGraph::DONE);
+    CHECK(g.state(e) == TaskGraph::SKIPPED);
+    CHECK(!ran_c);
+    CHECK(!ran_e);
+  }
+
+  // on many threads everything downstream of a failure is skipped
+  for (int round = 0; round < 20; ++round) {
+    TaskGraph g;
+    atomic<int> ran(0);
+    const int root = g.add("root", []() { return true; });
+    const int bad = g.add("bad", []() { return false; }, deps(root));
+    vector<int> below;
+    int prev = bad;
+    for (int i = 0; i < 10; ++i) {
+      prev = g.add("below", [&]() { ++ran; return true; }, deps(prev, root));
+      below.push_back(prev);
+    }
+    CHECK(!g.run(8));
+    CHECK(g.state(bad) == TaskGraph::FAILED);
+    CHECK(ran == 0);
+    for (size_t i = 0; i < below.size(); ++i)
+      CHECK(g.state(below[i]) == TaskGraph::SKIPPED);
+  }
+
+  // a task only starts once all its dependencies are done
+  for (int round = 0; round < 20; ++round) {
+    TaskGraph g;
+    mutex lock;
+    vector<int> order;
+    auto step = [&](const int id) {
+      return [&, id]() {
+        lock_guard<mutex> hold(lock);
+        order.push_back(id);
+        return true;
+      };
+    };
+    // a diamond: 0 -> (1, 2) -> 3, plus 4 on its own
+    g.add("top", step(0));
+    g.add("left", step(1), deps(0));
+    g.add("right", step(2), deps(0));
+    g.add("bottom", step(3), deps(1, 2));
+    g.add("alone", step(4));
+    CHECK(g.run(4));
+    CHECK(order.size() == 5);
+    vector<int> at(5, -1);
+    for (size_t i = 0; i < order.size(); ++i)
+      at[order[i]] = static_cast<int>(i);
+    CHECK(at[0] < at[1] && at[0] < at[2]);
+    CHECK(at[1] < at[3] && at[2] < at[3]);
+    for (int id = 0; id < 5; ++id)
+      CHECK(g.state(id) == TaskGraph::DONE);
+  }
+
+  // a cached task counts as done without running
+  {
+    TaskGraph g;
+    bool ran_a(false), ran_b(false);
+    const int a = g.add("a", [&]() { ran_a = true; return false; });
+    const int b = g.add("b", [&]() { ran_b = true; return true; }, deps(a));
+    g.mark_cached(a);
+    CHECK(g.run());
+    CHECK(!ran_a);
+    CHECK(ran_b);
+    CHECK(g.state(a) == TaskGraph::CACHED);
+    CHECK(g.state(b) == TaskGraph::DONE);
+  }
+
+  // an empty graph succeeds
+  {
+    TaskGraph g;
+    CHECK(g.run());
+    CHECK(g.size() == 0);
+  }
+
+  return check_result("task_graph");
+}
@@ -0,0 +1,149 @@
+// TileCache (tile_cache.h): least recently used eviction, edge
+// clamping, and tiles pinned while many threads read through a cache
+// too small to hold them
+
+#include <map>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "tile_cache.h"
+#include "check.h"
+
+using namespace std;
+
+namespace {
+
+// the cell value at (x, y)
+float
+cell(const int x, const int y)
+{
+  return static_cast<float>(x + 100 * y);
+}
+
+// a reader of cell() values counting the reads of each tile
+struct CountingReader {
+  CountingReader(const int t) : tile(t) {}
+
+  bool operator()(const int x0, const int y0, const int w, const int h,
+                  float* dst)
+  {
+    ++calls[make_pair(x0 / tile, y0 / tile)];
+    for (int y = 0; y < h; ++y)
+      for (int x = 0; x < w; ++x)
+        dst[y * w + x] = cell(x0 + x, y0 + y);
+    return true;
+  }
+
+  int tile;
+  map<pair<int, int>, int> calls;
+};
+
+// read one whole tile and check its cells
+bool
+read_tile(TileCache& cache, const int tx, const int ty, const int tile)
+{
+  vector<float> buf(tile * tile);
+  if (!cache.read(tx * tile, ty * tile, tile, tile, &buf[0]))
+    return false;
+  bool same(true);
+  for (int y = 0; y < tile; ++y)
+    for (int x = 0; x < tile; ++x)
+      same = same && buf[y * tile + x] == cell(tx * tile + x, ty * tile + y);
+  return same;
+}
+
+} // namespace
+
+int
+main()
+{
+  const int TILE = 4;
+  const size_t TILE_BYTES = TILE * TILE * sizeof(float);
+
+  // an 8x8 grid of 2x2 tiles with room for two.  Every read is on an
+  // edge tile and moves toward the edge, so nothing is prefetched.
+  {
+    CountingReader counts(TILE);
+    TileCache cache(8, 8, ref(counts), 2 * TILE_BYTES, TILE);
+    CHECK(read_tile(cache, 0, 1, TILE));  // miss
+    CHECK(read_tile(cache, 1, 1, TILE));  // miss
+    CHECK(read_tile(cache, 0, 1, TILE));  // hit, (1, 1) is now oldest
+    CHECK(read_tile(cache, 0, 0, TILE));  // miss, evicts (1, 1)
+    CHECK(read_tile(cache, 0, 1, TILE));  // hit
+    CHECK(read_tile(cache, 1, 1, TILE));  // miss again, evicts (0, 0)
+    CHECK(counts.calls.size() == 3);
+    CHECK(counts.calls[make_pair(0, 1)] == 1);
+    CHECK(counts.calls[make_pair(1, 1)] == 2);
+    CHECK(counts.calls[make_pair(0, 0)] == 1);
+  }
+
+  // windows hanging off the grid repeat the edge cells
+  {
+    CountingReader counts(TILE);
+    TileCache cache(6, 5, ref(counts), 64 * TILE_BYTES, TILE);
+    vector<float> buf(10 * 9);
+    CHECK(cache.read(-2, -2, 10, 9, &buf[0]));
+    int bad(0);
+    for (int y = 0; y < 9; ++y) {
+      for (int x = 0; x < 10; ++x) {
+        const int gx = min(max(x - 2, 0), 5);
+        const int gy = min(max(y - 2, 0), 4);
+        bad += buf[y * 10 + x] != cell(gx, gy);
+      }
+    }
+    CHECK(bad == 0);
+  }
+
+  // many threads reading random windows through a one-tile budget:
+  // tiles being copied from must not be evicted under them
+  {
+    const int NX = 61;
+    const int NY = 47;
+    TileCache cache(NX, NY, [](const int x0, const int y0, const int w,
+                               const int h, float* dst) {
+                      for (int y = 0; y < h; ++y)
+                        for (int x = 0; x < w; ++x)
+                          dst[y * w + x] = cell(x0 + x, y0 + y);
+                      return true;
+                    }, TILE_BYTES, TILE);
+    atomic<int> bad(0);
+    vector<thread> readers;
+    for (int i = 0; i < 8; ++i) {
+      readers.push_back(thread([&, i]() {
+          mt19937 gen(40 + i);
+          uniform_int_distribution<int> px(-3, NX), py(-3, NY), len(1, 13);
+          vector<float> buf;
+          for (int n = 0; n < 2000; ++n) {
+            const int x0 = px(gen), y0 = py(gen), w = len(gen), h = len(gen);
+            buf.assign(w * h, -1);
+            if (!cache.read(x0, y0, w, h, &buf[0])) {
+              ++bad;
+              continue;
+            }
+            for (int y = 0; y < h; ++y)
+              for (int x = 0; x < w; ++x)
+                bad += buf[y * w + x]
+                       != cell(min(max(x0 + x, 0), NX - 1),
+                               min(max(y0 + y, 0), NY - 1));
+          }
+        }));
+    }
+    for (size_t i = 0; i < readers.size(); ++i)
+      readers[i].join();
+    CHECK(bad == 0);
+  }
+
+  // a failed read fails the window
+  {
+    TileCache cache(8, 8, [](int, int, int, int, float*) { return false; },
+                    4 * TILE_BYTES, TILE);
+    vector<float> buf(4);
+    CHECK(!cache.read(1, 1, 2, 2, &buf[0]));
+  }
+
+  return check_result("tile_cache");
+}
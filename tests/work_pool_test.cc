@@ -0,0 +1,105 @@
+// WorkPool (work_pool.h): every job and subtask runs exactly once,
+// idle workers steal subtasks, and groups work from outside the pool
+
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+#include "work_pool.h"
+#include "check.h"
+
+using namespace std;
+
+int
+main()
+{
+  CHECK(WorkPool(0).workers() == 1);
+  CHECK(WorkPool(3).workers() == 3);
+  CHECK(WorkPool::current() == 0);
+
+  // jobs split into subtasks, some of those split again
+  {
+    const int NJOBS = 16;
+    const int NSUB = 50;
+    WorkPool pool(4);
+    vector<atomic<int> > runs(NJOBS * NSUB * 3);
+    for (size_t i = 0; i < runs.size(); ++i)
+      runs[i] = 0;
+    atomic<int> in_pool(0);
+    for (int j = 0; j < NJOBS; ++j) {
+      pool.submit([&, j]() {
+          in_pool += WorkPool::current() == &pool;
+          WorkPool::Group group(WorkPool::current());
+          for (int s = 0; s < NSUB; ++s) {
+            const int k = (j * NSUB + s) * 3;
+            group.spawn([&, k]() {
+                ++runs[k];
+                WorkPool::Group inner(WorkPool::current());
+                inner.spawn([&, k]() { ++runs[k + 1]; });
+                inner.spawn([&, k]() { ++runs[k + 2]; });
+              });
+          }
+          group.wait();
+        });
+    }
+    pool.run();
+    CHECK(in_pool == NJOBS);
+    int bad(0);
+    for (size_t i = 0; i < runs.size(); ++i)
+      bad += runs[i] != 1;
+    CHECK(bad == 0);
+  }
+
+  // one job's subtasks are shared out to the workers with no job
+  {
+    WorkPool pool(4);
+    mutex lock;
+    set<thread::id> ran_on;
+    pool.submit([&]() {
+        WorkPool::Group group(WorkPool::current());
+        for (int s = 0; s < 64; ++s) {
+          group.spawn([&]() {
+              this_thread::sleep_for(chrono::milliseconds(2));
+              lock_guard<mutex> hold(lock);
+              ran_on.insert(this_thread::get_id());
+            });
+        }
+      });
+    pool.run();
+    CHECK(ran_on.size() > 1);
+  }
+
+  // a thread outside the pool (a task graph stage) spawning subtasks
+  {
+    WorkPool pool(2);
+    atomic<int> done(0);
+    pool.submit([&]() {
+        WorkPool* p = WorkPool::current();
+        thread stage([&, p]() {
+            CHECK(WorkPool::current() == 0);
+            WorkPool::Group group(p);
+            for (int s = 0; s < 100; ++s)
+              group.spawn([&]() { ++done; });
+            group.wait();
+            CHECK(done == 100);
+          });
+        stage.join();
+      });
+    pool.run();
+    CHECK(done == 100);
+  }
+
+  // without a pool, spawn() runs the task at once
+  {
+    int n(0);
+    WorkPool::Group group(0);
+    group.spawn([&]() { ++n; });
+    CHECK(n == 1);
+    group.wait();
+  }
+
+  return check_result("work_pool");
+}